@@ -0,0 +1,81 @@
+/**
+ * implement aggregates over the values of a linked_hashmap
+ */
+#ifndef SJTU_AGGREGATES_HPP
+#define SJTU_AGGREGATES_HPP
+
+#include <cstddef>
+#include <limits>
+#include <type_traits>
+#include "linked_hashmap.hpp"
+#include "exceptions.hpp"
+#include "simd.hpp"
+
+namespace sjtu {
+    /**
+     * reaches the node arrays of a map for the functions below (see
+     * linked_hashmap::for_value_slots). a scan batched over order_slots
+     * runs at active_simd_level(), a walk of the order list one node at
+     * a time as scalar.
+     */
+struct value_scan {
+	template<class Map, class F>
+	static void run(const Map &map, F f) {
+		map.for_value_slots([&](auto slots, size_t n, size_t offset, bool batched) {
+			f(slots, n, offset, batched ? active_simd_level() : simd_scalar);
+		});
+	}
+};
+
+    /**
+     * the sum of all values of map in insertion order, in the type given
+     * by value_sum (see simd.hpp). only for arithmetic T.
+     * in indexed mode order_slots is scanned with SSE4.2 or AVX2 when
+     * the cpu has them and values are 4 or 8 bytes, holes masked out;
+     * floating sums then may differ from a sequential sum in the last
+     * bits. otherwise the order list is walked.
+     */
+template<class Key, class T, class Hash, class Equal, class Storage>
+typename std::enable_if<std::is_arithmetic<T>::value, typename value_sum<T>::type>::type
+sum_values(const linked_hashmap<Key, T, Hash, Equal, Storage> &map) {
+	typename value_sum<T>::type acc = 0;
+	value_scan::run(map, [&](auto slots, size_t n, size_t offset, simd_level level) {
+		value_kernels<T>::sum(slots, n, offset, acc, level);
+	});
+	return acc;
+}
+
+    /**
+     * the least and the greatest value of map, as sum_values(). NaNs are
+     * skipped. throw container_is_empty if the map is empty.
+     */
+template<class Key, class T, class Hash, class Equal, class Storage>
+typename std::enable_if<std::is_arithmetic<T>::value, pair<T, T> >::type
+min_max_values(const linked_hashmap<Key, T, Hash, Equal, Storage> &map) {
+	if (map.empty()) throw container_is_empty();
+	typedef std::numeric_limits<T> limits;
+	T lo = limits::has_infinity ? limits::infinity() : limits::max();
+	T hi = limits::has_infinity ? -limits::infinity() : limits::lowest();
+	value_scan::run(map, [&](auto slots, size_t n, size_t offset, simd_level level) {
+		value_kernels<T>::min_max(slots, n, offset, lo, hi, level);
+	});
+	return pair<T, T>(lo, hi);
+}
+
+    /**
+     * the number of values of map for which pred(value) returns true.
+     * pred is called once per element, in insertion order.
+     */
+template<class Key, class T, class Hash, class Equal, class Storage, class Pred>
+typename std::enable_if<std::is_arithmetic<T>::value, size_t>::type
+count_if_values(const linked_hashmap<Key, T, Hash, Equal, Storage> &map, Pred pred) {
+	size_t count = 0;
+	value_scan::run(map, [&](auto slots, size_t n, size_t offset, simd_level level) {
+		count += value_kernels<T>::count_if(slots, n, offset, pred, level);
+	});
+	return count;
+}
+
+}
+
+#endif
@@ -0,0 +1,78 @@
+/**
+ * compare the value aggregates of linked_hashmap with iterator loops.
+ *
+ * usage: linked_hashmap_bench_aggregates [n]
+ *   n defaults to 1000000. the map holds n values with a tenth of the
+ *   keys erased again, so indexed mode has holes to skip; times are
+ *   nanoseconds per element.
+ */
+#include "linked_hashmap.hpp"
+#include "aggregates.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+typedef std::chrono::steady_clock clock_type;
+
+volatile double sink;
+
+template<class F>
+double time_per(size_t n, F f) {
+	const int ROUNDS = 5;
+	clock_type::time_point start = clock_type::now();
+	for (int r = 0; r < ROUNDS; r++) sink = (double)f();
+	return std::chrono::duration<double, std::nano>(clock_type::now() - start).count() / ROUNDS / n;
+}
+
+template<class T>
+void run(const char *title, size_t n) {
+	typedef sjtu::linked_hashmap<long long, T> Map;
+	Map map;
+	unsigned long long x = 88172645463325252ULL;
+	for (size_t i = 0; i < n; i++) {
+		x ^= x << 13, x ^= x >> 7, x ^= x << 17;
+		map[(long long)i] = (T)(x % 100000);
+	}
+	for (size_t i = 0; i < n; i += 10) map.erase((long long)i);
+	const Map &cmap = map;
+	for (int indexed = 0; indexed < 2; indexed++) {
+		map.set_indexed(indexed != 0);
+		printf("%s, n = %zu%s (ns/element)\n", title, cmap.size(), indexed ? ", indexed" : "");
+		printf("  sum      loop %6.2f  sum_values      %6.2f\n",
+			time_per(cmap.size(), [&]() {
+				typename sjtu::value_sum<T>::type s = 0;
+				for (typename Map::const_iterator it = cmap.cbegin(); it != cmap.cend(); ++it) s += it->second;
+				return s;
+			}),
+			time_per(cmap.size(), [&]() { return sjtu::sum_values(cmap); }));
+		printf("  min/max  loop %6.2f  min_max_values  %6.2f\n",
+			time_per(cmap.size(), [&]() {
+				T lo = cmap.cbegin()->second, hi = lo;
+				for (typename Map::const_iterator it = cmap.cbegin(); it != cmap.cend(); ++it) {
+					if (it->second < lo) lo = it->second;
+					if (hi < it->second) hi = it->second;
+				}
+				return lo + hi;
+			}),
+			time_per(cmap.size(), [&]() { sjtu::pair<T, T> m = sjtu::min_max_values(cmap); return m.first + m.second; }));
+		printf("  count_if loop %6.2f  count_if_values %6.2f\n",
+			time_per(cmap.size(), [&]() {
+				size_t c = 0;
+				for (typename Map::const_iterator it = cmap.cbegin(); it != cmap.cend(); ++it) c += it->second > 50000;
+				return c;
+			}),
+			time_per(cmap.size(), [&]() { return sjtu::count_if_values(cmap, [](T v) { return v > 50000; }); }));
+	}
+}
+
+}
+
+int main(int argc, char **argv) {
+	size_t n = argc > 1 ? (size_t)std::strtoull(argv[1], nullptr, 10) : 1000000;
+	if (n < 10) n = 10;
+	run<int>("int values", n);
+	run<double>("double values", n);
+	return 0;
+}
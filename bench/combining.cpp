@@ -0,0 +1,118 @@
+/**
+ * compare ways of sharing one linked_hashmap between threads under a
+ * write-heavy load: a mutex around the map, the keys split over shards
+ * each with its own mutex and map, and combining_linked_hashmap.
+ *
+ * usage: linked_hashmap_bench_combining [ops]
+ *   every thread runs ops requests (default 1000000): half assignments,
+ *   a quarter erases and a quarter finds over 65536 keys. times are
+ *   nanoseconds per request over all threads, best of three; "batch" is
+ *   how many requests a combining batch held on average.
+ */
+#include "combining_linked_hashmap.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+typedef std::chrono::steady_clock clock_type;
+typedef sjtu::linked_hashmap<int, long long> Map;
+typedef sjtu::combining_linked_hashmap<int, long long> CombiningMap;
+
+const int KEYS = 65536;
+const int SHARD_BITS = 4;
+const int SHARDS = 1 << SHARD_BITS;
+
+struct locked_map {
+	std::mutex lock;
+	Map map;
+	char pad[64];
+};
+
+/**
+ * run body(thread, op, key, kind) for ops requests on each of threads
+ *   threads; kind 0 and 1 assign, 2 erases and 3 finds.
+ */
+template<class Body>
+double run(int threads, size_t ops, Body body) {
+	clock_type::time_point start = clock_type::now();
+	std::vector<std::thread> workers;
+	for (int t = 0; t < threads; t++) {
+		workers.push_back(std::thread([&, t]() {
+			unsigned long long x = 88172645463325252ULL + t;
+			for (size_t i = 0; i < ops; i++) {
+				x ^= x << 13, x ^= x >> 7, x ^= x << 17;
+				body(t, i, (int)(x % KEYS), (int)(x >> 60) & 3);
+			}
+		}));
+	}
+	for (size_t t = 0; t < workers.size(); t++) workers[t].join();
+	return std::chrono::duration<double, std::nano>(clock_type::now() - start).count() / (ops * threads);
+}
+
+template<class F>
+double best(F f) {
+	double b = 0;
+	for (int r = 0; r < 3; r++) {
+		double t = f();
+		if (r == 0 || t < b) b = t;
+	}
+	return b;
+}
+
+long long request(Map &map, int key, int kind, long long value) {
+	if (kind < 2) {
+		map[key] = value;
+		return 0;
+	}
+	if (kind == 2) return (long long)map.erase(key);
+	Map::const_iterator it = static_cast<const Map &>(map).find(key);
+	return it == map.cend() ? 0 : it->second;
+}
+
+}
+
+int main(int argc, char **argv) {
+	size_t ops = argc > 1 ? (size_t)std::strtoull(argv[1], nullptr, 10) : 1000000;
+	printf("%zu requests per thread (ns/request)\n", ops);
+	int counts[] = {1, 2, 4, 8};
+	for (int c = 0; c < 4; c++) {
+		int threads = counts[c];
+		double mutex_time = best([&]() {
+			locked_map shared;
+			return run(threads, ops, [&](int, size_t i, int key, int kind) {
+				std::lock_guard<std::mutex> guard(shared.lock);
+				request(shared.map, key, kind, (long long)i);
+			});
+		});
+		double sharded_time = best([&]() {
+			std::vector<locked_map> shards(SHARDS);
+			return run(threads, ops, [&](int, size_t i, int key, int kind) {
+				// not key % SHARDS: with std::hash<int> a shard's keys would
+				// then share their low bits and crowd into its own buckets
+				locked_map &shard = shards[((unsigned int)key * 2654435761u) >> (32 - SHARD_BITS)];
+				std::lock_guard<std::mutex> guard(shard.lock);
+				request(shard.map, key, kind, (long long)i);
+			});
+		});
+		double batch = 0;
+		double combining_time = best([&]() {
+			CombiningMap map(threads);
+			std::vector<CombiningMap::handle *> handles(threads);
+			for (int t = 0; t < threads; t++) handles[t] = new CombiningMap::handle(map);
+			double t = run(threads, ops, [&](int thread, size_t i, int key, int kind) {
+				handles[thread]->execute([=](Map &m) { request(m, key, kind, (long long)i); });
+			});
+			for (int h = 0; h < threads; h++) delete handles[h];
+			batch = (double)map.combined_count() / map.batch_count();
+			return t;
+		});
+		printf("  threads %d  mutex %7.1f  sharded %7.1f  combining %7.1f  batch %.2f\n",
+			threads, mutex_time, sharded_time, combining_time, batch);
+	}
+	return 0;
+}
@@ -0,0 +1,122 @@
+/**
+ * compare the kernels of every simd level the cpu runs.
+ *
+ * usage: linked_hashmap_bench_dispatch [n]
+ *   n defaults to 1000000. each row is measured once per level through
+ *   set_active_simd_level, on a map of 30000 elements (in cache) and on
+ *   one of n; times are nanoseconds per lookup or per element, the best
+ *   of three rounds. SJTU_SIMD in the environment caps the levels.
+ */
+#include "linked_hashmap.hpp"
+#include "storage.hpp"
+#include "aggregates.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+
+typedef std::chrono::steady_clock clock_type;
+typedef sjtu::linked_hashmap<int, int, std::hash<int>, std::equal_to<int>, sjtu::cuckoo_storage> cuckoo_map;
+typedef sjtu::linked_hashmap<int, long long> value_map;
+
+volatile long long sink;
+
+unsigned long long rng_state = 88172645463325252ULL;
+int next_key() {
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return (int)(rng_state >> 33);
+}
+
+/**
+ * the best of a few rounds, to keep other load on the machine out.
+ */
+template<class F>
+double best_ns(size_t n, F f) {
+	double best = 0;
+	for (int round = 0; round < 3; round++) {
+		clock_type::time_point start = clock_type::now();
+		sink = (long long)f();
+		double ns = std::chrono::duration<double, std::nano>(clock_type::now() - start).count() / n;
+		if (round == 0 || ns < best) best = ns;
+	}
+	return best;
+}
+
+template<class F>
+void row(const char *title, size_t n, sjtu::simd_level top, F f) {
+	printf("%-26s", title);
+	for (int level = sjtu::simd_scalar; level <= top; level++) {
+		sjtu::set_active_simd_level(sjtu::simd_level(level));
+		printf("%10.1f", best_ns(n, f));
+	}
+	printf("\n");
+}
+
+/**
+ * a cuckoo table takes its kernels when it is allocated, so each level
+ *   measures a copy of map made after switching to it.
+ */
+template<class F>
+void cuckoo_row(const char *title, size_t n, sjtu::simd_level top, const cuckoo_map &map, F f) {
+	printf("%-26s", title);
+	for (int level = sjtu::simd_scalar; level <= top; level++) {
+		sjtu::set_active_simd_level(sjtu::simd_level(level));
+		const cuckoo_map copy(map);
+		printf("%10.1f", best_ns(n, [&]() { return f(copy); }));
+	}
+	printf("\n");
+}
+
+void run(size_t n, sjtu::simd_level top) {
+	std::vector<int> keys, misses;
+	for (size_t i = 0; i < n; i++) keys.push_back(next_key());
+	for (size_t i = 0; i < n; i++) misses.push_back(next_key());
+	cuckoo_map cuckoo;
+	value_map values;
+	for (size_t i = 0; i < n; i++) {
+		cuckoo[keys[i]] = (int)i;
+		values[keys[i]] = next_key();
+	}
+	values.set_indexed(true);
+	for (size_t i = 0; i < n; i += 10) values.erase(keys[i]);
+	const value_map &cvalues = values;
+
+	printf("n = %zu%-16s", n, "");
+	for (int level = sjtu::simd_scalar; level <= top; level++) printf("%10s", sjtu::simd_level_name(sjtu::simd_level(level)));
+	printf("\n");
+	cuckoo_row("cuckoo find hit", n, top, cuckoo, [&](const cuckoo_map &map) {
+		size_t found = 0;
+		for (size_t i = 0; i < n; i++) found += map.count(keys[(i * 7919) % n]);
+		return found;
+	});
+	cuckoo_row("cuckoo find miss", n, top, cuckoo, [&](const cuckoo_map &map) {
+		size_t found = 0;
+		for (size_t i = 0; i < n; i++) found += map.count(misses[i]);
+		return found;
+	});
+	row("sum_values, indexed", cvalues.size(), top, [&]() { return sjtu::sum_values(cvalues); });
+	row("min_max_values, indexed", cvalues.size(), top, [&]() {
+		sjtu::pair<long long, long long> m = sjtu::min_max_values(cvalues);
+		return m.first ^ m.second;
+	});
+	row("count_if_values, indexed", cvalues.size(), top, [&]() {
+		return sjtu::count_if_values(cvalues, [](long long v) { return v > 1000000; });
+	});
+	printf("\n");
+}
+
+}
+
+int main(int argc, char **argv) {
+	size_t n = argc > 1 ? (size_t)std::strtoull(argv[1], nullptr, 10) : 1000000;
+	if (n < 10) n = 10;
+	sjtu::simd_level top = sjtu::active_simd_level();
+	printf("cpu: %s, measuring up to %s\n\n", sjtu::simd_level_name(sjtu::cpu_simd_level()), sjtu::simd_level_name(top));
+	run(30000, top);
+	run(n, top);
+	return 0;
+}
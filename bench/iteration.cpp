@@ -0,0 +1,80 @@
+/**
+ * compare iterator loops over linked_hashmap with for_each, which
+ * prefetches nodes ahead of the one it visits.
+ *
+ * usage: linked_hashmap_bench_iteration [n]
+ *   n defaults to 10000000. "fresh" is a map whose nodes were allocated
+ *   in insertion order; "shuffled" holds the same keys, but inserted
+ *   again after all of them were erased in random order, so malloc hands
+ *   the nodes out scattered over the heap; "defragmented" is that map
+ *   after defragment(). times are nanoseconds per element, best of three.
+ */
+#include "linked_hashmap.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+
+typedef std::chrono::steady_clock clock_type;
+typedef sjtu::linked_hashmap<long long, long long> Map;
+
+volatile long long sink;
+
+template<class F>
+double best_per(size_t n, F f) {
+	double best = 0;
+	for (int r = 0; r < 3; r++) {
+		clock_type::time_point start = clock_type::now();
+		sink = f();
+		double t = std::chrono::duration<double, std::nano>(clock_type::now() - start).count() / n;
+		if (r == 0 || t < best) best = t;
+	}
+	return best;
+}
+
+void run(const char *title, const Map &map) {
+	for (int indexed = 0; indexed < 2; indexed++) {
+		const_cast<Map &>(map).set_indexed(indexed != 0);
+		printf("  %-13s%-8s  ++it %6.2f  for_each %6.2f\n", title, indexed ? "indexed" : "",
+			best_per(map.size(), [&]() {
+				long long s = 0;
+				for (Map::const_iterator it = map.cbegin(); it != map.cend(); ++it) s += it->second;
+				return s;
+			}),
+			best_per(map.size(), [&]() {
+				long long s = 0;
+				map.for_each([&](const Map::value_type &v) { s += v.second; });
+				return s;
+			}));
+	}
+	const_cast<Map &>(map).set_indexed(false);
+}
+
+}
+
+int main(int argc, char **argv) {
+	size_t n = argc > 1 ? (size_t)std::strtoull(argv[1], nullptr, 10) : 10000000;
+	printf("n = %zu (ns/element)\n", n);
+	Map map;
+	for (size_t i = 0; i < n; i++) map[(long long)i] = (long long)i;
+	run("fresh", map);
+
+	std::vector<long long> keys(n);
+	for (size_t i = 0; i < n; i++) keys[i] = (long long)i;
+	unsigned long long x = 88172645463325252ULL;
+	for (size_t i = n - 1; i > 0; i--) {
+		x ^= x << 13, x ^= x >> 7, x ^= x << 17;
+		std::swap(keys[i], keys[x % (i + 1)]);
+	}
+	for (size_t i = 0; i < n; i++) map.erase(keys[i]);
+	for (size_t i = 0; i < n; i++) map[(long long)i] = (long long)i;
+	run("shuffled", map);
+
+	clock_type::time_point start = clock_type::now();
+	map.defragment();
+	printf("  defragment() %.2f ns/element\n", std::chrono::duration<double, std::nano>(clock_type::now() - start).count() / n);
+	run("defragmented", map);
+	return 0;
+}
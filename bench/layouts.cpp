@@ -0,0 +1,138 @@
+/**
+ * compare the storage policies of linked_hashmap on the same workloads.
+ *
+ * usage: linked_hashmap_bench_layouts [n]
+ *   n defaults to 1000000. every workload runs on int keys, on
+ *   16-character string keys and on 8-byte keys with 200-byte values;
+ *   times are nanoseconds per operation, and the last column names the
+ *   fastest layout.
+ */
+#include "linked_hashmap.hpp"
+#include "storage.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace {
+
+const char *const LAYOUTS[] = {"chained", "robin_hood", "cuckoo", "hopscotch", "soa"};
+const int LAYOUT_COUNT = 5;
+const char *const WORKLOADS[] = {"insert", "find hit", "find miss", "iterate", "mixed 90/10", "erase half"};
+const int WORKLOAD_COUNT = 6;
+
+typedef std::chrono::steady_clock clock_type;
+
+double since(clock_type::time_point start, size_t ops) {
+	return std::chrono::duration<double, std::nano>(clock_type::now() - start).count() / ops;
+}
+
+unsigned long long rng_state = 88172645463325252ULL;
+unsigned long long next_rand() {
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return rng_state;
+}
+
+int make_key(int, unsigned long long r) { return (int)(r >> 33); }
+long long make_key(long long, unsigned long long r) { return (long long)(r >> 1); }
+std::string make_key(const std::string &, unsigned long long r) {
+	std::string s(16, 'a');
+	for (int i = 0; i < 16; i++, r >>= 4) s[i] = (char)('a' + (r & 15));
+	return s;
+}
+
+/**
+ * a value as wide as a small record, to show what probing drags along.
+ */
+struct wide_value {
+	long long v;
+	char payload[192];
+	wide_value(long long v = 0) : v(v) {}
+	operator long long() const { return v; }
+};
+
+// keeps results observable so the loops are not optimized away
+volatile long long sink;
+
+template<class Map, class K>
+void run_layout(const std::vector<K> &keys, const std::vector<K> &misses, double *ns) {
+	typedef typename Map::value_type value_type;
+	size_t n = keys.size();
+	Map map;
+	clock_type::time_point start = clock_type::now();
+	for (size_t i = 0; i < n; i++) map.insert(value_type(keys[i], (long long)i));
+	ns[0] = since(start, n);
+
+	const Map &cmap = map;
+	long long sum = 0;
+	start = clock_type::now();
+	for (size_t i = 0; i < n; i++) sum += cmap.find(keys[(i * 7919) % n])->second;
+	ns[1] = since(start, n);
+
+	start = clock_type::now();
+	for (size_t i = 0; i < n; i++) sum += cmap.count(misses[i]);
+	ns[2] = since(start, n);
+
+	start = clock_type::now();
+	for (typename Map::const_iterator it = cmap.cbegin(); it != cmap.cend(); ++it) sum += it->second;
+	ns[3] = since(start, n);
+
+	start = clock_type::now();
+	for (size_t i = 0; i < n; i++) {
+		if (i % 10 == 0) {
+			map.erase(keys[i]);
+			map.insert(value_type(misses[i], (long long)i));
+		} else {
+			sum += cmap.count(keys[(i * 7919) % n]);
+		}
+	}
+	ns[4] = since(start, n);
+
+	start = clock_type::now();
+	for (size_t i = 1; i < n; i += 2) map.erase(keys[i]);
+	ns[5] = since(start, n / 2);
+	sink = sum;
+}
+
+template<class K, class V, class Hash>
+void run_all(const char *title, size_t n) {
+	std::vector<K> keys, misses;
+	K tag = K();
+	for (size_t i = 0; i < n; i++) keys.push_back(make_key(tag, next_rand()));
+	for (size_t i = 0; i < n; i++) misses.push_back(make_key(tag, next_rand()));
+
+	double ns[LAYOUT_COUNT][WORKLOAD_COUNT];
+	run_layout<sjtu::linked_hashmap<K, V, Hash, std::equal_to<K>, sjtu::chained_storage> >(keys, misses, ns[0]);
+	run_layout<sjtu::linked_hashmap<K, V, Hash, std::equal_to<K>, sjtu::robin_hood_storage> >(keys, misses, ns[1]);
+	run_layout<sjtu::linked_hashmap<K, V, Hash, std::equal_to<K>, sjtu::cuckoo_storage> >(keys, misses, ns[2]);
+	run_layout<sjtu::linked_hashmap<K, V, Hash, std::equal_to<K>, sjtu::hopscotch_storage> >(keys, misses, ns[3]);
+	run_layout<sjtu::linked_hashmap<K, V, Hash, std::equal_to<K>, sjtu::soa_storage> >(keys, misses, ns[4]);
+
+	printf("%s, n = %zu (ns/op)\n%-12s", title, n, "");
+	for (int l = 0; l < LAYOUT_COUNT; l++) printf("%12s", LAYOUTS[l]);
+	printf("  fastest\n");
+	for (int w = 0; w < WORKLOAD_COUNT; w++) {
+		printf("%-12s", WORKLOADS[w]);
+		int best = 0;
+		for (int l = 0; l < LAYOUT_COUNT; l++) {
+			printf("%12.1f", ns[l][w]);
+			if (ns[l][w] < ns[best][w]) best = l;
+		}
+		printf("  %s\n", LAYOUTS[best]);
+	}
+	printf("\n");
+}
+
+}
+
+int main(int argc, char **argv) {
+	size_t n = argc > 1 ? (size_t)std::strtoull(argv[1], nullptr, 10) : 1000000;
+	if (n < 2) n = 2;
+	run_all<int, long long, std::hash<int> >("int keys", n);
+	run_all<std::string, long long, std::hash<std::string> >("string keys", n);
+	run_all<long long, wide_value, std::hash<long long> >("8-byte keys, 200-byte values", n);
+	return 0;
+}
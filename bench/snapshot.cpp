@@ -0,0 +1,85 @@
+/**
+ * measure what a snapshot of linked_hashmap costs: taking one, an insert
+ * after it, const finds, which read the shared elements in place, and
+ * non-const finds, which copy the element they return the first time
+ * (see linked_hashmap::snapshot).
+ *
+ * usage: linked_hashmap_bench_snapshot [n]
+ *   maps of 1000, 100000 and n (default 1000000) elements. times are
+ *   microseconds per call, averaged over rounds that each take a fresh
+ *   snapshot; "no snapshot" is the same call with none alive.
+ */
+#include "linked_hashmap.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+typedef std::chrono::steady_clock clock_type;
+typedef sjtu::linked_hashmap<long long, long long> Map;
+
+volatile long long sink;
+
+/**
+ * the average time of f() over rounds, with a snapshot of map alive
+ *   during each call if snap is set. the snapshot is taken and dropped
+ *   outside the timed part.
+ */
+template<class F>
+double time_call(Map &map, bool snap, int rounds, F f) {
+	double total = 0;
+	for (int r = 0; r < rounds; r++) {
+		Map::snapshot_view *view = snap ? new Map::snapshot_view(map.snapshot()) : nullptr;
+		clock_type::time_point start = clock_type::now();
+		sink = f(r);
+		total += std::chrono::duration<double, std::micro>(clock_type::now() - start).count();
+		delete view;
+	}
+	return total / rounds;
+}
+
+void run(size_t n) {
+	Map map;
+	for (size_t i = 0; i < n; i++) map[(long long)i] = (long long)i;
+	const Map &cmap = map;
+	int rounds = n <= 1000 ? 1000 : n <= 100000 ? 50 : 10;
+	printf("n = %zu (us/call)\n", n);
+
+	double take = 0;
+	for (int r = 0; r < rounds; r++) {
+		clock_type::time_point start = clock_type::now();
+		Map::snapshot_view view = map.snapshot();
+		take += std::chrono::duration<double, std::micro>(clock_type::now() - start).count();
+		sink = (long long)view->size();
+	}
+	printf("  snapshot()                    %10.3f\n", take / rounds);
+
+	// insert a new key, erased again untimed so the size stays put
+	for (int snap = 0; snap < 2; snap++) {
+		double t = time_call(map, snap != 0, rounds, [&](int r) {
+			return (long long)map.insert(Map::value_type(-1 - r, r)).second;
+		});
+		for (int r = 0; r < rounds; r++) map.erase(-1 - r);
+		printf("  insert         %-14s %10.3f\n", snap ? "after snapshot" : "no snapshot", t);
+	}
+	for (int snap = 0; snap < 2; snap++) {
+		printf("  const find     %-14s %10.3f\n", snap ? "after snapshot" : "no snapshot",
+			time_call(map, snap != 0, rounds, [&](int r) { return cmap.find((long long)(r % n))->second; }));
+	}
+	for (int snap = 0; snap < 2; snap++) {
+		printf("  non-const find %-14s %10.3f\n", snap ? "after snapshot" : "no snapshot",
+			time_call(map, snap != 0, rounds, [&](int r) { return map.find((long long)(r % n))->second; }));
+	}
+}
+
+}
+
+int main(int argc, char **argv) {
+	size_t n = argc > 1 ? (size_t)std::strtoull(argv[1], nullptr, 10) : 1000000;
+	if (n < 1) n = 1;
+	run(1000);
+	run(100000);
+	run(n);
+	return 0;
+}
@@ -0,0 +1,234 @@
+/**
+ * implement a linked_hashmap shared by threads through flat combining
+ */
+#ifndef SJTU_COMBINING_LINKEDHASHMAP_HPP
+#define SJTU_COMBINING_LINKEDHASHMAP_HPP
+
+// only for std::equal_to<T> and std::hash<T>
+#include <functional>
+#include <cstddef>
+#include <exception>
+#include <new>
+#include <thread>
+#include "linked_hashmap.hpp"
+#include "exceptions.hpp"
+
+namespace sjtu {
+    /**
+     * combining_linked_hashmap lets many threads insert, erase and look
+     * up keys in one linked_hashmap without each of them taking a lock
+     * in turn. A thread writes its request into a slot of its own and
+     * tries the lock; the thread that gets it runs every request waiting
+     * in the slots, its own among them, and the others find their answer
+     * in their slot when they look again. Batches run on one core, so
+     * the table stays in that core's cache rather than moving from core
+     * to core with the lock, and the lock changes hands once per batch
+     * instead of once per request.
+     *
+     * Each thread needs a handle, which owns one of the slots. Requests
+     * from one handle run in the order made; requests from different
+     * handles run in some order consistent with when they returned.
+     */
+template<
+	class Key,
+	class T,
+	class Hash = std::hash<Key>,
+	class Equal = std::equal_to<Key>,
+	class Storage = chained_storage
+> class combining_linked_hashmap {
+public:
+	typedef linked_hashmap<Key, T, Hash, Equal, Storage> map_type;
+	typedef typename map_type::value_type value_type;
+
+private:
+	static const size_t LINE = 64;
+	// scans of the slots per batch, for requests made while it runs
+	static const int COMBINE_PASSES = 3;
+
+	/**
+	 * a request: run(map, request) does it. the owner sets pending and
+	 *   waits; the combiner clears it once the request ran, storing in
+	 *   error what it threw.
+	 */
+	struct alignas(64) slot {
+		void (*run)(map_type &, void *);
+		void *request;
+		std::exception_ptr error;
+		int pending;
+		int taken;
+	};
+
+	map_type map;
+	// the lock is polled by every waiting thread; keep it off the map's lines
+	char pad[LINE];
+	int locked;
+	char pad_after[LINE];
+	unsigned char *raw;
+	slot *slots;
+	size_t slot_count;
+	// batches run and requests they held, for tuning
+	size_t batches, combined;
+
+	template<class F>
+	static void invoke(map_type &map, void *request) { (*static_cast<F *>(request))(map); }
+
+	bool try_lock() {
+		return __atomic_load_n(&locked, __ATOMIC_RELAXED) == 0 && !__atomic_exchange_n(&locked, 1, __ATOMIC_ACQUIRE);
+	}
+	void unlock() { __atomic_store_n(&locked, 0, __ATOMIC_RELEASE); }
+
+	/**
+	 * run what the slots hold; the lock is ours.
+	 */
+	void combine() {
+		batches++;
+		for (int pass = 0; pass < COMBINE_PASSES; pass++) {
+			size_t ran = 0;
+			for (size_t i = 0; i < slot_count; i++) {
+				slot &s = slots[i];
+				if (__atomic_load_n(&s.pending, __ATOMIC_ACQUIRE) == 0) continue;
+				try {
+					s.run(map, s.request);
+				} catch (...) {
+					s.error = std::current_exception();
+				}
+				__atomic_store_n(&s.pending, 0, __ATOMIC_RELEASE);
+				ran++;
+			}
+			if (ran == 0) break;
+			combined += ran;
+		}
+	}
+
+public:
+	/**
+	 * a thread's access to the map, taking one of its max_threads()
+	 *   slots until destroyed.
+	 */
+	class handle {
+	private:
+		combining_linked_hashmap *owner;
+		slot *own;
+
+	public:
+		/**
+		 * throw runtime_error if every slot is taken.
+		 */
+		explicit handle(combining_linked_hashmap &map) : owner(&map), own(nullptr) {
+			for (size_t i = 0; i < map.slot_count && own == nullptr; i++) {
+				int expected = 0;
+				if (__atomic_compare_exchange_n(&map.slots[i].taken, &expected, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+					own = map.slots + i;
+			}
+			if (own == nullptr) throw runtime_error();
+		}
+		handle(const handle &) = delete;
+		handle & operator=(const handle &) = delete;
+		~handle() { __atomic_store_n(&own->taken, 0, __ATOMIC_RELEASE); }
+
+		/**
+		 * have f(map) run, by this thread or another, and wait for it.
+		 *   f may be run by another thread, so it must not rely on
+		 *   thread-local state; what f throws is thrown here.
+		 */
+		template<class F>
+		void execute(F f) {
+			own->run = &invoke<F>;
+			own->request = &f;
+			__atomic_store_n(&own->pending, 1, __ATOMIC_RELEASE);
+			while (__atomic_load_n(&own->pending, __ATOMIC_ACQUIRE) != 0) {
+				if (owner->try_lock()) {
+					owner->combine();
+					owner->unlock();
+				} else {
+					std::this_thread::yield();
+				}
+			}
+			if (own->error) {
+				std::exception_ptr error = own->error;
+				own->error = nullptr;
+				std::rethrow_exception(error);
+			}
+		}
+
+		bool insert(const value_type &value) {
+			bool added = false;
+			execute([&](map_type &map) { added = map.insert(value).second; });
+			return added;
+		}
+		void assign(const Key &key, const T &value) {
+			execute([&](map_type &map) { map[key] = value; });
+		}
+		size_t erase(const Key &key) {
+			size_t erased = 0;
+			execute([&](map_type &map) { erased = map.erase(key); });
+			return erased;
+		}
+		/**
+		 * copy the value of key into value; false if key is absent.
+		 */
+		bool find(const Key &key, T &value) {
+			bool found = false;
+			execute([&](map_type &map) {
+				typename map_type::const_iterator it = static_cast<const map_type &>(map).find(key);
+				if (it != map.cend()) {
+					value = it->second;
+					found = true;
+				}
+			});
+			return found;
+		}
+		size_t count(const Key &key) {
+			size_t n = 0;
+			execute([&](map_type &map) { n = static_cast<const map_type &>(map).count(key); });
+			return n;
+		}
+		size_t size() {
+			size_t n = 0;
+			execute([&](map_type &map) { n = map.size(); });
+			return n;
+		}
+	};
+
+	/**
+	 * room for max_threads handles at a time.
+	 */
+	explicit combining_linked_hashmap(size_t max_threads = 64) : locked(0), raw(nullptr), slots(nullptr), slot_count(max_threads), batches(0), combined(0) {
+		raw = new unsigned char[(slot_count + 1) * sizeof(slot)];
+		size_t misalign = (size_t)raw % sizeof(slot);
+		slots = reinterpret_cast<slot*>(raw + (misalign ? sizeof(slot) - misalign : 0));
+		for (size_t i = 0; i < slot_count; i++) {
+			new (slots + i) slot;
+			slots[i].run = nullptr;
+			slots[i].request = nullptr;
+			slots[i].pending = slots[i].taken = 0;
+		}
+	}
+	combining_linked_hashmap(const combining_linked_hashmap &) = delete;
+	combining_linked_hashmap & operator=(const combining_linked_hashmap &) = delete;
+	/**
+	 * every handle must be gone.
+	 */
+	~combining_linked_hashmap() {
+		for (size_t i = 0; i < slot_count; i++) slots[i].~slot();
+		delete[] raw;
+	}
+
+	/**
+	 * the map itself, for when no handle is in use.
+	 */
+	map_type & underlying() { return map; }
+	const map_type & underlying() const { return map; }
+
+	/**
+	 * how many batches ran, and the requests they held between them;
+	 *   read them when no handle is in use.
+	 */
+	size_t batch_count() const { return batches; }
+	size_t combined_count() const { return combined; }
+	size_t max_threads() const { return slot_count; }
+};
+
+}
+
+#endif
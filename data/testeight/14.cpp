@@ -0,0 +1,135 @@
+#include "linked_hashmap.hpp"
+#include <iostream>
+#include <cstdio>
+
+unsigned long long seed = 20240607;
+unsigned int next_rand() {
+	seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+	return (unsigned int)(seed >> 33);
+}
+
+typedef sjtu::linked_hashmap<int, int> Map;
+
+long long page_checksum(const Map &map, size_t page_size) {
+	long long sum = 0;
+	for (size_t first = 0; first < map.size(); first += page_size) {
+		Map::const_iterator it = map.nth(first);
+		for (size_t i = 0; i < page_size && it != map.cend(); i++, ++it)
+			sum = (sum * 31 + it->first + (long long)(first + i) * it->second) % 1000000007;
+	}
+	return sum;
+}
+
+void test_nth_position() {
+	puts("Test: nth / position_of");
+	Map plain, indexed;
+	indexed.set_indexed(true);
+	std::cout << plain.indexed() << indexed.indexed() << std::endl;
+	long long diff = 0;
+	for (int round = 0; round < 20000; round++) {
+		int op = next_rand() % 10, key = next_rand() % 3000;
+		if (op < 6) {
+			plain[key] = round;
+			indexed[key] = round;
+		} else if (op < 9) {
+			plain.erase(key);
+			indexed.erase(key);
+		} else if (!plain.empty()) {
+			size_t k = next_rand() % plain.size();
+			Map::iterator a = plain.nth(k), b = indexed.nth(k);
+			if (a->first != b->first) diff++;
+			if (plain.position_of(a) != k || indexed.position_of(b) != k) diff++;
+			if (indexed.position_of(indexed.find(a->first)) != k) diff++;
+		}
+	}
+	std::cout << plain.size() << " " << diff << std::endl;
+	std::cout << page_checksum(plain, 100) << " " << page_checksum(indexed, 100) << std::endl;
+	std::cout << indexed.position_of(indexed.end()) << " " << indexed.position_of(indexed.begin()) << std::endl;
+	try {
+		indexed.nth(indexed.size());
+	} catch (...) {
+		puts("index_out_of_bound");
+	}
+	try {
+		indexed.position_of(plain.begin());
+	} catch (...) {
+		puts("invalid_iterator");
+	}
+}
+
+bool keep_even(const Map::value_type &value) { return value.second % 2 == 0; }
+
+void test_bulk_and_copy() {
+	puts("Test: indexed mode with bulk erase and copies");
+	Map map;
+	for (int i = 0; i < 5000; i++) map[i * 7 % 5003] = i;
+	map.set_indexed(true);
+	map.retain(keep_even);
+	std::cout << map.size() << " " << map.nth(1000)->first << " " << map.position_of(map.find(7 * 2000 % 5003)) << std::endl;
+	map.pop_front(100);
+	Map copy(map);
+	std::cout << copy.indexed() << " " << copy.nth(0)->second << " " << copy.position_of(copy.find(7 * 2000 % 5003)) << std::endl;
+	Map::iterator first = map.nth(10), last = map.nth(2000);
+	map.erase(first, last);
+	std::cout << map.size() << " " << map.nth(10)->second << " " << page_checksum(map, 37) << std::endl;
+	map.set_indexed(false);
+	std::cout << map.indexed() << " " << map.nth(10)->second << " " << page_checksum(map, 37) << std::endl;
+	copy = map;
+	map.clear();
+	map.set_indexed(true);
+	for (int i = 0; i < 100; i++) map[i] = i;
+	std::cout << copy.indexed() << " " << map.size() << " " << map.nth(99)->first << " " << map.position_of(map.find(42)) << std::endl;
+}
+
+size_t brute_from_seq(const Map &map, unsigned long long s) {
+	size_t pos = 0;
+	for (Map::const_iterator it = map.cbegin(); it != map.cend(); ++it, ++pos)
+		if (map.seq(it) >= s) break;
+	return pos;
+}
+
+void test_seq() {
+	puts("Test: seq / last_seq / iterate_from_seq");
+	Map plain, indexed;
+	indexed.set_indexed(true);
+	std::cout << plain.last_seq() << " " << (plain.iterate_from_seq(1) == plain.end()) << std::endl;
+	unsigned long long cursor = 0;
+	long long polled = 0, diff = 0;
+	for (int round = 0; round < 20000; round++) {
+		int op = next_rand() % 10, key = next_rand() % 2000;
+		if (op < 5) {
+			plain[key] = round;
+			indexed[key] = round;
+		} else if (op < 8) {
+			plain.erase(key);
+			indexed.erase(key);
+		} else if (op < 9) {
+			// a consumer polling for entries inserted since its last visit
+			for (Map::iterator it = plain.iterate_from_seq(cursor + 1); it != plain.end(); ++it) polled += it->first;
+			cursor = plain.last_seq();
+		} else {
+			unsigned long long s = next_rand() % (plain.last_seq() + 2);
+			size_t a = plain.position_of(plain.iterate_from_seq(s));
+			size_t b = indexed.position_of(indexed.iterate_from_seq(s));
+			if (a != b || a != brute_from_seq(plain, s)) diff++;
+		}
+	}
+	std::cout << plain.last_seq() << " " << indexed.last_seq() << " " << polled << " " << diff << std::endl;
+	Map copy(indexed);
+	std::cout << copy.last_seq() << " " << copy.seq(copy.begin()) << " " << indexed.seq(indexed.begin()) << std::endl;
+	unsigned long long last = indexed.last_seq();
+	indexed.clear();
+	indexed[1] = 1;
+	std::cout << (indexed.seq(indexed.begin()) == last + 1) << " " << (indexed.iterate_from_seq(last) == indexed.begin()) << std::endl;
+	try {
+		indexed.seq(indexed.end());
+	} catch (...) {
+		puts("invalid_iterator");
+	}
+}
+
+int main() {
+	test_nth_position();
+	test_bulk_and_copy();
+	test_seq();
+}
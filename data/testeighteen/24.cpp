@@ -0,0 +1,109 @@
+#include "linked_hashmap.hpp"
+#include "storage.hpp"
+#include "aggregates.hpp"
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+
+// few distinct hash codes: every bucket holds keys with equal fragments
+class FewHash {
+public:
+	size_t operator () (int k) const { return (size_t)(k % 97) * 0x9e3779b97f4a7c15ULL; }
+};
+
+typedef sjtu::linked_hashmap<int, int, std::hash<int>, std::equal_to<int>, sjtu::cuckoo_storage> CuckooMap;
+typedef sjtu::linked_hashmap<int, int, FewHash, std::equal_to<int>, sjtu::cuckoo_storage> FewCuckooMap;
+typedef sjtu::linked_hashmap<int, int> ChainMap;
+
+unsigned int state = 20261021;
+int next_rand(int mod) {
+	state = state * 1103515245u + 12345u;
+	return (state >> 8) % mod;
+}
+
+sjtu::simd_level lower(sjtu::simd_level a, sjtu::simd_level b) { return a < b ? a : b; }
+
+template<class Map>
+bool random_against_chains(Map &map, int rounds, int range) {
+	ChainMap ref;
+	bool ok = true;
+	for (int r = 0; r < rounds; r++) {
+		int op = next_rand(10), k = next_rand(range);
+		if (op < 5) {
+			if (map.insert(typename Map::value_type(k, r)).second != ref.insert(ChainMap::value_type(k, r)).second) ok = false;
+		} else if (op < 7) {
+			if (map.erase(k) != ref.erase(k)) ok = false;
+		} else if (map.count(k) != ref.count(k) || (ref.count(k) && map.at(k) != ref.at(k))) {
+			ok = false;
+		}
+	}
+	return ok && map.size() == ref.size();
+}
+
+void test_override() {
+	puts("Test: SJTU_SIMD caps the active level");
+	sjtu::simd_level cpu = sjtu::cpu_simd_level();
+	std::cout << (sjtu::active_simd_level() == lower(sjtu::simd_sse2, cpu)) << ' '
+		<< (sjtu::set_active_simd_level(sjtu::simd_avx512bw) == cpu) << ' '
+		<< (sjtu::active_simd_level() == cpu) << ' '
+		<< (sjtu::set_active_simd_level(sjtu::simd_scalar) == sjtu::simd_scalar) << std::endl;
+	for (int level = sjtu::simd_scalar; level <= sjtu::simd_avx512bw; level++)
+		std::cout << sjtu::simd_level_name(sjtu::simd_level(level)) << (level < sjtu::simd_avx512bw ? ' ' : '\n');
+}
+
+void test_bucket_match() {
+	puts("Test: every level matches bucket fragments alike");
+	bool ok = true;
+	unsigned int a[4], b[4];
+	const sjtu::probe_kernels &scalar = sjtu::probe_kernels::at(sjtu::simd_scalar);
+	for (int r = 0; r < 10000; r++) {
+		unsigned int frag = (unsigned int)next_rand(4);
+		for (int i = 0; i < 4; i++) {
+			a[i] = (unsigned int)next_rand(4);
+			b[i] = (unsigned int)next_rand(4) | (next_rand(2) ? 0x80000000u : 0);
+		}
+		unsigned int want = scalar.bucket_match(a, b, frag);
+		for (int level = sjtu::simd_sse2; level <= sjtu::simd_avx512bw; level++)
+			if (sjtu::probe_kernels::at(sjtu::simd_level(level)).bucket_match(a, b, frag) != want) ok = false;
+	}
+	std::cout << ok << std::endl;
+}
+
+void test_maps_per_level() {
+	puts("Test: cuckoo maps at every level");
+	for (int level = sjtu::simd_scalar; level <= sjtu::simd_avx512bw; level++) {
+		sjtu::set_active_simd_level(sjtu::simd_level(level));
+		CuckooMap map;
+		FewCuckooMap few;
+		bool ok = random_against_chains(map, 50000, 8000);
+		bool few_ok = random_against_chains(few, 5000, 400);
+		std::cout << ok << ' ' << few_ok << ' ' << map.size() << ' ' << few.size() << std::endl;
+	}
+}
+
+void test_aggregates_per_level() {
+	puts("Test: aggregates at every level");
+	sjtu::linked_hashmap<int, long long> map;
+	for (int i = 0; i < 20000; i++) map[next_rand(100000)] = next_rand(2000000) - 1000000;
+	map.set_indexed(true);
+	for (int i = 0; i < 5000; i++) map.erase(next_rand(100000));
+	bool ok = true;
+	sjtu::set_active_simd_level(sjtu::simd_scalar);
+	long long sum = sjtu::sum_values(map);
+	sjtu::pair<long long, long long> mm = sjtu::min_max_values(map);
+	for (int level = sjtu::simd_sse2; level <= sjtu::simd_avx512bw; level++) {
+		sjtu::set_active_simd_level(sjtu::simd_level(level));
+		sjtu::pair<long long, long long> m = sjtu::min_max_values(map);
+		if (sjtu::sum_values(map) != sum || m.first != mm.first || m.second != mm.second) ok = false;
+	}
+	std::cout << ok << ' ' << sum << ' ' << mm.first << ' ' << mm.second << std::endl;
+}
+
+int main() {
+	setenv("SJTU_SIMD", "sse2", 1);
+	test_override();
+	test_bucket_match();
+	test_maps_per_level();
+	test_aggregates_per_level();
+	return 0;
+}
@@ -0,0 +1,103 @@
+#include "linked_hashmap.hpp"
+#include "seeded_hash.hpp"
+#include <iostream>
+#include <cstdio>
+#include <string>
+
+typedef sjtu::seeded_hash<std::string> StringHash;
+
+std::string bytes(int n) {
+	std::string s;
+	for (int i = 0; i < n; i++) s.push_back((char)i);
+	return s;
+}
+
+void test_vectors() {
+	puts("Test: SipHash-2-4 reference vectors");
+	StringHash h(0x0706050403020100ULL, 0x0f0e0d0c0b0a0908ULL);
+	const int lengths[] = {0, 1, 7, 8, 15, 63};
+	for (int n : lengths) printf("%d %016llx\n", n, (unsigned long long)h(bytes(n)));
+}
+
+void test_seeds() {
+	puts("Test: every instance has its own seed");
+	StringHash a, b;
+	std::string key = "flood";
+	std::cout << (a(key) == a(key)) << ' ' << (a(key) != b(key)) << std::endl;
+	StringHash c = a;
+	std::cout << (c(key) == a(key)) << std::endl;
+	c.reseed();
+	std::cout << (c(key) != a(key)) << std::endl;
+	sjtu::seeded_hash<int> i0, i1;
+	std::cout << (i0(42) == i0(42)) << ' ' << (i0(42) != i1(42)) << std::endl;
+}
+
+int reseeds = 0;
+
+// collides on purpose until the map asks for a new seed
+class FloodedHash {
+public:
+	unsigned long long seed = 0;
+	size_t operator () (int k) const {
+		if (seed == 0) return (size_t)k << 12;
+		unsigned long long x = (unsigned long long)k + seed * 0x9e3779b97f4a7c15ULL;
+		x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+		return (size_t)(x ^ (x >> 31));
+	}
+	void reseed() { seed = ++reseeds; }
+};
+
+// collides whatever the seed
+class HopelessHash {
+public:
+	size_t operator () (int) const { return 7; }
+	void reseed() { reseeds++; }
+};
+
+template<class Map>
+bool check(Map &map, int n, int step) {
+	if ((int)map.size() != n) return false;
+	int expect = 0;
+	for (typename Map::const_iterator it = map.cbegin(); it != map.cend(); ++it, expect += step)
+		if (it->first != expect || it->second != expect * 3) return false;
+	for (int i = 0; i < n; i++)
+		if (map.count(i * step) != 1 || map.count(-1 - i) != 0) return false;
+	return true;
+}
+
+void test_defense() {
+	puts("Test: a flooded chain triggers a reseed");
+	sjtu::linked_hashmap<int, int, FloodedHash> map;
+	for (int i = 0; i < 5000; i++) map.insert(sjtu::pair<const int, int>(i * 2, i * 6));
+	std::cout << reseeds << ' ' << check(map, 5000, 2) << std::endl;
+	for (int i = 0; i < 5000; i += 2) map.erase(i * 2);
+	std::cout << map.size() << ' ' << map.count(2) << ' ' << map.count(4) << std::endl;
+
+	puts("Test: reseeding is rationed when it cannot help");
+	reseeds = 0;
+	sjtu::linked_hashmap<int, int, HopelessHash> hopeless;
+	for (int i = 0; i < 1500; i++) hopeless.insert(sjtu::pair<const int, int>(i, i * 3));
+	std::cout << reseeds << ' ' << check(hopeless, 1500, 1) << std::endl;
+}
+
+void test_string_map() {
+	puts("Test: linked_hashmap over seeded_hash");
+	sjtu::linked_hashmap<std::string, int, StringHash> map;
+	for (int i = 0; i < 20000; i++) map[std::to_string(i * 7)] = i;
+	bool ok = map.size() == 20000;
+	for (int i = 0; i < 20000; i++)
+		if (map.at(std::to_string(i * 7)) != i || map.count(std::to_string(i * 7 + 1)) != ((i * 7 + 1) % 7 == 0 ? 1u : 0u)) ok = false;
+	sjtu::linked_hashmap<std::string, int, StringHash> copy(map);
+	copy.erase(std::string("0"));
+	ok = ok && copy.size() == 19999 && map.count("0") == 1 && copy.cbegin()->first == "7";
+	std::cout << (ok ? "consistent" : "MISMATCH") << std::endl;
+}
+
+int main() {
+	test_vectors();
+	test_seeds();
+	test_defense();
+	test_string_map();
+	return 0;
+}
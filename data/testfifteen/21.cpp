@@ -0,0 +1,186 @@
+#include "linked_hashmap.hpp"
+#include "storage.hpp"
+#include <iostream>
+#include <cstdio>
+#include <string>
+
+class Integer {
+public:
+	static int counter;
+	int val;
+	Integer(int val) : val(val) { counter++; }
+	Integer(const Integer &rhs) : val(rhs.val) { counter++; }
+	~Integer() { counter--; }
+};
+int Integer::counter = 0;
+
+class Equal {
+public:
+	bool operator () (const Integer &lhs, const Integer &rhs) const { return lhs.val == rhs.val; }
+};
+class Hash {
+public:
+	unsigned int operator () (const Integer &lhs) const { return std::hash<int>()(lhs.val); }
+};
+// only a handful of hash values: most keys cannot get a slot of their own
+class FewHash {
+public:
+	size_t operator () (const Integer &lhs) const { return lhs.val % 5; }
+};
+
+// runs of 24 consecutive keys share a hash, so neighborhoods overlap
+// and free slots have to be hopped back towards their homes
+class CrowdedHash {
+public:
+	size_t operator () (const Integer &lhs) const { return std::hash<int>()(lhs.val / 24) * 0x9e3779b97f4a7c15ULL; }
+};
+
+// one hash value for every key and no reseed(): the stash takes nearly all
+class ConstantHash {
+public:
+	size_t operator () (const Integer &) const { return 7; }
+};
+
+int reseeds = 0;
+// collides on purpose until the map asks for a new seed
+class FloodedHash {
+public:
+	unsigned long long seed = 0;
+	size_t operator () (const Integer &k) const {
+		if (seed == 0) return 42;
+		unsigned long long x = (unsigned long long)k.val + seed * 0x9e3779b97f4a7c15ULL;
+		x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+		return (size_t)(x ^ (x >> 31));
+	}
+	void reseed() { seed = ++reseeds; }
+};
+
+typedef sjtu::linked_hashmap<Integer, std::string, Hash, Equal, sjtu::hopscotch_storage> HopMap;
+typedef sjtu::linked_hashmap<Integer, std::string, FewHash, Equal, sjtu::hopscotch_storage> FewHopMap;
+typedef sjtu::linked_hashmap<Integer, std::string, CrowdedHash, Equal, sjtu::hopscotch_storage> CrowdedHopMap;
+typedef sjtu::linked_hashmap<Integer, std::string, FloodedHash, Equal, sjtu::hopscotch_storage> FloodedHopMap;
+typedef sjtu::linked_hashmap<Integer, std::string, ConstantHash, Equal, sjtu::hopscotch_storage> ConstantHopMap;
+typedef sjtu::linked_hashmap<Integer, std::string, Hash, Equal> ChainMap;
+
+std::string text(int i) { return std::string(i % 11 + 1, char('a' + i % 26)); }
+
+unsigned int state = 20261018;
+int next_rand(int mod) {
+	state = state * 1103515245u + 12345u;
+	return (state >> 8) % mod;
+}
+
+template<class A, class B>
+bool same(const A &a, const B &b) {
+	if (a.size() != b.size()) return false;
+	typename B::const_iterator bit = b.cbegin();
+	for (typename A::const_iterator it = a.cbegin(); it != a.cend(); ++it, ++bit)
+		if (it->first.val != bit->first.val || it->second != bit->second) return false;
+	return true;
+}
+
+template<class Map>
+bool random_against_chains(Map &map, int rounds, int range) {
+	ChainMap ref;
+	bool ok = true;
+	for (int r = 0; r < rounds; r++) {
+		int op = next_rand(12), k = next_rand(range);
+		if (op < 6) {
+			bool x = map.insert(typename Map::value_type(Integer(k), text(r))).second;
+			bool y = ref.insert(ChainMap::value_type(Integer(k), text(r))).second;
+			if (x != y) ok = false;
+		} else if (op < 9) {
+			if (map.erase(Integer(k)) != ref.erase(Integer(k))) ok = false;
+		} else {
+			const Map &cmap = map;
+			typename Map::const_iterator it = cmap.find(Integer(k));
+			if ((it == cmap.cend()) != (ref.count(Integer(k)) == 0)) ok = false;
+			else if (it != cmap.cend() && it->second != ref.at(Integer(k))) ok = false;
+		}
+		if (map.load_factor() > map.max_load_factor()) ok = false;
+	}
+	return ok && same(map, ref);
+}
+
+void test_random() {
+	puts("Test: hopscotch storage agrees with chains");
+	HopMap map;
+	std::cout << map.max_load_factor() << ' ' << random_against_chains(map, 200000, 30000) << ' ' << map.size() << std::endl;
+	FewHopMap few;
+	std::cout << random_against_chains(few, 20000, 300) << ' ' << few.size() << std::endl;
+}
+
+void test_dense() {
+	puts("Test: hopscotch storage near its load limit");
+	HopMap map;
+	map.max_load_factor(0.95);
+	bool ok = true;
+	for (int i = 0; i < 120000; i++) map.insert(HopMap::value_type(Integer(i * 13), text(i)));
+	for (int i = 0; i < 120000; i++)
+		if (map.count(Integer(i * 13)) != 1 || map.count(Integer(i * 13 + 1)) != 0) ok = false;
+	for (int i = 0; i < 120000; i += 3) map.erase(Integer(i * 13));
+	for (int i = 0; i < 120000; i++)
+		if (map.count(Integer(i * 13)) != (i % 3 != 0 ? 1u : 0u)) ok = false;
+	std::cout << ok << ' ' << map.size() << ' ' << (map.load_factor() <= 0.95) << std::endl;
+}
+
+void test_crowded() {
+	puts("Test: hopscotch storage with crowded neighborhoods");
+	CrowdedHopMap map;
+	std::cout << random_against_chains(map, 100000, 20000) << ' ' << map.size() << std::endl;
+}
+
+void test_flood() {
+	puts("Test: an overflowing neighborhood triggers a reseed");
+	FloodedHopMap map;
+	for (int i = 0; i < 3000; i++) map.insert(FloodedHopMap::value_type(Integer(i), text(i)));
+	bool ok = map.size() == 3000;
+	for (int i = 0; i < 3000; i++)
+		if (map.at(Integer(i)) != text(i)) ok = false;
+	std::cout << reseeds << ' ' << ok << std::endl;
+}
+
+void test_constant() {
+	puts("Test: a long stash without reseed grows the table, boundedly");
+	ConstantHopMap map;
+	for (int i = 0; i < 1000; i++) map.insert(ConstantHopMap::value_type(Integer(i), text(i)));
+	bool ok = map.size() == 1000;
+	for (int i = 0; i < 1000; i++)
+		if (map.at(Integer(i)) != text(i) || map.count(Integer(i + 1000)) != 0) ok = false;
+	size_t grown = map.bucket_count();
+	for (int i = 0; i < 1000; i += 2) map.erase(Integer(i));
+	for (int i = 1000; i < 1500; i++) map.insert(ConstantHopMap::value_type(Integer(i), text(i)));
+	for (int i = 0; i < 1500; i++)
+		if (map.count(Integer(i)) != (i < 1000 && i % 2 == 0 ? 0u : 1u)) ok = false;
+	std::cout << ok << ' ' << grown << ' ' << map.bucket_count() << std::endl;
+}
+
+void test_features() {
+	puts("Test: map features over hopscotch storage");
+	HopMap map;
+	ChainMap ref;
+	for (int i = 0; i < 5000; i++) {
+		map.insert(HopMap::value_type(Integer(i * 3), text(i)));
+		ref.insert(ChainMap::value_type(Integer(i * 3), text(i)));
+	}
+	HopMap::snapshot_view snap = map.snapshot();
+	HopMap copy = map;
+	map.retain([](const HopMap::value_type &v) { return v.first.val % 2 != 0; });
+	ref.retain([](const ChainMap::value_type &v) { return v.first.val % 2 != 0; });
+	std::cout << same(map, ref) << ' ' << same(*snap, copy) << ' ' << snap->size() << std::endl;
+	map.pop_front(1000);
+	ref.pop_front(1000);
+	std::cout << same(map, ref) << ' ' << map.size() << ' ' << copy.count(Integer(0)) << std::endl;
+}
+
+int main() {
+	test_random();
+	test_dense();
+	test_crowded();
+	test_flood();
+	test_constant();
+	test_features();
+	std::cout << "leaked " << Integer::counter << std::endl;
+	return 0;
+}
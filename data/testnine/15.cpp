@@ -0,0 +1,197 @@
+#include "linked_hashmap.hpp"
+#include <iostream>
+#include <cstdio>
+#include <string>
+
+class Integer {
+public:
+	static int counter;
+	int val;
+	Integer(int val) : val(val) { counter++; }
+	Integer(const Integer &rhs) : val(rhs.val) { counter++; }
+	~Integer() { counter--; }
+};
+int Integer::counter = 0;
+
+class Equal {
+public:
+	bool operator () (const Integer &lhs, const Integer &rhs) const { return lhs.val == rhs.val; }
+};
+class Hash {
+public:
+	unsigned int operator () (const Integer &lhs) const { return std::hash<int>()(lhs.val); }
+};
+
+typedef sjtu::linked_hashmap<Integer, std::string, Hash, Equal> Map;
+
+long long checksum(const Map &map) {
+	long long sum = 0, pos = 0;
+	for (Map::const_iterator it = map.cbegin(); it != map.cend(); ++it)
+		sum = (sum + (++pos) * it->first.val + (long long)it->second.size() * 7) % 1000000007;
+	return sum;
+}
+
+std::string text(int i) { return std::string(i % 13 + 1, char('a' + i % 26)); }
+
+void test_frozen_view() {
+	puts("Test: snapshot sees a frozen map");
+	Map map;
+	for (int i = 0; i < 1000; i++) map.insert(Map::value_type(Integer(i), text(i)));
+	Map::snapshot_view snap = map.snapshot();
+	long long before = checksum(map);
+	std::cout << snap->size() << " " << (checksum(*snap) == before) << std::endl;
+	// reads through the const interface do not copy anything
+	const Map &cmap = map;
+	std::cout << cmap.at(Integer(10)) << " " << snap->at(Integer(10)) << std::endl;
+	map.erase(Integer(10));
+	map[Integer(5000)] = "new";
+	map.at(Integer(11)) = "changed";
+	map.pop_front(3);
+	std::cout << map.size() << " " << snap->size() << " " << (checksum(*snap) == before) << std::endl;
+	std::cout << snap->count(Integer(10)) << snap->count(Integer(5000)) << map.count(Integer(10)) << map.count(Integer(5000)) << std::endl;
+	std::cout << snap->at(Integer(11)) << " " << map.at(Integer(11)) << " " << snap->cbegin()->first.val << " " << map.cbegin()->first.val << std::endl;
+	std::cout << (snap->last_seq() < map.last_seq()) << " " << snap->seq(snap->find(Integer(500))) << " " << map.seq(map.find(Integer(500))) << std::endl;
+}
+
+void test_iterators_across_detach() {
+	puts("Test: iterators passed to the first modification");
+	Map map;
+	for (int i = 0; i < 100; i++) map.insert(Map::value_type(Integer(i), text(i)));
+	Map::iterator it = map.find(Integer(42));
+	Map::snapshot_view snap = map.snapshot();
+	Map::iterator next = map.erase(it);
+	std::cout << next->first.val << " " << map.size() << " " << snap->size() << std::endl;
+	Map::snapshot_view snap2 = map.snapshot();
+	Map::iterator first = map.begin(), last = map.begin();
+	Map::snapshot_view snap3 = map.snapshot();
+	for (int i = 0; i < 10; i++) ++last;
+	map.erase(first, last);
+	std::cout << map.cbegin()->first.val << " " << map.size() << " " << snap2->size() << " " << snap3->size() << std::endl;
+}
+
+void test_copy_on_write() {
+	puts("Test: writes copy only the elements they touch");
+	Map map;
+	for (int i = 0; i < 10; i++) map.insert(Map::value_type(Integer(i), text(i)));
+	Map::iterator it = map.begin();
+	Map::snapshot_view snap = map.snapshot();
+	long long before = checksum(*snap);
+	const Map &cmap = map;
+	// reads find the very nodes the snapshot holds
+	std::cout << cmap.nth(3)->first.val << " " << cmap.iterate_from_seq(5)->first.val << " "
+		<< (&cmap.find(Integer(1))->second == &snap->find(Integer(1))->second) << std::endl;
+	// an iterator taken before the snapshot writes to a copy
+	it->second = "x";
+	(*map.find(Integer(1))).second = "w";
+	std::cout << snap->at(Integer(0)) << " " << map.at(Integer(0)) << " " << snap->at(Integer(1)) << " " << map.at(Integer(1)) << " "
+		<< (checksum(*snap) == before) << " " << (&cmap.find(Integer(1))->second == &snap->find(Integer(1))->second) << " "
+		<< (&cmap.find(Integer(5))->second == &snap->find(Integer(5))->second) << std::endl;
+	map.for_each([](Map::value_type &v) { v.second += "!"; });
+	std::cout << snap->at(Integer(5)) << " " << map.at(Integer(5)) << " " << (checksum(*snap) == before) << std::endl;
+	// iterators stay valid across inserts and erases
+	Map::iterator third = map.find(Integer(2));
+	map.insert(Map::value_type(Integer(100), "new"));
+	map.erase(Integer(3));
+	++third;
+	std::cout << third->first.val << " " << (--third)->first.val << " " << it->second << std::endl;
+	it = map.erase(it);
+	std::cout << it->first.val << " " << map.size() << " " << snap->size() << " " << map.cbegin()->first.val << " " << snap->cbegin()->first.val << std::endl;
+	Map::snapshot_view snap2 = map.snapshot();
+	map[Integer(2)] = "y";
+	std::cout << snap2->at(Integer(2)) << " " << map.at(Integer(2)) << " " << snap->at(Integer(2)) << " " << snap2->count(Integer(0)) << snap->count(Integer(0)) << std::endl;
+	Map::iterator last = map.end();
+	--last;
+	std::cout << last->first.val << " " << (--last)->first.val << " " << map.position_of(last) << std::endl;
+}
+
+void test_layers() {
+	puts("Test: positions and order through layers");
+	Map map;
+	map.set_indexed(true);
+	for (int i = 0; i < 100; i++) map.insert(Map::value_type(Integer(i), text(i)));
+	Map::snapshot_view *first = new Map::snapshot_view(map.snapshot());
+	for (int i = 0; i < 50; i += 3) map.erase(Integer(i));
+	for (int i = 100; i < 120; i++) map.insert(Map::value_type(Integer(i), text(i)));
+	Map::snapshot_view *second = new Map::snapshot_view(map.snapshot());
+	for (int i = 50; i < 60; i++) map.erase(Integer(i));
+	map[Integer(7)] = "seven";
+	Map flat(map);
+	bool same = true;
+	for (size_t k = 0; k < map.size(); k++) {
+		Map::iterator at = map.nth(k);
+		same = same && at->first.val == flat.nth(k)->first.val && map.position_of(at) == k && at->second == flat.nth(k)->second;
+	}
+	size_t backwards = 0;
+	for (Map::iterator p = map.end(); p != map.begin(); --p) backwards++;
+	std::cout << map.size() << " " << same << " " << backwards << " " << (*first)->size() << " " << (*second)->size() << " "
+		<< map.equal_in_order(flat) << " " << (map == flat) << " " << (map.key_fingerprint() == flat.key_fingerprint()) << std::endl;
+	std::cout << map.iterate_from_seq(1)->first.val << " " << map.iterate_from_seq(51)->first.val << " " << map.iterate_from_seq(101)->first.val << " "
+		<< (*second)->iterate_from_seq(51)->first.val << std::endl;
+	// once the snapshots are gone the next modification folds the layers
+	std::string &seven = map.at(Integer(7));
+	Map::iterator keep = map.find(Integer(8));
+	delete first;
+	delete second;
+	map.insert(Map::value_type(Integer(200), "x"));
+	map.erase(Integer(9));
+	++keep;
+	std::cout << seven << " " << keep->first.val << " " << map.size() << " " << map.nth(50)->first.val << " " << flat.nth(50)->first.val << std::endl;
+	// every snapshot keeps what it saw however many are alive
+	Map::snapshot_view *views[12];
+	size_t sizes[12];
+	for (int r = 0; r < 12; r++) {
+		map[Integer(r + 1000)] = text(r);
+		map.erase(Integer(r + 10));
+		views[r] = new Map::snapshot_view(map.snapshot());
+		sizes[r] = map.size();
+	}
+	bool kept = true;
+	for (int r = 0; r < 12; r++) {
+		kept = kept && (*views[r])->size() == sizes[r] && (*views[r])->count(Integer(r + 1001)) == 0
+			&& (*views[r])->at(Integer(r + 1000)) == text(r) && (*views[r])->count(Integer(r + 10)) == 0;
+		delete views[r];
+	}
+	std::cout << kept << " " << map.size() << std::endl;
+}
+
+void test_lifetimes() {
+	puts("Test: snapshot lifetimes");
+	Map::snapshot_view *outlive;
+	{
+		Map map;
+		for (int i = 0; i < 200; i++) map.insert(Map::value_type(Integer(i), text(i)));
+		Map::snapshot_view a = map.snapshot();
+		Map::snapshot_view b = map.snapshot();
+		b = a;
+		outlive = new Map::snapshot_view(a);
+		// no write before the snapshots go away: nothing is ever copied
+		{
+			Map::snapshot_view c = map.snapshot();
+			std::cout << c->size() << std::endl;
+		}
+		map.set_indexed(true);
+		for (int i = 200; i < 300; i++) map.insert(Map::value_type(Integer(i), text(i)));
+		std::cout << map.nth(250)->first.val << " " << (*outlive)->indexed() << std::endl;
+		Map copy(*a);
+		copy.insert(Map::value_type(Integer(-1), "x"));
+		std::cout << copy.size() << " " << a->size() << " " << copy.last_seq() << std::endl;
+	}
+	std::cout << (*outlive)->size() << " " << checksum(**outlive) << std::endl;
+	delete outlive;
+	Map map;
+	map.insert(Map::value_type(Integer(1), "one"));
+	{
+		Map::snapshot_view s = map.snapshot();
+	}
+	map.insert(Map::value_type(Integer(2), "two"));
+	std::cout << map.size() << std::endl;
+}
+
+int main() {
+	test_frozen_view();
+	test_iterators_across_detach();
+	test_copy_on_write();
+	test_layers();
+	test_lifetimes();
+	std::cout << Integer::counter << std::endl;
+}
@@ -0,0 +1,135 @@
+#include "linked_hashmap.hpp"
+#include "seeded_hash.hpp"
+#include "storage.hpp"
+#include <iostream>
+#include <cstdio>
+#include <string>
+#include <utility>
+
+typedef sjtu::linked_hashmap<int, int> ChainMap;
+typedef sjtu::linked_hashmap<int, int, sjtu::seeded_hash<int>, std::equal_to<int>, sjtu::robin_hood_storage> SeededMap;
+typedef sjtu::linked_hashmap<std::string, std::string, std::hash<std::string>, std::equal_to<std::string>, sjtu::cuckoo_storage> StringMap;
+
+unsigned int state = 20261017;
+int next_rand(int mod) {
+	state = state * 1103515245u + 12345u;
+	return (state >> 8) % mod;
+}
+
+template<class Map>
+void print(const Map &map) {
+	for (typename Map::const_iterator it = map.cbegin(); it != map.cend(); ++it)
+		std::cout << it->first << ':' << it->second << ' ';
+	std::cout << "| " << map.size() << std::endl;
+}
+
+template<class Map>
+void fill(Map &a, Map &b) {
+	for (int i = 1; i <= 5; i++) a.insert(typename Map::value_type(i, i * 10));
+	for (int i = 8; i >= 3; i--) b.insert(typename Map::value_type(i, i * 100));
+}
+
+struct add {
+	int operator()(const int &mine, const int &theirs) const { return mine + theirs; }
+};
+
+template<class Map>
+void test_policies(const char *name) {
+	printf("Test: merge policies (%s)\n", name);
+	Map a, b;
+	fill(a, b);
+	std::cout << a.merge_from(b, sjtu::merge_keep()) << ' ';
+	print(a);
+	Map c, d;
+	fill(c, d);
+	std::cout << c.merge_from(d, sjtu::merge_overwrite()) << ' ';
+	print(c);
+	Map e, f;
+	fill(e, f);
+	std::cout << e.merge_from(f, add()) << ' ';
+	print(e);
+	print(f);
+}
+
+void test_move() {
+	puts("Test: merging an rvalue moves its nodes");
+	StringMap a, b;
+	a.insert(StringMap::value_type("x", "1"));
+	a.insert(StringMap::value_type("y", "2"));
+	b.insert(StringMap::value_type("z", "3"));
+	b.insert(StringMap::value_type("y", "4"));
+	b.insert(StringMap::value_type("w", "5"));
+	const std::string *z = &b.find("z")->second;
+	std::cout << a.merge_from(std::move(b), sjtu::merge_overwrite()) << ' ';
+	print(a);
+	print(b);
+	std::cout << (&a.find("z")->second == z) << std::endl;
+	b.insert(StringMap::value_type("v", "6"));
+	a.merge_from(std::move(b), [](const std::string &mine, const std::string &theirs) { return mine + theirs; });
+	print(a);
+	a.merge_from(std::move(a), [](const std::string &mine, const std::string &theirs) { return mine + theirs; });
+	print(a);
+}
+
+void test_snapshot() {
+	puts("Test: an rvalue shared with a snapshot is copied");
+	ChainMap a, b;
+	fill(a, b);
+	ChainMap::snapshot_view view = b.snapshot();
+	a.merge_from(std::move(b), sjtu::merge_keep());
+	print(a);
+	print(b);
+	print(*view);
+}
+
+template<class Map>
+bool random_merges(bool indexed, bool move) {
+	bool ok = true;
+	for (int round = 0; round < 50; round++) {
+		Map a, b;
+		ChainMap ref;
+		a.set_indexed(indexed);
+		b.set_indexed(round % 2 == 0);
+		int n = next_rand(2000), m = next_rand(2000);
+		for (int i = 0; i < n; i++) {
+			int k = next_rand(3000);
+			if (a.insert(typename Map::value_type(k, i)).second) ref.insert(ChainMap::value_type(k, i));
+		}
+		for (int i = 0; i < m; i++) b.insert(typename Map::value_type(next_rand(3000), -i));
+		for (int i = 0; i < 100 && b.size() > 0; i++) b.erase(next_rand(3000));
+		for (typename Map::const_iterator it = b.cbegin(); it != b.cend(); ++it) {
+			ChainMap::iterator r = ref.find(it->first);
+			if (r == ref.end()) ref.insert(ChainMap::value_type(it->first, it->second));
+			else r->second += it->second;
+		}
+		size_t before = a.size(), added;
+		if (move) added = a.merge_from(std::move(b), add());
+		else added = a.merge_from(b, add());
+		if (added != a.size() - before || a.size() != ref.size() || (move && b.size() != 0)) ok = false;
+		ChainMap::const_iterator r = ref.cbegin();
+		size_t k = 0;
+		for (typename Map::const_iterator it = a.cbegin(); it != a.cend(); ++it, ++r, ++k) {
+			if (it->first != r->first || it->second != r->second) ok = false;
+			if (a.count(it->first) != 1) ok = false;
+			if (indexed && a.nth(k)->first != it->first) ok = false;
+		}
+		b.insert(typename Map::value_type(1, 1));
+		if ((move && b.size() != 1) || b.count(1) != 1) ok = false;
+	}
+	return ok;
+}
+
+void test_random() {
+	puts("Test: random merges against insert");
+	std::cout << random_merges<ChainMap>(false, false) << random_merges<ChainMap>(true, true)
+		<< random_merges<SeededMap>(true, false) << random_merges<SeededMap>(false, true) << std::endl;
+}
+
+int main() {
+	test_policies<ChainMap>("chained");
+	test_policies<SeededMap>("seeded robin_hood");
+	test_move();
+	test_snapshot();
+	test_random();
+	return 0;
+}
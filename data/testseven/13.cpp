@@ -0,0 +1,146 @@
+#include "linked_hashmap.hpp"
+#include <iostream>
+#include <cstdio>
+
+class Integer {
+public:
+	static int counter;
+	int val;
+	Integer(int val) : val(val) { counter++; }
+	Integer(const Integer &rhs) : val(rhs.val) { counter++; }
+	~Integer() { counter--; }
+};
+int Integer::counter = 0;
+
+class Equal {
+public:
+	bool operator () (const Integer &lhs, const Integer &rhs) const {
+		return lhs.val == rhs.val;
+	}
+};
+class Hash {
+public:
+	// deliberately poor: every key lands in one of 4 chains
+	unsigned int operator () (const Integer &lhs) const {
+		return lhs.val & 3;
+	}
+};
+
+typedef sjtu::linked_hashmap<Integer, Integer, Hash, Equal> Map;
+
+long long checksum(const Map &map) {
+	long long sum = 0, pos = 0;
+	for (Map::const_iterator it = map.cbegin(); it != map.cend(); ++it)
+		sum += (++pos) * it->first.val + it->second.val;
+	return sum;
+}
+
+void test_erase_key() {
+	puts("Test: erase(key)");
+	Map map;
+	for (int i = 0; i < 1000; i++) map.insert(Map::value_type(Integer(i), Integer(i * 7)));
+	size_t removed = 0;
+	for (int i = 0; i < 1000; i += 3) removed += map.erase(Integer(i));
+	for (int i = 0; i < 1000; i += 3) removed += map.erase(Integer(i));
+	std::cout << removed << " " << map.size() << " " << checksum(map) << std::endl;
+	std::cout << map.count(Integer(3)) << map.count(Integer(4)) << std::endl;
+}
+
+void test_erase_while_iterating() {
+	puts("Test: erase(iterator) returns next");
+	Map map;
+	for (int i = 0; i < 2000; i++) map.insert(Map::value_type(Integer(i * 5 % 2001), Integer(i)));
+	Map::iterator it = map.begin();
+	while (it != map.end()) {
+		if (it->second.val % 2 == 0) it = map.erase(it);
+		else ++it;
+	}
+	std::cout << map.size() << " " << checksum(map) << std::endl;
+	it = map.begin();
+	while (it != map.end()) it = map.erase(it);
+	std::cout << map.size() << " " << map.empty() << std::endl;
+	try {
+		map.erase(map.end());
+	} catch (...) {
+		puts("invalid_iterator");
+	}
+}
+
+void test_chain_heads() {
+	puts("Test: erase chain heads and tails");
+	Map map;
+	for (int i = 0; i < 64; i++) map.insert(Map::value_type(Integer(i), Integer(i)));
+	// erase in reverse insertion order: every node is its chain's head
+	for (int i = 63; i >= 32; i--) map.erase(map.find(Integer(i)));
+	// erase in insertion order: every node is its chain's tail
+	for (int i = 0; i < 16; i++) map.erase(map.find(Integer(i)));
+	for (int i = 0; i < 64; i++) std::cout << map.count(Integer(i));
+	std::cout << std::endl;
+	for (int i = 100; i < 200; i++) map.insert(Map::value_type(Integer(i), Integer(-i)));
+	std::cout << map.size() << " " << checksum(map) << std::endl;
+}
+
+bool is_multiple_of_three(Map::value_type &value) { return value.first.val % 3 == 0; }
+
+struct KeepBelow {
+	int limit;
+	bool operator () (const Map::value_type &value) const { return value.second.val < limit; }
+};
+
+void test_erase_if_retain() {
+	puts("Test: erase_if / retain");
+	Map map;
+	for (int i = 0; i < 3000; i++) map.insert(Map::value_type(Integer(i * 7 % 3001), Integer(i)));
+	// a few removals: unlinked one by one
+	std::cout << sjtu::erase_if(map, is_multiple_of_three) << " " << map.size() << " " << checksum(map) << std::endl;
+	// most removals: the table is rebuilt from the survivors
+	KeepBelow keep = {500};
+	std::cout << map.retain(keep) << " " << map.size() << " " << checksum(map) << std::endl;
+	size_t found = 0;
+	for (int i = 0; i < 3001; i++) found += map.count(Integer(i));
+	std::cout << found << std::endl;
+	for (int i = 5000; i < 5100; i++) map.insert(Map::value_type(Integer(i), Integer(i)));
+	std::cout << map.size() << " " << checksum(map) << std::endl;
+	std::cout << map.retain(keep) << " " << map.retain(keep) << " " << map.size() << std::endl;
+	KeepBelow none = {-1};
+	std::cout << map.retain(none) << " " << map.size() << " " << (map.begin() == map.end()) << std::endl;
+}
+
+void test_range_erase() {
+	puts("Test: erase(first, last) / pop_front");
+	Map map;
+	for (int i = 0; i < 1000; i++) map.insert(Map::value_type(Integer(i * 13 % 1009), Integer(i)));
+	Map::iterator first = map.begin(), last = map.begin();
+	for (int i = 0; i < 100; i++) ++first;
+	last = first;
+	for (int i = 0; i < 50; i++) ++last;
+	Map::iterator ret = map.erase(first, last);
+	std::cout << (ret == last) << " " << ret->second.val << " " << map.size() << " " << checksum(map) << std::endl;
+	std::cout << (map.erase(ret, ret) == ret) << " " << map.size() << std::endl;
+	try {
+		map.erase(last, map.begin());
+	} catch (...) {
+		puts("invalid_iterator");
+	}
+	std::cout << map.size() << " " << checksum(map) << std::endl;
+	// drop most of the map: the survivors are re-threaded
+	last = map.end();
+	for (int i = 0; i < 10; i++) --last;
+	map.erase(map.begin(), last);
+	std::cout << map.size() << " " << checksum(map) << std::endl;
+	for (int i = 2000; i < 2100; i++) map.insert(Map::value_type(Integer(i), Integer(i)));
+	std::cout << map.pop_front(5) << " " << map.begin()->second.val << " " << map.size() << " " << checksum(map) << std::endl;
+	std::cout << map.pop_front(0) << " " << map.pop_front(1000) << " " << map.size() << " " << map.empty() << std::endl;
+	for (int i = 0; i < 10; i++) map.insert(Map::value_type(Integer(i), Integer(i)));
+	map.erase(map.begin(), map.end());
+	std::cout << map.size() << " " << map.count(Integer(3)) << std::endl;
+}
+
+int main() {
+	test_erase_key();
+	test_erase_while_iterating();
+	test_chain_heads();
+	test_erase_if_retain();
+	test_range_erase();
+	std::cout << Integer::counter << std::endl;
+}
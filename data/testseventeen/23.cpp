@@ -0,0 +1,135 @@
+#include "linked_hashmap.hpp"
+#include "aggregates.hpp"
+#include <iostream>
+#include <cstdio>
+#include <cstddef>
+#include <string>
+
+unsigned int state = 20261020;
+int next_rand(int mod) {
+	state = state * 1103515245u + 12345u;
+	return (state >> 8) % mod;
+}
+
+// values that sum exactly in every type tested
+template<class T>
+T make_value(int r) {
+	return (T)(r - 5000) / (std::is_floating_point<T>::value ? 2 : 1);
+}
+
+template<class T>
+bool agrees_with_iteration(const sjtu::linked_hashmap<int, T> &map) {
+	typedef sjtu::linked_hashmap<int, T> Map;
+	typename sjtu::value_sum<T>::type sum = 0;
+	T lo = map.cbegin()->second, hi = lo;
+	size_t positive = 0;
+	for (typename Map::const_iterator it = map.cbegin(); it != map.cend(); ++it) {
+		sum += it->second;
+		if (it->second < lo) lo = it->second;
+		if (hi < it->second) hi = it->second;
+		if (it->second > 0) positive++;
+	}
+	sjtu::pair<T, T> mm = sjtu::min_max_values(map);
+	return sjtu::sum_values(map) == sum && mm.first == lo && mm.second == hi
+		&& sjtu::count_if_values(map, [](T v) { return v > 0; }) == positive;
+}
+
+template<class T>
+void test_type(const char *name) {
+	typedef sjtu::linked_hashmap<int, T> Map;
+	Map map;
+	for (int i = 0; i < 5003; i++) map[next_rand(100000)] = make_value<T>(next_rand(10000));
+	bool plain = agrees_with_iteration(map);
+	for (int i = 0; i < 3000; i++) map.erase(next_rand(100000));
+	plain = plain && agrees_with_iteration(map);
+	map.set_indexed(true);
+	for (int i = 0; i < 1000; i++) map.erase(next_rand(100000));
+	map[-1] = make_value<T>(10000);
+	bool indexed = agrees_with_iteration(map);
+	std::cout << name << ' ' << plain << ' ' << indexed << ' ' << map.size() << std::endl;
+}
+
+template<class T>
+struct Record {
+	char tag;
+	T value;
+};
+
+// every level the cpu has must agree with the scalar loop
+template<class T>
+bool levels_agree() {
+	const int N = 1001;
+	static Record<T> records[N];
+	const Record<T> *slots[N];
+	for (int i = 0; i < N; i++) {
+		records[i].value = make_value<T>(next_rand(10000));
+		slots[i] = next_rand(5) == 0 ? nullptr : &records[i];
+	}
+	size_t offset = offsetof(Record<T>, value);
+	typedef sjtu::value_kernels<T> kernels;
+	typename sjtu::value_sum<T>::type sum0 = 0;
+	T lo0 = make_value<T>(10000), hi0 = make_value<T>(0);
+	kernels::sum(slots, N, offset, sum0, sjtu::simd_scalar);
+	kernels::min_max(slots, N, offset, lo0, hi0, sjtu::simd_scalar);
+	auto odd = [](T v) { return (long long)v % 2 != 0; };
+	size_t odd0 = kernels::count_if(slots, N, offset, odd, sjtu::simd_scalar);
+	bool ok = true;
+	for (int level = sjtu::simd_sse2; level <= sjtu::simd_avx512bw; level++) {
+		for (int start = 0; start < 4; start++) {
+			typename sjtu::value_sum<T>::type sum = 0;
+			T lo = make_value<T>(10000), hi = make_value<T>(0);
+			kernels::sum(slots + start, N - start, offset, sum, sjtu::simd_level(level));
+			kernels::min_max(slots + start, N - start, offset, lo, hi, sjtu::simd_level(level));
+			size_t odds = kernels::count_if(slots + start, N - start, offset, odd, sjtu::simd_level(level));
+			typename sjtu::value_sum<T>::type sum1 = 0;
+			T lo1 = make_value<T>(10000), hi1 = make_value<T>(0);
+			kernels::sum(slots + start, N - start, offset, sum1, sjtu::simd_scalar);
+			kernels::min_max(slots + start, N - start, offset, lo1, hi1, sjtu::simd_scalar);
+			size_t odds1 = kernels::count_if(slots + start, N - start, offset, odd, sjtu::simd_scalar);
+			if (sum != sum1 || lo != lo1 || hi != hi1 || odds != odds1) ok = false;
+		}
+	}
+	return ok && odd0 > 0 && lo0 < hi0 && sum0 != 0;
+}
+
+void test_levels() {
+	puts("Test: every simd level agrees with the scalar loop");
+	std::cout << levels_agree<int>() << levels_agree<unsigned int>() << levels_agree<long long>()
+		<< levels_agree<unsigned long long>() << levels_agree<float>() << levels_agree<double>()
+		<< levels_agree<short>() << std::endl;
+}
+
+void test_edges() {
+	puts("Test: aggregate edge cases");
+	sjtu::linked_hashmap<int, unsigned long long> big;
+	big[1] = ~0ULL;
+	big[2] = 3;
+	big[3] = 1ULL << 63;
+	sjtu::pair<unsigned long long, unsigned long long> mm = sjtu::min_max_values(big);
+	std::cout << mm.first << ' ' << mm.second << ' ' << sjtu::sum_values(big) << std::endl;
+	sjtu::linked_hashmap<int, int> empty;
+	std::cout << sjtu::sum_values(empty) << ' ' << sjtu::count_if_values(empty, [](int) { return true; }) << ' ';
+	try {
+		sjtu::min_max_values(empty);
+		std::cout << "no throw" << std::endl;
+	} catch (sjtu::container_is_empty &) {
+		std::cout << "throws" << std::endl;
+	}
+	sjtu::linked_hashmap<std::string, int> words;
+	words["a"] = 2000000000;
+	words["b"] = 2000000000;
+	std::cout << sjtu::sum_values(words) << std::endl;
+}
+
+int main() {
+	puts("Test: aggregates agree with iteration");
+	test_type<int>("int");
+	test_type<unsigned int>("unsigned");
+	test_type<long long>("long long");
+	test_type<float>("float");
+	test_type<double>("double");
+	test_type<short>("short");
+	test_levels();
+	test_edges();
+	return 0;
+}
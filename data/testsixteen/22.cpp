@@ -0,0 +1,188 @@
+#include "linked_hashmap.hpp"
+#include "storage.hpp"
+#include <iostream>
+#include <cstdio>
+#include <string>
+
+class Integer {
+public:
+	static int counter;
+	int val;
+	Integer(int val) : val(val) { counter++; }
+	Integer(const Integer &rhs) : val(rhs.val) { counter++; }
+	~Integer() { counter--; }
+};
+int Integer::counter = 0;
+
+class Equal {
+public:
+	bool operator () (const Integer &lhs, const Integer &rhs) const { return lhs.val == rhs.val; }
+};
+class Hash {
+public:
+	unsigned int operator () (const Integer &lhs) const { return std::hash<int>()(lhs.val); }
+};
+
+// a small trivially copyable key, kept in the key array
+struct Point {
+	int x, y;
+};
+struct PointEqual {
+	bool operator () (const Point &a, const Point &b) const { return a.x == b.x && a.y == b.y; }
+};
+struct PointHash {
+	size_t operator () (const Point &p) const { return std::hash<long long>()((long long)p.x << 32 | (unsigned int)p.y); }
+};
+// only a handful of hash values, so keys are told apart in the key array
+struct FewPointHash {
+	size_t operator () (const Point &p) const { return (size_t)(p.x % 7); }
+};
+
+// too wide to be kept in the key array
+struct Wide {
+	int v[8];
+};
+struct WideEqual {
+	bool operator () (const Wide &a, const Wide &b) const { return a.v[0] == b.v[0] && a.v[7] == b.v[7]; }
+};
+struct WideHash {
+	size_t operator () (const Wide &w) const { return std::hash<int>()(w.v[0]); }
+};
+
+typedef sjtu::linked_hashmap<Integer, std::string, Hash, Equal, sjtu::soa_storage> SoaMap;
+typedef sjtu::linked_hashmap<Integer, std::string, Hash, Equal> ChainMap;
+typedef sjtu::linked_hashmap<Point, int, PointHash, PointEqual, sjtu::soa_storage> PointMap;
+typedef sjtu::linked_hashmap<Point, int, FewPointHash, PointEqual, sjtu::soa_storage> FewPointMap;
+typedef sjtu::linked_hashmap<Point, int, PointHash, PointEqual> PointChainMap;
+typedef sjtu::linked_hashmap<Wide, int, WideHash, WideEqual, sjtu::soa_storage> WideMap;
+
+std::string text(int i) { return std::string(i % 11 + 1, char('a' + i % 26)); }
+
+unsigned int state = 20261019;
+int next_rand(int mod) {
+	state = state * 1103515245u + 12345u;
+	return (state >> 8) % mod;
+}
+
+template<class A, class B>
+bool same(const A &a, const B &b) {
+	if (a.size() != b.size()) return false;
+	typename B::const_iterator bit = b.cbegin();
+	for (typename A::const_iterator it = a.cbegin(); it != a.cend(); ++it, ++bit)
+		if (it->first.val != bit->first.val || it->second != bit->second) return false;
+	return true;
+}
+
+template<class A, class B>
+bool same_points(const A &a, const B &b) {
+	if (a.size() != b.size()) return false;
+	typename B::const_iterator bit = b.cbegin();
+	for (typename A::const_iterator it = a.cbegin(); it != a.cend(); ++it, ++bit)
+		if (!PointEqual()(it->first, bit->first) || it->second != bit->second) return false;
+	return true;
+}
+
+void test_random() {
+	puts("Test: soa storage agrees with chains");
+	SoaMap map;
+	ChainMap ref;
+	bool ok = true;
+	for (int r = 0; r < 200000; r++) {
+		int op = next_rand(12), k = next_rand(30000);
+		if (op < 6) {
+			if (map.insert(SoaMap::value_type(Integer(k), text(r))).second != ref.insert(ChainMap::value_type(Integer(k), text(r))).second) ok = false;
+		} else if (op < 9) {
+			if (map.erase(Integer(k)) != ref.erase(Integer(k))) ok = false;
+		} else {
+			const SoaMap &cmap = map;
+			SoaMap::const_iterator it = cmap.find(Integer(k));
+			if ((it == cmap.cend()) != (ref.count(Integer(k)) == 0)) ok = false;
+			else if (it != cmap.cend() && it->second != ref.at(Integer(k))) ok = false;
+		}
+	}
+	std::cout << map.max_load_factor() << ' ' << (ok && same(map, ref)) << ' ' << map.size() << std::endl;
+}
+
+template<class Map>
+bool points_against_chains(Map &map, int rounds, int range) {
+	PointChainMap ref;
+	bool ok = true;
+	for (int r = 0; r < rounds; r++) {
+		int op = next_rand(12);
+		Point p = {next_rand(range), next_rand(4) - 2};
+		if (op < 6) {
+			if (map.insert(typename Map::value_type(p, r)).second != ref.insert(PointChainMap::value_type(p, r)).second) ok = false;
+		} else if (op < 9) {
+			if (map.erase(p) != ref.erase(p)) ok = false;
+		} else if (map.count(p) != ref.count(p) || (ref.count(p) && map.at(p) != ref.at(p))) {
+			ok = false;
+		}
+		if (map.load_factor() > map.max_load_factor()) ok = false;
+	}
+	return ok && same_points(map, ref);
+}
+
+void test_inline_keys() {
+	puts("Test: keys kept in the key array");
+	PointMap map;
+	std::cout << points_against_chains(map, 200000, 8000) << ' ' << map.size() << std::endl;
+	FewPointMap few;
+	std::cout << points_against_chains(few, 20000, 100) << ' ' << few.size() << std::endl;
+	map.max_load_factor(0.99);
+	bool ok = true;
+	for (int i = 0; i < 50000; i++) {
+		Point p = {i, -i};
+		map[p] = i;
+	}
+	for (int i = 0; i < 50000; i++) {
+		Point p = {i, -i}, q = {i, i + 2};
+		if (map.at(p) != i || map.count(q) != 0) ok = false;
+	}
+	std::cout << ok << ' ' << (map.load_factor() <= 0.99) << std::endl;
+}
+
+void test_wide_keys() {
+	puts("Test: keys compared through their nodes");
+	WideMap map;
+	bool ok = true;
+	for (int i = 0; i < 20000; i++) {
+		Wide w = {{i, 0, 0, 0, 0, 0, 0, i * 3}};
+		map[w] = i;
+	}
+	for (int i = 0; i < 20000; i += 2) {
+		Wide w = {{i, 0, 0, 0, 0, 0, 0, i * 3}};
+		map.erase(w);
+	}
+	for (int i = 0; i < 20000; i++) {
+		Wide w = {{i, 0, 0, 0, 0, 0, 0, i * 3}}, x = {{i, 0, 0, 0, 0, 0, 0, i * 3 + 1}};
+		if (map.count(w) != (unsigned)(i % 2) || map.count(x) != 0) ok = false;
+	}
+	std::cout << ok << ' ' << map.size() << ' ' << map.begin()->second << std::endl;
+}
+
+void test_features() {
+	puts("Test: map features over soa storage");
+	SoaMap map;
+	ChainMap ref;
+	for (int i = 0; i < 5000; i++) {
+		map.insert(SoaMap::value_type(Integer(i * 3), text(i)));
+		ref.insert(ChainMap::value_type(Integer(i * 3), text(i)));
+	}
+	SoaMap::snapshot_view snap = map.snapshot();
+	SoaMap copy = map;
+	map.retain([](const SoaMap::value_type &v) { return v.first.val % 2 != 0; });
+	ref.retain([](const ChainMap::value_type &v) { return v.first.val % 2 != 0; });
+	std::cout << same(map, ref) << ' ' << same(*snap, copy) << ' ' << snap->size() << std::endl;
+	map.pop_front(1000);
+	ref.pop_front(1000);
+	std::cout << same(map, ref) << ' ' << map.size() << ' ' << copy.count(Integer(0)) << std::endl;
+}
+
+int main() {
+	test_random();
+	test_inline_keys();
+	test_wide_keys();
+	test_features();
+	std::cout << "leaked " << Integer::counter << std::endl;
+	return 0;
+}
@@ -0,0 +1,182 @@
+#include "persistent_linked_hashmap.hpp"
+#include "linked_hashmap.hpp"
+#include <iostream>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+class Integer {
+public:
+	static int counter;
+	int val;
+	Integer(int val) : val(val) { counter++; }
+	Integer(const Integer &rhs) : val(rhs.val) { counter++; }
+	~Integer() { counter--; }
+};
+int Integer::counter = 0;
+
+class Equal {
+public:
+	bool operator () (const Integer &lhs, const Integer &rhs) const { return lhs.val == rhs.val; }
+};
+class Hash {
+public:
+	unsigned int operator () (const Integer &lhs) const { return std::hash<int>()(lhs.val); }
+};
+// every key collides on the full hash; exercises collision nodes
+class PoorHash {
+public:
+	size_t operator () (const Integer &lhs) const { return lhs.val & 3; }
+};
+
+int compares_left = -1;
+// throws once compares_left runs out, to interrupt a path copy halfway
+class FailingEqual {
+public:
+	bool operator () (const Integer &lhs, const Integer &rhs) const {
+		if (compares_left == 0) throw 0;
+		if (compares_left > 0) compares_left--;
+		return lhs.val == rhs.val;
+	}
+};
+
+typedef sjtu::persistent_linked_hashmap<Integer, std::string, Hash, Equal> PMap;
+typedef sjtu::persistent_linked_hashmap<Integer, std::string, PoorHash, FailingEqual> FailingMap;
+typedef sjtu::persistent_linked_hashmap<Integer, std::string, PoorHash, Equal> PoorMap;
+typedef sjtu::linked_hashmap<Integer, std::string, Hash, Equal> Map;
+
+std::string text(int i) { return std::string(i % 13 + 1, char('a' + i % 26)); }
+
+unsigned int state = 20260417;
+int next_rand(int mod) {
+	state = state * 1103515245u + 12345u;
+	return (state >> 8) % mod;
+}
+
+template<class P>
+bool same(const P &p, const Map &m) {
+	if (p.size() != m.size()) return false;
+	typename P::const_iterator pit = p.cbegin();
+	for (Map::const_iterator it = m.cbegin(); it != m.cend(); ++it, ++pit) {
+		if (pit == p.cend()) return false;
+		if (pit->first.val != it->first.val || pit->second != it->second) return false;
+		if (p.at(it->first) != it->second || p.count(it->first) != 1) return false;
+		if (p.find(it->first) != pit) return false;
+	}
+	return pit == p.cend();
+}
+
+void set(Map &m, int k, const std::string &v) {
+	Map::iterator it = m.find(Integer(k));
+	if (it == m.end()) m.insert(Map::value_type(Integer(k), v));
+	else it->second = v;
+}
+
+void test_basic() {
+	puts("Test: with and without leave the old version alone");
+	PMap empty;
+	PMap a = empty.with(1, "one").with(2, "two").with(3, "three");
+	PMap b = a.with(2, "TWO");
+	PMap c = b.without(1);
+	PMap d = c.without(42);
+	std::cout << empty.size() << ' ' << empty.empty() << ' ' << (empty.cbegin() == empty.cend()) << std::endl;
+	for (const PMap *p : {&a, &b, &c, &d}) {
+		for (PMap::const_iterator it = p->cbegin(); it != p->cend(); ++it)
+			std::cout << it->first.val << '=' << it->second << ' ';
+		std::cout << "| " << p->size() << std::endl;
+	}
+	std::cout << a.count(4) << ' ' << (a.find(4) == a.cend()) << std::endl;
+	try {
+		a.at(4);
+	} catch (...) {
+		puts("at throws for a missing key");
+	}
+	PMap e = c.without(2).without(3);
+	std::cout << e.size() << ' ' << (e.cbegin() == e.cend()) << std::endl;
+	PMap f = e.with(7, "seven");
+	std::cout << f.cbegin()->first.val << ' ' << f.size() << std::endl;
+}
+
+template<class P>
+void test_history(const char *name, int rounds, int range) {
+	printf("Test: random version history (%s)\n", name);
+	std::vector<P> versions(1);
+	std::vector<Map> models(1);
+	bool ok = true;
+	for (int r = 0; r < rounds; r++) {
+		// mostly branch off recent versions so the maps actually grow
+		int from = next_rand(4) == 0 ? next_rand(versions.size()) : versions.size() - 1 - next_rand(versions.size() < 8 ? versions.size() : 8);
+		int op = next_rand(10), k = next_rand(range);
+		P next;
+		Map model = models[from];
+		if (op < 8) {
+			next = versions[from].with(k, text(k + r));
+			set(model, k, text(k + r));
+		} else {
+			next = versions[from].without(k);
+			model.erase(Integer(k));
+		}
+		versions.push_back(next);
+		models.push_back(model);
+		if (r % 97 == 0) {
+			for (size_t i = 0; i < versions.size(); i += 7)
+				if (!same(versions[i], models[i])) ok = false;
+		}
+	}
+	for (size_t i = 0; i < versions.size(); i++)
+		if (!same(versions[i], models[i])) ok = false;
+	std::cout << (ok ? "consistent" : "MISMATCH") << ' ' << versions.back().size() << std::endl;
+}
+
+void test_long_run() {
+	puts("Test: long linear history");
+	PMap p;
+	Map m;
+	bool ok = true;
+	for (int i = 0; i < 100000; i++) {
+		int k = next_rand(5000);
+		if (next_rand(3) == 0) {
+			p = p.without(k);
+			Map::iterator it = m.find(Integer(k));
+			if (it != m.end()) m.erase(it);
+		} else {
+			p = p.with(k, text(i));
+			set(m, k, text(i));
+		}
+		if (i % 20000 == 0 && !same(p, m)) ok = false;
+	}
+	std::cout << (ok && same(p, m) ? "consistent" : "MISMATCH") << ' ' << p.size() << std::endl;
+}
+
+void test_unwind() {
+	puts("Test: a throw in the middle of with() leaves nothing behind");
+	FailingMap p;
+	for (int i = 0; i < 8; i++) p = p.with(i * 4, text(i));
+	for (int i = 1; i < 4; i++) p = p.with(i, text(i));
+	int thrown = 0;
+	// the key sits below the root, whose other children a copy retains,
+	// and a chain of nodes ending in a collision node: with() copies
+	// them, then compares against the colliding keys (once in the lookup
+	// before, once in the copy)
+	for (int budget = 0; budget < 16; budget++) {
+		compares_left = budget;
+		try {
+			p.with(100, "x");
+		} catch (int) {
+			thrown++;
+		}
+		compares_left = -1;
+	}
+	FailingMap q = p.with(100, "x").without(0);
+	std::cout << thrown << ' ' << p.size() << ' ' << q.size() << ' ' << q.at(100) << std::endl;
+}
+
+int main() {
+	test_basic();
+	test_history<PMap>("spread hash", 3000, 200);
+	test_history<PoorMap>("colliding hash", 1500, 60);
+	test_long_run();
+	test_unwind();
+	std::cout << "leaked " << Integer::counter << std::endl;
+	return 0;
+}
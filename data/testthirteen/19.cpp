@@ -0,0 +1,143 @@
+#include "linked_hashmap.hpp"
+#include "storage.hpp"
+#include <iostream>
+#include <cstdio>
+#include <string>
+
+class Integer {
+public:
+	static int counter;
+	int val;
+	Integer(int val) : val(val) { counter++; }
+	Integer(const Integer &rhs) : val(rhs.val) { counter++; }
+	~Integer() { counter--; }
+};
+int Integer::counter = 0;
+
+class Equal {
+public:
+	bool operator () (const Integer &lhs, const Integer &rhs) const { return lhs.val == rhs.val; }
+};
+class Hash {
+public:
+	unsigned int operator () (const Integer &lhs) const { return std::hash<int>()(lhs.val); }
+};
+// many keys per hash value, to make long probe runs
+class PoorHash {
+public:
+	size_t operator () (const Integer &lhs) const { return lhs.val / 16; }
+};
+
+typedef sjtu::linked_hashmap<Integer, std::string, Hash, Equal, sjtu::robin_hood_storage> RobinMap;
+typedef sjtu::linked_hashmap<Integer, std::string, PoorHash, Equal, sjtu::robin_hood_storage> PoorRobinMap;
+typedef sjtu::linked_hashmap<Integer, std::string, Hash, Equal> ChainMap;
+
+std::string text(int i) { return std::string(i % 11 + 1, char('a' + i % 26)); }
+
+unsigned int state = 20261017;
+int next_rand(int mod) {
+	state = state * 1103515245u + 12345u;
+	return (state >> 8) % mod;
+}
+
+template<class A, class B>
+bool same(const A &a, const B &b) {
+	if (a.size() != b.size()) return false;
+	typename B::const_iterator bit = b.cbegin();
+	for (typename A::const_iterator it = a.cbegin(); it != a.cend(); ++it, ++bit)
+		if (it->first.val != bit->first.val || it->second != bit->second) return false;
+	return true;
+}
+
+template<class Map>
+bool random_against_chains(Map &map, int rounds, int range) {
+	ChainMap ref;
+	bool ok = true;
+	for (int r = 0; r < rounds; r++) {
+		int op = next_rand(12), k = next_rand(range);
+		if (op < 6) {
+			bool x = map.insert(typename Map::value_type(Integer(k), text(r))).second;
+			bool y = ref.insert(ChainMap::value_type(Integer(k), text(r))).second;
+			if (x != y) ok = false;
+		} else if (op < 9) {
+			if (map.erase(Integer(k)) != ref.erase(Integer(k))) ok = false;
+		} else if (op < 11) {
+			const Map &cmap = map;
+			typename Map::const_iterator it = cmap.find(Integer(k));
+			if ((it == cmap.cend()) != (ref.count(Integer(k)) == 0)) ok = false;
+			else if (it != cmap.cend() && it->second != ref.at(Integer(k))) ok = false;
+		} else if (map.size() > 0) {
+			size_t n = next_rand(4);
+			map.pop_front(n);
+			ref.pop_front(n);
+		}
+		if (map.load_factor() > map.max_load_factor()) ok = false;
+	}
+	return ok && same(map, ref);
+}
+
+void test_random() {
+	puts("Test: robin hood storage agrees with chains");
+	RobinMap map;
+	std::cout << map.max_load_factor() << ' ' << random_against_chains(map, 200000, 30000) << ' ' << map.size() << std::endl;
+	PoorRobinMap poor;
+	std::cout << random_against_chains(poor, 50000, 5000) << ' ' << poor.size() << std::endl;
+}
+
+void test_load_factor() {
+	puts("Test: configurable load factor");
+	RobinMap map;
+	map.max_load_factor(0.97);
+	for (int i = 0; i < 100000; i++) map.insert(RobinMap::value_type(Integer(i * 7), text(i)));
+	std::cout << map.max_load_factor() << ' ' << (map.load_factor() <= 0.97) << ' ' << (map.load_factor() > 0.45) << std::endl;
+	map.max_load_factor(0.5);
+	std::cout << (map.load_factor() <= 0.5) << ' ' << map.at(Integer(700)) << std::endl;
+	try {
+		map.max_load_factor(1.0);
+	} catch (...) {
+		puts("open addressing needs a load factor below 1");
+	}
+	ChainMap chains;
+	chains.max_load_factor(3.0);
+	for (int i = 0; i < 1000; i++) chains.insert(ChainMap::value_type(Integer(i), text(i)));
+	std::cout << chains.max_load_factor() << ' ' << (chains.load_factor() > 1.0) << ' ' << chains.at(Integer(999)) << std::endl;
+	try {
+		chains.max_load_factor(0);
+	} catch (...) {
+		puts("a load factor must be positive");
+	}
+}
+
+void test_features() {
+	puts("Test: map features over robin hood storage");
+	RobinMap map;
+	ChainMap ref;
+	for (int i = 0; i < 5000; i++) {
+		map.insert(RobinMap::value_type(Integer(i * 3), text(i)));
+		ref.insert(ChainMap::value_type(Integer(i * 3), text(i)));
+	}
+	RobinMap::snapshot_view snap = map.snapshot();
+	RobinMap copy = map;
+	for (RobinMap::iterator it = map.begin(); it != map.end();) {
+		if (it->first.val % 2 == 0) it = map.erase(it);
+		else ++it;
+	}
+	ref.retain([](const ChainMap::value_type &v) { return v.first.val % 2 != 0; });
+	std::cout << same(map, ref) << ' ' << same(*snap, copy) << ' ' << snap->size() << std::endl;
+	map.set_indexed(true);
+	std::cout << map.nth(100)->first.val << ' ' << map.position_of(map.find(Integer(303))) << std::endl;
+	map.erase(map.nth(10), map.nth(2000));
+	ref.erase(ref.nth(10), ref.nth(2000));
+	std::cout << same(map, ref) << ' ' << map.size() << std::endl;
+	map.clear();
+	map.insert(RobinMap::value_type(Integer(1), "one"));
+	std::cout << map.size() << ' ' << map.at(Integer(1)) << ' ' << copy.count(Integer(3)) << std::endl;
+}
+
+int main() {
+	test_random();
+	test_load_factor();
+	test_features();
+	std::cout << "leaked " << Integer::counter << std::endl;
+	return 0;
+}
@@ -0,0 +1,176 @@
+#include "linked_hashmap.hpp"
+#include <iostream>
+#include <cstdio>
+#include <string>
+
+class Long {
+public:
+	long long val;
+	Long(long long val) : val(val) {}
+};
+class LongEqual {
+public:
+	bool operator () (const Long &lhs, const Long &rhs) const { return lhs.val == rhs.val; }
+};
+// drops the upper half of the key, as a careless 32-bit hash would
+class TruncatingHash {
+public:
+	unsigned int operator () (const Long &key) const { return (unsigned int)key.val; }
+};
+class GoodHash {
+public:
+	size_t operator () (const Long &key) const { return std::hash<long long>()(key.val); }
+};
+
+namespace sjtu {
+template<>
+struct bucket_less<Long> {
+	bool operator () (const Long &lhs, const Long &rhs) const { return lhs.val < rhs.val; }
+};
+}
+
+class Integer {
+public:
+	static int counter;
+	int val;
+	Integer(int val) : val(val) { counter++; }
+	Integer(const Integer &rhs) : val(rhs.val) { counter++; }
+	~Integer() { counter--; }
+};
+int Integer::counter = 0;
+class Equal {
+public:
+	bool operator () (const Integer &lhs, const Integer &rhs) const { return lhs.val == rhs.val; }
+};
+// a few distinct hash values, no order: equal hashes are scanned
+class FewHash {
+public:
+	size_t operator () (const Integer &key) const { return (size_t)(key.val % 37) << 20; }
+};
+class IntegerHash {
+public:
+	size_t operator () (const Integer &key) const { return std::hash<int>()(key.val); }
+};
+
+unsigned int state = 20261017;
+int next_rand(int mod) {
+	state = state * 1103515245u + 12345u;
+	return (state >> 8) % mod;
+}
+
+template<class A, class B>
+bool same(const A &a, const B &b) {
+	if (a.size() != b.size()) return false;
+	typename B::const_iterator bit = b.cbegin();
+	for (typename A::const_iterator it = a.cbegin(); it != a.cend(); ++it, ++bit)
+		if (it->first.val != bit->first.val || it->second != bit->second) return false;
+	return true;
+}
+
+template<class A, class B, class K>
+bool random_ops(A &a, B &b, int rounds, int range, K key_of) {
+	bool ok = true;
+	for (int r = 0; r < rounds; r++) {
+		int op = next_rand(10), k = next_rand(range);
+		if (op < 5) {
+			bool x = a.insert(typename A::value_type(key_of(k), r)).second;
+			bool y = b.insert(typename B::value_type(key_of(k), r)).second;
+			if (x != y) ok = false;
+		} else if (op < 8) {
+			if (a.erase(key_of(k)) != b.erase(key_of(k))) ok = false;
+		} else {
+			typename A::const_iterator it = static_cast<const A&>(a).find(key_of(k));
+			if (a.count(key_of(k)) != b.count(key_of(k))) ok = false;
+			else if (it != a.cend() && it->second != b.at(key_of(k))) ok = false;
+		}
+	}
+	return ok && same(a, b);
+}
+
+Long wide_key(int k) { return Long((long long)k << 32); }
+Integer few_key(int k) { return Integer(k); }
+
+void test_ordered_tree() {
+	puts("Test: full-hash collisions ordered by bucket_less");
+	sjtu::linked_hashmap<Long, int, TruncatingHash, LongEqual> bad;
+	sjtu::linked_hashmap<Long, int, GoodHash, LongEqual> good;
+	std::cout << random_ops(bad, good, 200000, 20000, wide_key) << ' ' << bad.size() << std::endl;
+	for (int i = 0; i < 50000; i++) {
+		bad.insert(sjtu::pair<const Long, int>(wide_key(i + 100000), i));
+		good.insert(sjtu::pair<const Long, int>(wide_key(i + 100000), i));
+	}
+	bool found = true;
+	for (int i = 0; i < 50000; i++)
+		if (bad.at(wide_key(i + 100000)) != i) found = false;
+	std::cout << found << ' ' << same(bad, good) << ' ' << bad.size() << std::endl;
+}
+
+void test_scanned_tree() {
+	puts("Test: equal hashes without an order are scanned");
+	sjtu::linked_hashmap<Integer, int, FewHash, Equal> bad;
+	sjtu::linked_hashmap<Integer, int, IntegerHash, Equal> good;
+	std::cout << random_ops(bad, good, 100000, 4000, few_key) << ' ' << bad.size() << std::endl;
+}
+
+void test_shrink_and_regrow() {
+	puts("Test: trees come and go with the bucket size");
+	sjtu::linked_hashmap<Long, int, TruncatingHash, LongEqual> bad;
+	sjtu::linked_hashmap<Long, int, GoodHash, LongEqual> good;
+	bool ok = true;
+	for (int round = 0; round < 50; round++) {
+		int n = next_rand(20);
+		for (int i = 0; i < n; i++) {
+			bad.insert(sjtu::pair<const Long, int>(wide_key(i), round));
+			good.insert(sjtu::pair<const Long, int>(wide_key(i), round));
+		}
+		for (int i = 0; i < 20; i++) {
+			if (next_rand(2) == 0) continue;
+			if (bad.erase(wide_key(i)) != good.erase(wide_key(i))) ok = false;
+		}
+		if (!same(bad, good)) ok = false;
+		for (int i = 0; i < 20; i++)
+			if (bad.count(wide_key(i)) != good.count(wide_key(i))) ok = false;
+	}
+	std::cout << ok << std::endl;
+}
+
+void test_bulk_operations() {
+	puts("Test: bulk operations on treeified buckets");
+	typedef sjtu::linked_hashmap<Integer, int, FewHash, Equal> Map;
+	typedef sjtu::linked_hashmap<Integer, int, IntegerHash, Equal> Ref;
+	Map bad;
+	Ref good;
+	for (int i = 0; i < 3000; i++) {
+		bad.insert(Map::value_type(Integer(i * 3), i));
+		good.insert(Ref::value_type(Integer(i * 3), i));
+	}
+	Map copy(bad);
+	Map::snapshot_view snap = bad.snapshot();
+	struct odd {
+		bool operator () (const Map::value_type &v) const { return v.second % 2 == 1; }
+	};
+	bad.retain(odd());
+	good.retain(odd());
+	std::cout << same(bad, good) << ' ' << bad.count(Integer(3)) << ' ' << bad.count(Integer(6)) << std::endl;
+	bad.pop_front(700);
+	good.pop_front(700);
+	bad.erase(bad.nth(100), bad.nth(400));
+	good.erase(good.nth(100), good.nth(400));
+	std::cout << same(bad, good) << ' ' << bad.size() << std::endl;
+	bool ok = copy.size() == 3000 && snap->size() == 3000;
+	for (int i = 0; i < 3000; i++)
+		if (copy.at(Integer(i * 3)) != i || snap->at(Integer(i * 3)) != i) ok = false;
+	std::cout << ok << std::endl;
+	bad.clear();
+	for (int i = 0; i < 500; i++) bad.insert(Map::value_type(Integer(i), i));
+	std::cout << bad.size() << ' ' << bad.at(Integer(499)) << std::endl;
+}
+
+int main() {
+	test_ordered_tree();
+	test_scanned_tree();
+	test_shrink_and_regrow();
+	test_bulk_operations();
+	std::cout << "leaked " << Integer::counter << std::endl;
+	return 0;
+}
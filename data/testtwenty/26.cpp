@@ -0,0 +1,88 @@
+#include "linked_hashmap.hpp"
+#include "seeded_hash.hpp"
+#include "storage.hpp"
+#include <iostream>
+#include <cstdio>
+#include <string>
+
+typedef sjtu::linked_hashmap<int, int> ChainMap;
+typedef sjtu::linked_hashmap<int, int, std::hash<int>, std::equal_to<int>, sjtu::hopscotch_storage> HopMap;
+typedef sjtu::linked_hashmap<std::string, int, sjtu::seeded_hash<std::string>, std::equal_to<std::string>, sjtu::robin_hood_storage> SeededMap;
+
+unsigned int state = 20261018;
+int next_rand(int mod) {
+	state = state * 1103515245u + 12345u;
+	return (state >> 8) % mod;
+}
+
+template<class Map>
+void test_equality(const char *name) {
+	printf("Test: equality (%s)\n", name);
+	Map a, b;
+	for (int i = 0; i < 100; i++) a.insert(typename Map::value_type(i, i * i));
+	for (int i = 99; i >= 0; i--) b.insert(typename Map::value_type(i, i * i));
+	std::cout << (a == b) << (a != b) << a.equal_in_order(b) << (a.key_fingerprint() == b.key_fingerprint()) << ' ';
+	Map c(a);
+	std::cout << (a == c) << a.equal_in_order(c) << ' ';
+	c[50] = 0;
+	std::cout << (a == c) << a.equal_in_order(c) << (a.key_fingerprint() == c.key_fingerprint()) << ' ';
+	c.erase(50);
+	std::cout << (a == c) << (a.key_fingerprint() == c.key_fingerprint()) << ' ';
+	c.insert(typename Map::value_type(50, 2500));
+	std::cout << (a == c) << a.equal_in_order(c) << (a.key_fingerprint() == c.key_fingerprint()) << ' ';
+	c.erase(0);
+	c.insert(typename Map::value_type(100, 0));
+	std::cout << (a == c) << (a.key_fingerprint() == c.key_fingerprint()) << ' ';
+	Map empty1, empty2;
+	std::cout << (empty1 == empty2) << empty1.equal_in_order(empty2) << (empty1.key_fingerprint() == 0) << ' ';
+	a.clear();
+	std::cout << (a == empty1) << (a.key_fingerprint() == 0) << std::endl;
+}
+
+void test_seeded() {
+	puts("Test: seeded hashers probe with their own hash codes");
+	SeededMap a, b;
+	for (int i = 0; i < 200; i++) a.insert(SeededMap::value_type("k" + std::to_string(i), i));
+	for (int i = 199; i >= 0; i--) b.insert(SeededMap::value_type("k" + std::to_string(i), i));
+	SeededMap c(a);
+	std::cout << (a == b) << a.equal_in_order(b) << (a == c) << a.equal_in_order(c) << (a.key_fingerprint() == c.key_fingerprint()) << ' ';
+	b["k7"] = -1;
+	std::cout << (a == b) << std::endl;
+}
+
+template<class Map>
+size_t recount(const Map &map) {
+	Map copy;
+	for (typename Map::const_iterator it = map.cbegin(); it != map.cend(); ++it) copy.insert(*it);
+	return copy.key_fingerprint();
+}
+
+bool random_fingerprints() {
+	bool ok = true;
+	ChainMap a, b;
+	for (int r = 0; r < 20000; r++) {
+		int op = next_rand(10), k = next_rand(500);
+		if (op < 5) a.insert(ChainMap::value_type(k, k));
+		else if (op < 7) a.erase(k);
+		else if (op < 8) a.pop_front(next_rand(4));
+		else if (op < 9) a.retain([&](const ChainMap::value_type &v) { return v.first % 7 != k % 7; });
+		else {
+			ChainMap other;
+			for (int i = 0; i < 20; i++) other.insert(ChainMap::value_type(next_rand(500), i));
+			if (k % 2) a.merge_from(other, sjtu::merge_keep());
+			else a.merge_from(std::move(other), sjtu::merge_keep());
+		}
+		if (r % 500 == 0 && a.key_fingerprint() != recount(a)) ok = false;
+	}
+	for (ChainMap::const_iterator it = a.cbegin(); it != a.cend(); ++it) b.insert(*it);
+	return ok && a == b && a.equal_in_order(b) && a.key_fingerprint() == b.key_fingerprint();
+}
+
+int main() {
+	test_equality<ChainMap>("chained");
+	test_equality<HopMap>("hopscotch");
+	test_seeded();
+	puts("Test: key fingerprints follow every insert and erase");
+	std::cout << random_fingerprints() << std::endl;
+	return 0;
+}
@@ -0,0 +1,160 @@
+#include "write_behind_linked_hashmap.hpp"
+#include "storage.hpp"
+#include <iostream>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef sjtu::write_behind_linked_hashmap<std::string, int> CountMap;
+typedef sjtu::write_behind_linked_hashmap<int, long long> LongMap;
+typedef sjtu::write_behind_linked_hashmap<int, long long, std::hash<int>, std::equal_to<int>, sjtu::robin_hood_storage> RobinLongMap;
+
+/**
+ * a value whose assignment throws when given -1.
+ */
+class Fussy {
+public:
+	int v;
+	Fussy(int x = 0) : v(x) {}
+	Fussy(const Fussy &other) : v(other.v) {}
+	Fussy & operator=(const Fussy &other) {
+		if (other.v == -1) throw sjtu::runtime_error();
+		v = other.v;
+		return *this;
+	}
+};
+typedef sjtu::write_behind_linked_hashmap<int, Fussy> FussyMap;
+
+void test_single() {
+	puts("Test: queued changes show after flush()");
+	CountMap map(5, 3);
+	std::cout << map.queue_capacity() << ' ';
+	for (int i = 0; i < 20; i++) map.async_insert("k" + std::to_string(i % 7), i);
+	map.async_erase("k3");
+	map.async_erase("nope");
+	std::string key = "k3";
+	map.async_insert(std::move(key), 100);
+	map.flush();
+	std::cout << map.size() << ' ' << map.applied_count() << ' ' << (map.batch_count() >= 8) << ' ';
+	std::cout << map.read([](const CountMap::map_type &m) {
+		std::string s;
+		for (CountMap::map_type::const_iterator it = m.cbegin(); it != m.cend(); ++it)
+			if (it->first == "k3" || it->first == "k5") s += it->first + "=" + std::to_string(it->second) + " ";
+		return s;
+	}) << std::endl;
+	map.flush();
+
+	puts("Test: what the applier throws comes out of flush()");
+	FussyMap fussy;
+	fussy.async_insert(1, Fussy(1));
+	fussy.async_insert(1, Fussy(-1));
+	fussy.async_insert(2, Fussy(2));
+	try {
+		fussy.flush();
+	} catch (sjtu::runtime_error &) {
+		puts("runtime_error");
+	}
+	fussy.flush();
+	std::cout << fussy.size() << ' ' << fussy.read([](const FussyMap::map_type &m) { return m.at(1).v + m.at(2).v; }) << std::endl;
+}
+
+/**
+ * a hasher that throws on 13.
+ */
+struct PickyHash {
+	size_t operator()(int x) const {
+		if (x == 13) throw sjtu::runtime_error();
+		return std::hash<int>()(x);
+	}
+};
+typedef sjtu::write_behind_linked_hashmap<int, int, PickyHash> PickyMap;
+
+/**
+ * big batches of new keys, updates and erases end up in the order the
+ *   same changes give when applied one at a time.
+ */
+void test_order() {
+	puts("Test: new keys join the insertion order in queue order");
+	LongMap map(1024, 1024);
+	sjtu::linked_hashmap<int, long long> ref;
+	unsigned int state = 7;
+	for (int i = 0; i < 3000; i++) {
+		state = state * 1103515245u + 12345u;
+		int key = (state >> 8) % 500;
+		if (i % 5 == 4) {
+			map.async_erase(key);
+			ref.erase(key);
+		} else {
+			map.async_insert(key, (long long)i);
+			ref[key] = i;
+		}
+	}
+	map.flush();
+	std::cout << map.read([&](const LongMap::map_type &m) { return m.equal_in_order(ref); }) << ' ' << map.size() << std::endl;
+
+	puts("Test: a throwing hasher comes out of flush()");
+	PickyMap picky;
+	picky.async_insert(1, 1);
+	picky.async_insert(13, 13);
+	picky.async_erase(13);
+	picky.async_insert(2, 2);
+	try {
+		picky.flush();
+	} catch (sjtu::runtime_error &) {
+		puts("runtime_error");
+	}
+	std::cout << picky.size() << ' ' << picky.applied_count() << std::endl;
+}
+
+/**
+ * producers write their own keys, each ending up erased or holding the
+ *   last value written to it, while another thread keeps flushing.
+ */
+template<class Map>
+bool concurrent() {
+	const int producers = 4, rounds = 5000;
+	Map map(64, 16);
+	std::vector<std::thread> threads;
+	for (int t = 0; t < producers; t++) {
+		threads.push_back(std::thread([&, t]() {
+			for (int i = 0; i < rounds; i++) {
+				int key = t * 1000 + i % 1000;
+				if (i % 7 == 3) map.async_erase(key);
+				else map.async_insert(key, (long long)i);
+			}
+		}));
+	}
+	std::thread flusher([&]() {
+		for (int i = 0; i < 50; i++) {
+			map.flush();
+			std::this_thread::yield();
+		}
+	});
+	for (size_t t = 0; t < threads.size(); t++) threads[t].join();
+	flusher.join();
+	map.flush();
+	bool ok = map.applied_count() == (unsigned long long)producers * rounds;
+	map.read([&](const typename Map::map_type &m) {
+		for (int t = 0; t < producers; t++)
+			for (int k = 0; k < 1000; k++) {
+				int last = 4000 + k;
+				typename Map::map_type::const_iterator it = m.find(t * 1000 + k);
+				if (last % 7 == 3) {
+					if (it != m.cend()) ok = false;
+				} else if (it == m.cend() || it->second != last) {
+					ok = false;
+				}
+			}
+		return 0;
+	});
+	return ok;
+}
+
+int main() {
+	test_single();
+	test_order();
+	puts("Test: four producers");
+	std::cout << concurrent<LongMap>() << concurrent<RobinLongMap>() << std::endl;
+	return 0;
+}
@@ -0,0 +1,122 @@
+#include "read_mostly_linked_hashmap.hpp"
+#include "storage.hpp"
+#include <iostream>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <vector>
+
+typedef sjtu::read_mostly_linked_hashmap<int, std::string> StringMap;
+typedef sjtu::read_mostly_linked_hashmap<int, long long> SumMap;
+typedef sjtu::read_mostly_linked_hashmap<int, long long, std::hash<int>, std::equal_to<int>, sjtu::robin_hood_storage> RobinSumMap;
+
+unsigned int state = 20261022;
+int next_rand(int mod) {
+	state = state * 1103515245u + 12345u;
+	return (state >> 8) % mod;
+}
+
+void test_single() {
+	puts("Test: updates and reads");
+	StringMap map(2);
+	StringMap::reader r(map);
+	std::string v;
+	std::cout << r.find(1, v) << map.insert(StringMap::value_type(1, "one")) << map.insert(StringMap::value_type(1, "uno")) << ' ';
+	map.assign(2, "two");
+	map.assign(1, "eins");
+	std::cout << r.find(1, v) << v << ' ' << r.count(2) << r.count(3) << ' ' << map.erase(2) << map.erase(2) << ' ' << r.size() << ' ' << map.version() << std::endl;
+	for (int i = 0; i < 100; i++) map.assign(i, std::to_string(i * i));
+	std::cout << r.read([](const StringMap::map_type &m) { return m.cbegin()->second + "," + m.at(99); }) << ' ' << map.writer_view().size() << std::endl;
+
+	puts("Test: a failed update is undone");
+	try {
+		map.modify([](StringMap::map_type &m) {
+			m.erase(5);
+			m[500] = "x";
+			throw sjtu::runtime_error();
+		});
+	} catch (sjtu::runtime_error &) {
+		puts("runtime_error");
+	}
+	std::cout << r.count(5) << r.count(500) << ' ' << r.size() << ' ' << map.version() << ' ';
+	map.clear();
+	std::cout << r.size() << map.writer_view().size() << std::endl;
+
+	puts("Test: reader slots");
+	{
+		StringMap::reader r2(map);
+		try {
+			StringMap::reader r3(map);
+		} catch (sjtu::runtime_error &) {
+			puts("runtime_error");
+		}
+	}
+	StringMap::reader r3(map);
+	std::cout << map.max_readers() << ' ' << r3.size() << std::endl;
+}
+
+/**
+ * the writer moves amounts between keys, keeping the values summing to
+ *   zero, and sometimes clears, so the tables grow and shrink; readers
+ *   must only ever see a zero sum and versions that never go back.
+ */
+template<class Map>
+bool concurrent() {
+	Map map(4);
+	const int readers = 3;
+	std::vector<int> ok(readers, 1);
+	std::vector<long long> reads(readers, 0);
+	std::atomic<bool> done(false);
+	std::vector<std::thread> threads;
+	for (int t = 0; t < readers; t++) {
+		threads.push_back(std::thread([&, t]() {
+			typename Map::reader r(map);
+			unsigned long long last = 0;
+			while (!done) {
+				unsigned long long seen = map.version();
+				long long sum = r.read([](const typename Map::map_type &m) {
+					long long s = 0;
+					int n = 0;
+					// give the writer a chance to run in the middle of a read
+					for (typename Map::map_type::const_iterator it = m.cbegin(); it != m.cend(); ++it) {
+						s += it->second;
+						if (++n % 64 == 0) std::this_thread::yield();
+					}
+					return s;
+				});
+				long long v;
+				if (sum != 0 || seen < last || (r.find(-1, v) && v != 0)) ok[t] = 0;
+				last = seen;
+				reads[t]++;
+				std::this_thread::yield();
+			}
+		}));
+	}
+	for (int i = 0; i < 20000; i++) {
+		int a = next_rand(1000), b = next_rand(1000);
+		long long d = next_rand(100);
+		if (next_rand(200) == 0) map.clear();
+		map.modify([&](typename Map::map_type &m) {
+			m[a] -= d;
+			m[b] += d;
+			m[-1] = 0;
+		});
+		if (i % 20 == 0) std::this_thread::yield();
+		if (i % 7 == 0 && map.writer_view().count(a) && map.writer_view().at(a) == 0) map.erase(a);
+	}
+	done = true;
+	for (size_t t = 0; t < threads.size(); t++) threads[t].join();
+	long long total = 0;
+	for (int t = 0; t < readers; t++) total += reads[t];
+	bool all = total > 0;
+	for (int t = 0; t < readers; t++) if (!ok[t]) all = false;
+	return all;
+}
+
+int main() {
+	test_single();
+	puts("Test: one writer, three readers");
+	std::cout << concurrent<SumMap>() << concurrent<RobinSumMap>() << std::endl;
+	return 0;
+}
@@ -0,0 +1,91 @@
+#include "linked_hashmap.hpp"
+#include "storage.hpp"
+#include <iostream>
+#include <cstdio>
+
+typedef sjtu::linked_hashmap<int, int> ChainMap;
+typedef sjtu::linked_hashmap<int, int, std::hash<int>, std::equal_to<int>, sjtu::robin_hood_storage> RobinMap;
+typedef sjtu::linked_hashmap<int, int, std::hash<int>, std::equal_to<int>, sjtu::cuckoo_storage> CuckooMap;
+typedef sjtu::linked_hashmap<int, int, std::hash<int>, std::equal_to<int>, sjtu::hopscotch_storage> HopMap;
+typedef sjtu::linked_hashmap<int, int, std::hash<int>, std::equal_to<int>, sjtu::soa_storage> SoaMap;
+
+// few distinct hash codes, so cuckoo_storage has to stash
+class FewHash {
+public:
+	size_t operator () (int k) const { return (size_t)(k % 5) * 0x9e3779b97f4a7c15ULL; }
+};
+typedef sjtu::linked_hashmap<int, int, FewHash, std::equal_to<int>, sjtu::cuckoo_storage> StashMap;
+
+unsigned int state = 20261021;
+int next_rand(int mod) {
+	state = state * 1103515245u + 12345u;
+	return (state >> 8) % mod;
+}
+
+void test_chained() {
+	puts("Test: chained buckets");
+	ChainMap map;
+	for (int i = 0; i < 10; i++) map[i * 16] = i;
+	map[3] = 100;
+	std::cout << map.bucket_count() << ' ' << map.bucket(32) << ' ' << map.bucket_size(0) << ' ' << map.bucket_size(3) << ' ' << map.bucket_size(5) << std::endl;
+	int sum = 0;
+	for (const ChainMap::value_type &v : map.buckets(0)) sum += v.second;
+	std::cout << sum << ' ' << map.buckets(3).begin()->first << ' ' << (map.buckets(4).begin() == map.buckets(4).end()) << ' ';
+	bool own = true;
+	for (size_t b = 0; b < map.bucket_count(); b++)
+		for (const ChainMap::value_type &v : map.buckets(b))
+			if (map.bucket(v.first) != b) own = false;
+	std::cout << own << std::endl;
+	try {
+		map.bucket_size(16);
+	} catch (sjtu::index_out_of_bound &) {
+		puts("index_out_of_bound");
+	}
+	try {
+		map.partition(0);
+	} catch (sjtu::runtime_error &) {
+		puts("runtime_error");
+	}
+	sjtu::linked_hashmap<int, int>::bucket_partition parts = map.partition(5);
+	for (size_t i = 0; i < parts.size(); i++) std::cout << parts[i].first_bucket() << '-' << parts[i].last_bucket() << ' ';
+	std::cout << std::endl;
+}
+
+/**
+ * every element is in exactly one part, and in exactly one bucket.
+ */
+template<class Map>
+bool covers(const Map &map, size_t k) {
+	typename Map::bucket_partition parts = map.partition(k);
+	Map seen;
+	size_t total = 0, sizes = 0;
+	for (size_t i = 0; i < parts.size(); i++) {
+		for (typename Map::bucket_iterator it = parts[i].begin(); it != parts[i].end(); it++) {
+			if (!seen.insert(*it).second || map.at(it->first) != it->second) return false;
+			total++;
+		}
+	}
+	for (size_t b = 0; b < map.bucket_count(); b++) sizes += map.bucket_size(b);
+	return total == map.size() && sizes == map.size() && seen.size() == map.size();
+}
+
+template<class Map>
+bool random_partitions() {
+	bool ok = true;
+	Map map;
+	for (int r = 0; r < 6000; r++) {
+		int k = next_rand(4000);
+		if (next_rand(3)) map[k] = r;
+		else map.erase(k);
+		if (r % 600 == 0 && !(covers(map, 1) && covers(map, 3) && covers(map, 16) && covers(map, map.bucket_count() + 5))) ok = false;
+	}
+	return ok;
+}
+
+int main() {
+	test_chained();
+	puts("Test: partitions cover every element once");
+	std::cout << random_partitions<ChainMap>() << random_partitions<RobinMap>() << random_partitions<CuckooMap>()
+		<< random_partitions<HopMap>() << random_partitions<SoaMap>() << random_partitions<StashMap>() << std::endl;
+	return 0;
+}
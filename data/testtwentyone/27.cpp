@@ -0,0 +1,110 @@
+#include "linked_hashmap.hpp"
+#include <iostream>
+#include <cstdio>
+#include <string>
+#include <tuple>
+#include <utility>
+
+int constructed, copied, moved;
+
+class Tracked {
+public:
+	int a, b;
+	Tracked() : a(0), b(0) { constructed++; }
+	Tracked(int x, int y) : a(x), b(y) { constructed++; }
+	Tracked(const Tracked &other) : a(other.a), b(other.b) { copied++; }
+	Tracked(Tracked &&other) : a(other.a), b(other.b) { moved++; }
+	Tracked & operator=(const Tracked &other) { a = other.a; b = other.b; copied++; return *this; }
+};
+
+void reset() { constructed = copied = moved = 0; }
+void report() { std::cout << constructed << ' ' << copied << ' ' << moved << std::endl; }
+
+typedef sjtu::linked_hashmap<int, Tracked> TrackedMap;
+typedef sjtu::linked_hashmap<std::string, int> Inner;
+typedef sjtu::linked_hashmap<std::string, Inner> Outer;
+
+void test_in_place() {
+	puts("Test: operator[], try_emplace and emplace construct in the node");
+	TrackedMap map;
+	reset();
+	map[1].a = 5;
+	report();
+	reset();
+	std::cout << map.try_emplace(2, 7, 8).second << map.try_emplace(2, 9, 9).second << ' ';
+	report();
+	reset();
+	std::cout << map.emplace(std::piecewise_construct, std::forward_as_tuple(3), std::forward_as_tuple(1, 2)).second << ' ';
+	report();
+	reset();
+	std::cout << map.emplace(3, Tracked(4, 4)).second << ' ';
+	report();
+	reset();
+	std::cout << map.insert(TrackedMap::value_type(4, Tracked(6, 6))).second << ' ';
+	report();
+	for (TrackedMap::const_iterator it = map.cbegin(); it != map.cend(); ++it)
+		std::cout << it->first << ':' << it->second.a << ',' << it->second.b << ' ';
+	std::cout << std::endl;
+}
+
+void test_plain_emplace() {
+	puts("Test: emplace with a key and a value");
+	sjtu::linked_hashmap<int, int> map;
+	std::cout << map.emplace(1, 2).second << map.emplace(3, 4L).second << map.emplace(1, 5).second << ' ';
+	short key = 6;
+	std::cout << map.emplace(key, 'a').second << map.emplace(sjtu::pair<int, int>(7, 8)).second << ' ';
+	std::cout << map.try_emplace(9).second << map.try_emplace(9, 10).second << std::endl;
+	for (sjtu::linked_hashmap<int, int>::const_iterator it = map.cbegin(); it != map.cend(); ++it)
+		std::cout << it->first << ':' << it->second << ' ';
+	std::cout << std::endl;
+}
+
+void test_nested() {
+	puts("Test: two-level maps");
+	Outer outer;
+	const char *users[] = {"ann", "bob", "cid"};
+	for (int i = 0; i < 300; i++) outer[users[i % 3]]["item" + std::to_string(i % 7)] += i;
+	for (Outer::const_iterator it = outer.cbegin(); it != outer.cend(); ++it) {
+		std::cout << it->first << ": ";
+		for (Inner::const_iterator jt = it->second.cbegin(); jt != it->second.cend(); ++jt)
+			std::cout << jt->first << '=' << jt->second << ' ';
+		std::cout << std::endl;
+	}
+	std::string key = "dan";
+	Inner inner;
+	inner["x"] = 1;
+	Inner::snapshot_view view = inner.snapshot();
+	outer.try_emplace(std::move(key), std::move(inner));
+	outer["dan"]["y"] = 2;
+	std::cout << outer.size() << ' ' << inner.size() << ' ' << view->size() << ' ' << outer["dan"].size() << ' ' << outer.at("dan").at("x") << std::endl;
+}
+
+void test_moves() {
+	puts("Test: moving whole maps");
+	TrackedMap a;
+	for (int i = 0; i < 100; i++) a.try_emplace(i, i, -i);
+	reset();
+	TrackedMap b(std::move(a));
+	TrackedMap c;
+	c = std::move(b);
+	report();
+	std::cout << a.size() << ' ' << b.size() << ' ' << c.size() << ' ' << c.at(42).b << std::endl;
+	const TrackedMap &moved_from = a;
+	std::cout << noexcept(TrackedMap(std::move(c))) << ' ' << moved_from.count(42) << (moved_from.find(1) == moved_from.cend())
+		<< (moved_from.cbegin() == moved_from.cend()) << moved_from.empty() << ' ' << moved_from.bucket_count() << std::endl;
+	TrackedMap::snapshot_view empty_view = a.snapshot();
+	a[7].a = 1;
+	std::cout << empty_view->size() << ' ' << a.size() << ' ' << (a.bucket_count() > 0) << std::endl;
+	b = c;
+	std::cout << a.size() << ' ' << b.size() << ' ' << (b.at(99).b == -99) << std::endl;
+	c = std::move(c);
+	std::cout << c.size() << std::endl;
+}
+
+int main() {
+	test_in_place();
+	test_plain_emplace();
+	test_nested();
+	test_moves();
+	return 0;
+}
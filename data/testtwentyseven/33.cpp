@@ -0,0 +1,197 @@
+#include "replicated_linked_hashmap.hpp"
+#include <iostream>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <vector>
+
+typedef sjtu::replicated_linked_hashmap<std::string, int> RouteMap;
+typedef sjtu::replicated_linked_hashmap<int, long long> SumMap;
+
+unsigned int state = 20261023;
+int next_rand(int mod) {
+	state = state * 1103515245u + 12345u;
+	return (state >> 8) % mod;
+}
+
+void test_single() {
+	puts("Test: replicas see updates at quiesce()");
+	RouteMap map(2, 8);
+	map.assign("a", 1);
+	RouteMap::replica r(map);
+	int v = 0;
+	std::cout << r.find("a", v) << v << ' ' << r.lag() << ' ';
+	std::cout << map.insert(RouteMap::value_type("b", 2)) << map.insert(RouteMap::value_type("b", 3)) << ' ';
+	map.assign("a", 10);
+	std::cout << map.erase("c") << map.erase("a") << ' ' << r.count("b") << r.find("a", v) << v << ' ' << r.lag() << map.max_lag() << ' ' << map.version() << std::endl;
+	r.quiesce();
+	std::cout << r.count("b") << r.count("a") << ' ' << r.size() << ' ' << r.lag() << map.max_lag() << ' ' << r.view().cbegin()->first << std::endl;
+	try {
+		map.modify([](RouteMap::map_type &m) { m.at("zzz"); });
+	} catch (sjtu::index_out_of_bound &) {
+		puts("index_out_of_bound");
+	}
+	std::cout << map.version() << ' ' << r.lag() << std::endl;
+
+	puts("Test: replica slots");
+	{
+		RouteMap::replica r2(map);
+		std::cout << r2.size() << ' ';
+		try {
+			RouteMap::replica r3(map);
+		} catch (sjtu::runtime_error &) {
+			puts("runtime_error");
+		}
+	}
+	map.clear();
+	RouteMap::replica r3(map);
+	std::cout << r3.size() << r.size() << ' ' << map.max_lag() << ' ';
+	r.quiesce();
+	std::cout << r.size() << ' ' << map.max_replicas() << ' ' << map.log_size() << std::endl;
+}
+
+/**
+ * updates never wait for a replica, not even one held by the updating
+ *   thread; a replica left behind by more than the log copies the map.
+ */
+void test_overrun() {
+	puts("Test: a replica that overran the log copies the map");
+	SumMap map(1, 4);
+	SumMap::replica r(map);
+	for (int i = 0; i < 40; i++) map.assign(i, i);
+	std::cout << r.size() << ' ' << r.lag() << ' ' << map.max_lag() << ' ';
+	r.quiesce();
+	long long v = 0;
+	std::cout << r.size() << ' ' << r.lag() << ' ' << (r.find(39, v) && v == 39) << ' ';
+	map.erase(0);
+	map.assign(1, -1);
+	r.quiesce();
+	std::cout << r.size() << ' ' << (r.find(1, v) && v == -1) << ' ' << r.count(0) << std::endl;
+}
+
+/**
+ * a value whose copy stalls, on a thread that asks for it, until let go.
+ */
+std::atomic<int> stalled(0), let_go(0);
+thread_local bool stall_copy = false;
+struct Gate {
+	int v;
+	Gate(int v = 0) : v(v) {}
+	Gate(const Gate &other) : v(other.v) {
+		if (!stall_copy) return;
+		stall_copy = false;
+		stalled = 1;
+		while (let_go == 0) std::this_thread::yield();
+	}
+	Gate & operator=(const Gate &other) = default;
+};
+typedef sjtu::replicated_linked_hashmap<int, Gate> GateMap;
+
+/**
+ * a replica replays the log and copies the map off the update lock, so
+ *   an update goes through while one is stuck in the middle of either.
+ */
+void test_catch_up() {
+	puts("Test: updates go through while a replica catches up");
+	GateMap map(2, 4);
+	map.assign(1, Gate(1));
+	std::atomic<int> ready(0), replaying(0), calls(0);
+	int seen = 0;
+	std::thread reader([&]() {
+		GateMap::replica r(map);
+		ready = 1;
+		while (r.lag() == 0) std::this_thread::yield();
+		r.quiesce();
+		Gate g;
+		r.find(2, g);
+		seen = g.v * 10 + (int)r.lag();
+	});
+	while (ready == 0) std::this_thread::yield();
+	map.modify([&](GateMap::map_type &m) {
+		// the second run is the reader's replay
+		if (calls++ == 1) {
+			replaying = 1;
+			while (let_go == 0) std::this_thread::yield();
+		}
+		m[2] = Gate(2);
+	});
+	while (replaying == 0) std::this_thread::yield();
+	map.assign(3, Gate(3));
+	map.erase(1);
+	std::cout << map.version() << ' ' << map.max_lag() << ' ';
+	let_go = 1;
+	reader.join();
+	std::cout << seen << ' ';
+
+	let_go = 0;
+	int size = 0;
+	std::thread copier([&]() {
+		stall_copy = true;
+		GateMap::replica r(map);
+		r.quiesce();
+		size = (int)r.size() * 10 + r.count(4);
+	});
+	while (stalled == 0) std::this_thread::yield();
+	map.assign(4, Gate(4));
+	std::cout << map.version() << ' ';
+	let_go = 1;
+	copier.join();
+	std::cout << size << std::endl;
+}
+
+/**
+ * the updater moves amounts between keys, keeping the values summing to
+ *   zero; every replica must only ever see a zero sum, and end up equal
+ *   to a fresh one.
+ */
+bool concurrent() {
+	SumMap map(4, 16);
+	const int readers = 3;
+	std::vector<int> ok(readers, 1);
+	std::vector<size_t> prints(readers, 0);
+	std::atomic<int> done(0);
+	std::vector<std::thread> threads;
+	for (int t = 0; t < readers; t++) {
+		threads.push_back(std::thread([&, t]() {
+			SumMap::replica r(map);
+			for (;;) {
+				bool last = done != 0;
+				r.quiesce();
+				long long sum = 0;
+				for (SumMap::map_type::const_iterator it = r.view().cbegin(); it != r.view().cend(); ++it) sum += it->second;
+				if (sum != 0) ok[t] = 0;
+				if (last) break;
+				std::this_thread::yield();
+			}
+			prints[t] = r.view().key_fingerprint();
+		}));
+	}
+	for (int i = 0; i < 3000; i++) {
+		int a = next_rand(200), b = next_rand(200);
+		long long d = next_rand(100);
+		map.modify([a, b, d](SumMap::map_type &m) {
+			m[a] -= d;
+			m[b] += d;
+		});
+		// keys from 1000 on hold 0, so they come and go without changing the sum
+		if (i % 5 == 0) map.assign(1000 + next_rand(50), 0);
+		if (i % 5 == 1) map.erase(1000 + next_rand(50));
+		if (i % 900 == 0) map.clear();
+	}
+	done = 1;
+	for (size_t t = 0; t < threads.size(); t++) threads[t].join();
+	SumMap::replica fresh(map);
+	bool all = fresh.size() > 0;
+	for (int t = 0; t < readers; t++) if (!ok[t] || prints[t] != fresh.view().key_fingerprint()) all = false;
+	return all;
+}
+
+int main() {
+	test_single();
+	test_overrun();
+	test_catch_up();
+	puts("Test: one updater, three replicas");
+	std::cout << concurrent() << std::endl;
+	return 0;
+}
@@ -0,0 +1,85 @@
+#include "combining_linked_hashmap.hpp"
+#include "storage.hpp"
+#include <iostream>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef sjtu::combining_linked_hashmap<int, std::string> StringMap;
+typedef sjtu::combining_linked_hashmap<int, long long> CountMap;
+typedef sjtu::combining_linked_hashmap<int, long long, std::hash<int>, std::equal_to<int>, sjtu::hopscotch_storage> HopCountMap;
+
+void test_single() {
+	puts("Test: requests from one thread");
+	StringMap map(2);
+	StringMap::handle h(map);
+	std::string v;
+	std::cout << h.find(1, v) << h.insert(StringMap::value_type(1, "one")) << h.insert(StringMap::value_type(1, "uno")) << ' ';
+	h.assign(2, "two");
+	h.assign(1, "eins");
+	std::cout << h.find(1, v) << v << ' ' << h.count(2) << h.count(3) << ' ' << h.erase(2) << h.erase(2) << ' ' << h.size() << std::endl;
+	try {
+		h.execute([](StringMap::map_type &m) { m.at(42); });
+	} catch (sjtu::index_out_of_bound &) {
+		puts("index_out_of_bound");
+	}
+	h.execute([](StringMap::map_type &m) { m[3] = m.at(1) + "!"; });
+	std::cout << h.find(3, v) << v << ' ' << map.batch_count() << ' ' << map.combined_count() << std::endl;
+
+	puts("Test: handle slots");
+	{
+		StringMap::handle h2(map);
+		try {
+			StringMap::handle h3(map);
+		} catch (sjtu::runtime_error &) {
+			puts("runtime_error");
+		}
+	}
+	StringMap::handle h3(map);
+	std::cout << map.max_threads() << ' ' << h3.size() << ' ' << map.underlying().at(3) << std::endl;
+}
+
+/**
+ * every thread keeps its own keys in the map and bumps a shared counter;
+ *   the map must end up with what each thread did and every bump.
+ */
+template<class Map>
+bool concurrent() {
+	const int threads = 4, rounds = 3000;
+	Map map(threads);
+	std::vector<int> ok(threads, 1);
+	std::vector<std::thread> workers;
+	for (int t = 0; t < threads; t++) {
+		workers.push_back(std::thread([&, t]() {
+			typename Map::handle h(map);
+			for (int i = 0; i < rounds; i++) {
+				int key = 1 + t * rounds + i / 3;
+				long long v;
+				if (i % 3 == 2) {
+					if (h.erase(key) != 1) ok[t] = 0;
+				} else if (i % 3 == 1) {
+					if (!h.find(key, v) || v != i - 1) ok[t] = 0;
+				} else {
+					h.assign(key, i);
+				}
+				// now and then hold the lock long enough for the others to queue up
+				h.execute([i](typename Map::map_type &m) {
+					m[0]++;
+					if (i % 20 == 0) std::this_thread::yield();
+				});
+			}
+		}));
+	}
+	for (size_t t = 0; t < workers.size(); t++) workers[t].join();
+	bool all = map.underlying().size() == 1 && map.underlying().at(0) == (long long)threads * rounds;
+	for (int t = 0; t < threads; t++) if (!ok[t]) all = false;
+	return all && map.combined_count() >= map.batch_count();
+}
+
+int main() {
+	test_single();
+	puts("Test: four threads");
+	std::cout << concurrent<CountMap>() << concurrent<HopCountMap>() << std::endl;
+	return 0;
+}
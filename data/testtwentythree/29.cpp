@@ -0,0 +1,140 @@
+#include "linked_hashmap.hpp"
+#include "storage.hpp"
+#include <iostream>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+typedef sjtu::linked_hashmap<int, std::string> ChainMap;
+typedef sjtu::linked_hashmap<int, std::string, std::hash<int>, std::equal_to<int>, sjtu::robin_hood_storage> RobinMap;
+typedef sjtu::linked_hashmap<int, std::string, std::hash<int>, std::equal_to<int>, sjtu::cuckoo_storage> CuckooMap;
+
+unsigned int state = 20261020;
+int next_rand(int mod) {
+	state = state * 1103515245u + 12345u;
+	return (state >> 8) % mod;
+}
+
+/**
+ * true if the elements lie at one fixed stride in insertion order.
+ */
+template<class Map>
+bool contiguous(const Map &map) {
+	const char *prev = nullptr;
+	long stride = 0;
+	for (typename Map::const_iterator it = map.cbegin(); it != map.cend(); ++it) {
+		const char *p = reinterpret_cast<const char*>(&it->second);
+		if (prev != nullptr) {
+			if (stride == 0) stride = p - prev;
+			if (p - prev != stride || stride <= 0) return false;
+		}
+		prev = p;
+	}
+	return true;
+}
+
+template<class Map>
+bool same(const Map &a, const Map &b) {
+	if (!a.equal_in_order(b)) return false;
+	for (typename Map::const_iterator it = a.cbegin(); it != a.cend(); ++it)
+		if (b.find(it->first) == b.cend() || b.at(it->first) != it->second) return false;
+	return true;
+}
+
+void test_whole() {
+	puts("Test: one pass lays elements out in insertion order");
+	ChainMap map;
+	for (int i = 0; i < 1000; i++) map[i] = std::to_string(i);
+	for (int i = 0; i < 1000; i += 3) map.erase(i);
+	for (int i = 2000; i > 1000; i -= 7) map[i] = "x" + std::to_string(i);
+	ChainMap copy(map);
+	std::cout << contiguous(map) << ' ';
+	std::cout << map.defragment() << contiguous(map) << same(map, copy) << ' ';
+	map.erase(500);
+	map[3000] = "tail";
+	std::cout << contiguous(map) << map.defragment() << contiguous(map) << ' ' << map.size() << ' ' << map.at(3000) << std::endl;
+	ChainMap empty;
+	std::cout << empty.defragment() << ' ';
+	map.clear();
+	std::cout << map.defragment() << map.size() << std::endl;
+}
+
+void test_keep() {
+	puts("Test: kept iterators follow their element");
+	ChainMap map;
+	for (int i = 0; i < 100; i++) map[i * 5] = std::to_string(i);
+	ChainMap::iterator keep[2] = {map.find(35), map.end()};
+	ChainMap::snapshot_view view = map.snapshot();
+	std::cout << map.defragment(10, keep, 2) << ' ' << keep[0]->first << ':' << keep[0]->second << ' ' << (keep[1] == map.end()) << ' ';
+	while (!map.defragment(10, keep, 1)) {}
+	std::cout << keep[0]->first << ':' << keep[0]->second << ' ' << map.erase(keep[0])->first << ' ' << view->size() << std::endl;
+	ChainMap other;
+	ChainMap::iterator wrong[1] = {other.end()};
+	try {
+		map.defragment(10, wrong, 1);
+	} catch (sjtu::invalid_iterator &) {
+		puts("invalid_iterator");
+	}
+}
+
+template<class Map>
+bool random_slices() {
+	bool ok = true;
+	Map map;
+	ChainMap ref;
+	for (int r = 0; r < 20000; r++) {
+		int op = next_rand(24), k = next_rand(3000);
+		std::string v = std::to_string(r);
+		if (op < 10) {
+			map[k] = v;
+			ref[k] = v;
+		} else if (op < 15) {
+			map.erase(k);
+			ref.erase(k);
+		} else if (op < 16) {
+			size_t n = next_rand(20);
+			map.pop_front(n);
+			ref.pop_front(n);
+		} else if (op < 17) {
+			map.retain([&](const typename Map::value_type &e) { return e.first % 13 != k % 13; });
+			ref.retain([&](const ChainMap::value_type &e) { return e.first % 13 != k % 13; });
+		} else if (op < 18) {
+			Map other;
+			for (int i = 0; i < 30; i++) {
+				int key = next_rand(3000);
+				other[key] = v;
+				if (ref.find(key) == ref.end()) ref[key] = v;
+			}
+			map.merge_from(std::move(other), sjtu::merge_keep());
+		} else if (op < 19) {
+			Map moved(std::move(map));
+			Map copy(moved);
+			map.merge_from(std::move(copy), sjtu::merge_keep());
+		} else if (op < 20) {
+			map.set_indexed(!map.indexed());
+		} else if (op < 21) {
+			// finish the pass in progress, then run a fresh one
+			map.defragment();
+			map.defragment();
+			if (!contiguous(map)) ok = false;
+		} else {
+			map.defragment(next_rand(300));
+		}
+		if (r % 500 == 0) {
+			if (map.size() != ref.size()) ok = false;
+			typename Map::const_iterator it = map.cbegin();
+			for (ChainMap::const_iterator jt = ref.cbegin(); jt != ref.cend() && ok; ++jt, ++it)
+				if (it == map.cend() || it->first != jt->first || it->second != jt->second || map.at(jt->first) != jt->second) ok = false;
+			if (map.indexed() && map.size() > 0 && map.nth(map.size() / 2)->first != ref.nth(ref.size() / 2)->first) ok = false;
+		}
+	}
+	return ok;
+}
+
+int main() {
+	test_whole();
+	test_keep();
+	puts("Test: time-sliced passes under churn");
+	std::cout << random_slices<ChainMap>() << random_slices<RobinMap>() << random_slices<CuckooMap>() << std::endl;
+	return 0;
+}
@@ -0,0 +1,81 @@
+#include "linked_hashmap.hpp"
+#include "storage.hpp"
+#include "aggregates.hpp"
+#include <iostream>
+#include <cstdio>
+#include <vector>
+
+typedef sjtu::linked_hashmap<int, long long> ChainMap;
+typedef sjtu::linked_hashmap<int, long long, std::hash<int>, std::equal_to<int>, sjtu::soa_storage> SoaMap;
+
+unsigned int state = 20261019;
+int next_rand(int mod) {
+	state = state * 1103515245u + 12345u;
+	return (state >> 8) % mod;
+}
+
+template<class Map>
+bool same_as_iteration(const Map &map) {
+	std::vector<int> keys;
+	map.for_each([&](const typename Map::value_type &v) { keys.push_back(v.first); });
+	if (keys.size() != map.size()) return false;
+	size_t i = 0;
+	for (typename Map::const_iterator it = map.cbegin(); it != map.cend(); ++it, ++i)
+		if (it->first != keys[i]) return false;
+	return true;
+}
+
+void test_small() {
+	puts("Test: for_each visits in insertion order");
+	ChainMap map;
+	map.for_each([](ChainMap::value_type &) { puts("never"); });
+	for (int i = 0; i < 40; i++) map[i * 3 % 41] = i;
+	map.erase(3);
+	map.erase(0);
+	map.pop_front(5);
+	map.for_each([](ChainMap::value_type &v) { v.second *= 2; });
+	const ChainMap &cmap = map;
+	cmap.for_each([](const ChainMap::value_type &v) { std::cout << v.first << ':' << v.second << ' '; });
+	std::cout << std::endl;
+	map.set_indexed(true);
+	map.erase(30);
+	long long sum = 0;
+	cmap.for_each([&](const ChainMap::value_type &v) { sum += v.second; });
+	std::cout << sum << ' ' << sjtu::sum_values(cmap) << std::endl;
+}
+
+template<class Map>
+bool random_walks() {
+	bool ok = true;
+	Map map;
+	for (int r = 0; r < 30000; r++) {
+		int op = next_rand(22), k = next_rand(2000);
+		if (op < 10) map[k] = r;
+		else if (op < 16) map.erase(k);
+		else if (op < 17) map.pop_front(next_rand(30));
+		else if (op < 18) map.retain([&](const typename Map::value_type &v) { return v.first % 11 != k % 11; });
+		else if (op < 19) {
+			Map other;
+			for (int i = 0; i < 50; i++) other[next_rand(2000)] = i;
+			map.merge_from(std::move(other), sjtu::merge_overwrite());
+		} else if (op < 20) map.set_indexed(!map.indexed());
+		else if (op < 21) map.defragment(next_rand(200));
+		else if (map.size() > 0) {
+			size_t a = next_rand(map.size()), b = next_rand(map.size());
+			map.erase(map.nth(a < b ? a : b), map.nth(a < b ? b : a));
+		}
+		if (r % 1000 == 0) {
+			if (!same_as_iteration(map)) ok = false;
+			Map copy(map);
+			if (!same_as_iteration(copy)) ok = false;
+		}
+	}
+	return ok && same_as_iteration(map);
+}
+
+int main() {
+	test_small();
+	puts("Test: random churn");
+	std::cout << random_walks<ChainMap>() << random_walks<SoaMap>() << std::endl;
+	return 0;
+}
@@ -4,13 +4,402 @@
 #ifndef SJTU_LINKEDHASHMAP_HPP
 #define SJTU_LINKEDHASHMAP_HPP
 
-// only for std::equal_to<T> and std::hash<T>
+// only for std::equal_to<T>, std::hash<T> and std::less<T>
 #include <functional>
 #include <cstddef>
 #include "utility.hpp"
 #include "exceptions.hpp"
 
 namespace sjtu {
+    /**
+     * policies for linked_hashmap::merge_from: on a key both maps hold,
+     * keep the value already there, or take the incoming one.
+     */
+struct merge_keep {};
+struct merge_overwrite {};
+
+    /**
+     * Buckets that grow long are searched through a tree ordered by hash
+     * code. Keys sharing a whole hash code are told apart by bucket_less
+     * when it is specialized for Key, and scanned otherwise:
+     *
+     *   template<> struct bucket_less<MyKey> {
+     *       bool operator()(const MyKey &a, const MyKey &b) const;
+     *   };
+     *
+     * The order must be a strict weak order in which keys that Equal
+     * considers equal are equivalent.
+     */
+template<class Key>
+struct bucket_less {};
+
+    /**
+     * A storage policy decides how linked_hashmap finds a node from its
+     * key; the nodes themselves, and the insertion order running through
+     * them, are the same whatever the policy. A policy provides
+     *
+     *   template<class Node> struct hook;
+     *     a base of every node, for whatever the policy keeps in nodes.
+     *   template<class Key, class Node, class Equal> class table;
+     *     the index over the nodes, with
+     *       init(capacity)      allocate it empty (capacity a power of 2)
+     *       destroy()           free it; the nodes are left alone
+     *       forget()            drop it unfreed, another table owns it
+     *       capacity()
+     *       find(key, hash_code, equal, probe)
+     *                           the node of key or nullptr; probe is set
+     *                           to how many other nodes were looked at
+     *       insert(node)        add a node whose key is absent
+     *       erase(node)
+     *       clear()
+     *       rebuild(first, last, capacity)
+     *                           reindex the nodes of an order list range
+     *       copy_shape(other)   after a copy of other's nodes is inserted
+     *       long_probe(node)    an insert of node probed PROBE_LIMIT or
+     *                           more nodes and reseeding did not help
+     *       bucket_count(), bucket_of(hash_code)
+     *                           the table seen as buckets, and the one a
+     *                           node goes to first (open addressing: its
+     *                           home slot; it may sit further on)
+     *       bucket_first(b), bucket_next(node, b)
+     *                           walk the nodes bucket b holds
+     *       default_load_factor(), max_load_factor_limit()
+     *
+     * Nodes keep their cached hash_code; tables never call the hasher.
+     */
+
+    /**
+     * chained_storage: an array of singly linked bucket chains. the
+     * default, and the only policy that copes with keys colliding on
+     * their whole hash code (by treeifying their bucket).
+     */
+struct chained_storage {
+	/**
+	 * bucket_link points at whichever pointer currently refers to this node
+	 * (the bucket slot or the previous node's next_in_bucket), so a node can
+	 * be unlinked from its chain without rehashing the key or scanning.
+	 */
+	template<class Node>
+	struct hook {
+		Node *next_in_bucket;
+		Node **bucket_link;
+		hook() : next_in_bucket(nullptr), bucket_link(nullptr) {}
+	};
+
+	template<class Key, class Node, class Equal>
+	class table {
+	public:
+		/**
+		 * a chain this long is all but impossible with a decent hash at our
+		 * load factor, so it is taken as a sign of deliberate collisions.
+		 * a treeified bucket turns back into a plain chain once it is down to
+		 * UNTREEIFY_LIMIT nodes.
+		 */
+		static const size_t PROBE_LIMIT = 8;
+		static const size_t UNTREEIFY_LIMIT = 6;
+
+	private:
+		Node **buckets;
+		size_t bucket_capacity;
+
+		/**
+		 * a treap over the nodes of one long bucket, ordered by hash code,
+		 * then bucket_less if there is one, then address. the bucket's chain
+		 * is kept as well; the tree only speeds up finding a key.
+		 * trees is allocated with the first such bucket and has a slot for
+		 * every bucket, nullptr for the ones that are plain chains.
+		 */
+		struct tree_node {
+			Node *node;
+			tree_node *left;
+			tree_node *right;
+			size_t prio;
+		};
+		struct bucket_tree {
+			tree_node *root;
+			size_t size;
+		};
+		bucket_tree **trees;
+
+		size_t get_bucket_index(size_t hash_code) const {
+			return hash_code % bucket_capacity;
+		}
+
+		void link_bucket(Node *node, size_t idx) {
+			Node *head = buckets[idx];
+			node->next_in_bucket = head;
+			node->bucket_link = &buckets[idx];
+			if (head) head->bucket_link = &node->next_in_bucket;
+			buckets[idx] = node;
+		}
+
+		template<class Less>
+		static auto compare_keys(const Less &less, const Key &a, const Key &b, int) -> decltype(less(a, b), int()) {
+			return less(a, b) ? -1 : less(b, a) ? 1 : 0;
+		}
+		template<class Less>
+		static int compare_keys(const Less &, const Key &, const Key &, long) { return 0; }
+
+		/**
+		 * where node stands relative to (hash_code, key) in tree order,
+		 *   leaving out the address.
+		 */
+		static int compare_node(const Node *node, size_t hash_code, const Key &key) {
+			if (node->hash_code != hash_code) return node->hash_code < hash_code ? -1 : 1;
+			return compare_keys(bucket_less<Key>(), node->data.first, key, 0);
+		}
+		static bool node_less(const Node *a, const Node *b) {
+			int c = compare_node(a, b->hash_code, b->data.first);
+			return c != 0 ? c < 0 : std::less<const Node*>()(a, b);
+		}
+
+		/**
+		 * search every node equivalent to (hash_code, key) for one equal to key.
+		 */
+		static Node *tree_find(const tree_node *t, size_t hash_code, const Key &key, const Equal &key_equal) {
+			while (t != nullptr) {
+				int c = compare_node(t->node, hash_code, key);
+				if (c < 0) {
+					t = t->right;
+				} else if (c > 0) {
+					t = t->left;
+				} else {
+					if (key_equal(t->node->data.first, key)) return t->node;
+					Node *found = tree_find(t->left, hash_code, key, key_equal);
+					if (found) return found;
+					t = t->right;
+				}
+			}
+			return nullptr;
+		}
+
+		static tree_node *tree_insert(tree_node *t, tree_node *x) {
+			if (t == nullptr) return x;
+			if (node_less(x->node, t->node)) {
+				t->left = tree_insert(t->left, x);
+				if (t->left->prio > t->prio) {
+					tree_node *l = t->left;
+					t->left = l->right;
+					l->right = t;
+					return l;
+				}
+			} else {
+				t->right = tree_insert(t->right, x);
+				if (t->right->prio > t->prio) {
+					tree_node *r = t->right;
+					t->right = r->left;
+					r->left = t;
+					return r;
+				}
+			}
+			return t;
+		}
+
+		/**
+		 * join two treaps, every node of a preceding every node of b.
+		 */
+		static tree_node *tree_merge(tree_node *a, tree_node *b) {
+			if (a == nullptr) return b;
+			if (b == nullptr) return a;
+			if (a->prio > b->prio) {
+				a->right = tree_merge(a->right, b);
+				return a;
+			}
+			b->left = tree_merge(a, b->left);
+			return b;
+		}
+
+		static tree_node *tree_erase(tree_node *t, const Node *node) {
+			if (t == nullptr) return nullptr;
+			if (t->node == node) {
+				tree_node *joined = tree_merge(t->left, t->right);
+				delete t;
+				return joined;
+			}
+			if (node_less(node, t->node)) t->left = tree_erase(t->left, node);
+			else t->right = tree_erase(t->right, node);
+			return t;
+		}
+
+		static void tree_free(tree_node *t) {
+			while (t != nullptr) {
+				tree_free(t->left);
+				tree_node *right = t->right;
+				delete t;
+				t = right;
+			}
+		}
+
+		/**
+		 * priorities come from the node's address, so no random state is kept.
+		 */
+		static tree_node *new_tree_node(Node *node) {
+			size_t x = (size_t)node;
+			x = (x ^ (x >> 31)) * 0x9e3779b97f4a7c15ULL;
+			tree_node *t = new tree_node;
+			t->node = node;
+			t->left = t->right = nullptr;
+			t->prio = x ^ (x >> 29);
+			return t;
+		}
+
+		void untreeify(size_t idx) {
+			tree_free(trees[idx]->root);
+			delete trees[idx];
+			trees[idx] = nullptr;
+		}
+
+		void free_trees() {
+			if (trees == nullptr) return;
+			for (size_t i = 0; i < bucket_capacity; i++)
+				if (trees[i]) untreeify(i);
+			delete[] trees;
+			trees = nullptr;
+		}
+
+		/**
+		 * build a tree over bucket idx. running out of memory just leaves the
+		 *   bucket a chain, which is slower but still correct.
+		 */
+		void treeify(size_t idx) {
+			bucket_tree *tree = nullptr;
+			try {
+				if (trees == nullptr) {
+					trees = new bucket_tree*[bucket_capacity];
+					for (size_t i = 0; i < bucket_capacity; i++) trees[i] = nullptr;
+				}
+				tree = new bucket_tree;
+				tree->root = nullptr;
+				tree->size = 0;
+				for (Node *p = buckets[idx]; p != nullptr; p = p->next_in_bucket) {
+					tree->root = tree_insert(tree->root, new_tree_node(p));
+					tree->size++;
+				}
+			} catch (...) {
+				if (tree) {
+					tree_free(tree->root);
+					delete tree;
+				}
+				return;
+			}
+			trees[idx] = tree;
+		}
+
+		void tree_remove(Node *node) {
+			size_t idx = get_bucket_index(node->hash_code);
+			bucket_tree *tree = trees[idx];
+			if (tree == nullptr) return;
+			tree->root = tree_erase(tree->root, node);
+			if (--tree->size <= UNTREEIFY_LIMIT) untreeify(idx);
+		}
+
+		void treeify_long_chains() {
+			for (size_t i = 0; i < bucket_capacity; i++) {
+				size_t length = 0;
+				for (Node *p = buckets[i]; p != nullptr && length < PROBE_LIMIT; p = p->next_in_bucket) length++;
+				if (length >= PROBE_LIMIT) treeify(i);
+			}
+		}
+
+	public:
+		table() : buckets(nullptr), bucket_capacity(0), trees(nullptr) {}
+
+		static double default_load_factor() { return 0.75; }
+		static double max_load_factor_limit() { return 64; }
+
+		void init(size_t capacity) {
+			buckets = new Node*[capacity];
+			bucket_capacity = capacity;
+			for (size_t i = 0; i < capacity; i++) buckets[i] = nullptr;
+		}
+		void destroy() {
+			free_trees();
+			delete[] buckets;
+			forget();
+		}
+		void forget() {
+			buckets = nullptr;
+			trees = nullptr;
+			bucket_capacity = 0;
+		}
+		size_t capacity() const { return bucket_capacity; }
+
+		size_t bucket_count() const { return bucket_capacity; }
+		size_t bucket_of(size_t hash_code) const { return get_bucket_index(hash_code); }
+		Node *bucket_first(size_t b) const { return buckets[b]; }
+		Node *bucket_next(const Node *node, size_t) const { return node->next_in_bucket; }
+
+		Node *find(const Key &key, size_t hash_code, const Equal &key_equal, size_t &probe) const {
+			size_t idx = get_bucket_index(hash_code);
+			probe = 0;
+			if (trees && trees[idx]) return tree_find(trees[idx]->root, hash_code, key, key_equal);
+			Node *p = buckets[idx];
+			while (p != nullptr && !key_equal(p->data.first, key)) {
+				p = p->next_in_bucket;
+				probe++;
+			}
+			return p;
+		}
+
+		void insert(Node *node) {
+			size_t idx = get_bucket_index(node->hash_code);
+			link_bucket(node, idx);
+			if (trees && trees[idx]) {
+				bucket_tree *tree = trees[idx];
+				try {
+					tree->root = tree_insert(tree->root, new_tree_node(node));
+					tree->size++;
+				} catch (...) {
+					untreeify(idx);
+				}
+			}
+		}
+
+		void erase(Node *node) {
+			*node->bucket_link = node->next_in_bucket;
+			if (node->next_in_bucket) node->next_in_bucket->bucket_link = node->bucket_link;
+			if (trees) tree_remove(node);
+		}
+
+		void clear() {
+			free_trees();
+			for (size_t i = 0; i < bucket_capacity; i++) buckets[i] = nullptr;
+		}
+
+		/**
+		 * trees are rebuilt for the chains that are still long, if there were
+		 *   any before; without trees every chain was short, and neither
+		 *   splitting buckets nor dropping nodes makes one longer.
+		 */
+		template<class Link>
+		void rebuild(Link *first, Link *last, size_t capacity) {
+			bool had_trees = trees != nullptr;
+			if (capacity != bucket_capacity) {
+				Node **new_buckets = new Node*[capacity];
+				free_trees();
+				delete[] buckets;
+				buckets = new_buckets;
+				bucket_capacity = capacity;
+			}
+			free_trees();
+			for (size_t i = 0; i < bucket_capacity; i++) buckets[i] = nullptr;
+			for (Link *p = first; p != last; p = p->order_next) {
+				Node *node = static_cast<Node*>(p);
+				link_bucket(node, get_bucket_index(node->hash_code));
+			}
+			if (had_trees) treeify_long_chains();
+		}
+
+		void copy_shape(const table &other) {
+			if (other.trees) treeify_long_chains();
+		}
+
+		void long_probe(Node *node) {
+			treeify(get_bucket_index(node->hash_code));
+		}
+	};
+};
+
     /**
      * In linked_hashmap, iteration ordering is differ from map,
      * which is the order in which keys were inserted into the map.
@@ -19,13 +408,22 @@ namespace sjtu {
      *
      * Note that insertion order is not affected if a key is re-inserted
      * into the map.
+     *
+     * When keys may come from an adversary, use sjtu::seeded_hash<Key>
+     * (from seeded_hash.hpp) as Hash: its seed differs per map, and a
+     * map noticing a suspicious chain draws a new one (see defend_chain).
+     *
+     * Storage chooses how keys are looked up: bucket chains by default
+     * (chained_storage), or one of the open-addressed tables of
+     * storage.hpp.
      */
     
 template<
 	class Key,
 	class T,
 	class Hash = std::hash<Key>, 
-	class Equal = std::equal_to<Key>
+	class Equal = std::equal_to<Key>,
+	class Storage = chained_storage
 > class linked_hashmap {
 public:
 	/**
@@ -33,60 +431,1554 @@ public:
 	 * it should have a default constructor, a copy constructor.
 	 * You can use sjtu::linked_hashmap as value_type by typedef.
 	 */
-	typedef pair<const Key, T> value_type;
+	typedef pair<const Key, T> value_type;
+
+private:
+	struct LinkNode {
+		LinkNode *order_prev;
+		LinkNode *order_next;
+		LinkNode() : order_prev(nullptr), order_next(nullptr) {}
+	};
+	/**
+	 * select the Node constructors below: in_place_tag takes what a
+	 *   value_type constructor would, key_args_tag a key and the
+	 *   arguments of a T constructor.
+	 */
+	struct in_place_tag {};
+	struct key_args_tag {};
+	/**
+	 * references to constructor arguments, kept until build() hands
+	 *   them on to a U constructor.
+	 */
+	template<class... Args>
+	struct arg_pack {
+		template<class U, class... Done>
+		U build(Done &&... done) const { return U(std::forward<Done>(done)...); }
+		// U(x) alone would be a cast, not a constructor call
+		template<class U, class Done>
+		U build(Done &&done) const { return static_cast<U>(std::forward<Done>(done)); }
+	};
+	template<class A, class... Rest>
+	struct arg_pack<A, Rest...> {
+		A &&head;
+		arg_pack<Rest...> rest;
+		arg_pack(A &&a, Rest &&... r) : head(std::forward<A>(a)), rest(std::forward<Rest>(r)...) {}
+		template<class U, class... Done>
+		U build(Done &&... done) const { return rest.template build<U>(std::forward<Done>(done)..., std::forward<A>(head)); }
+	};
+	/**
+	 * stands in for first or second in pair's two-argument constructor:
+	 *   the member is initialized from the U that operator U() returns,
+	 *   so U's constructor runs on args right in the member's storage.
+	 */
+	template<class U, class... Args>
+	struct builder {
+		arg_pack<Args...> args;
+		explicit builder(Args &&... a) : args(std::forward<Args>(a)...) {}
+		operator U() const { return args.template build<U>(); }
+	};
+	/**
+	 * a builder for U from the elements of tuple.
+	 */
+	template<class U, class Tuple, size_t... I>
+	static auto unpack(Tuple &tuple, std::index_sequence<I...>) {
+		// found by argument-dependent lookup for the tuple type
+		using std::get;
+		return builder<U, decltype(get<I>(std::move(tuple)))...>(get<I>(std::move(tuple))...);
+	}
+	/**
+	 * the hook holds whatever the storage policy keeps in each node.
+	 * hash_code caches hasher(data.first) so the table can be rebuilt
+	 * without calling the hasher again.
+	 * seq is the insertion sequence number stamped by insert.
+	 * data is always built by a pair constructor; the ones that take
+	 * separate arguments for first and second pass builders to it.
+	 */
+	struct Node : LinkNode, Storage::template hook<Node> {
+		value_type data;
+		size_t hash_code;
+		unsigned long long seq;
+		/**
+		 * data copied or moved from a value_type.
+		 */
+		template<class V>
+		Node(in_place_tag, size_t h, V &&value)
+			: LinkNode(), data(std::forward<V>(value)), hash_code(h), seq(0) {}
+		/**
+		 * first constructed from key, second from value.
+		 */
+		template<class K, class V>
+		Node(in_place_tag, size_t h, K &&key, V &&value)
+			: Node(key_args_tag(), h, std::forward<K>(key), std::forward<V>(value)) {}
+		/**
+		 * first constructed from the elements of key_args, second from
+		 *   those of value_args (see std::forward_as_tuple).
+		 */
+		template<template<class...> class Tuple, class... A, class... B>
+		Node(in_place_tag, size_t h, std::piecewise_construct_t, Tuple<A...> key_args, Tuple<B...> value_args)
+			: LinkNode(),
+			  data(unpack<Key>(key_args, std::index_sequence_for<A...>()), unpack<T>(value_args, std::index_sequence_for<B...>())),
+			  hash_code(h), seq(0) {}
+		/**
+		 * first constructed from key, second from args.
+		 */
+		template<class K, class... Args>
+		Node(key_args_tag, size_t h, K &&key, Args &&... args)
+			: LinkNode(),
+			  data(builder<Key, K>(std::forward<K>(key)), builder<T, Args...>(std::forward<Args>(args)...)),
+			  hash_code(h), seq(0) {}
+		/**
+		 * the placement form builds a node in a slab (see defragment);
+		 *   declaring it here hides the global forms, so the usual ones
+		 *   are passed through as well.
+		 */
+		static void *operator new(size_t size) { return ::operator new(size); }
+		static void *operator new(size_t, void *where) noexcept { return where; }
+		static void operator delete(void *ptr) noexcept { ::operator delete(ptr); }
+		static void operator delete(void *, void *) noexcept {}
+	};
+	typedef typename Storage::template table<Key, Node, Equal> table_type;
+
+	static const size_t INIT_CAPACITY = 16;
+	// true for a hasher without state (see hash_of)
+	static const bool STATELESS_HASH = __is_empty(Hash);
+	/**
+	 * for_each() prefetches LOOKAHEAD slots ahead in indexed mode, and
+	 * otherwise follows CHAINS chunks of SKIP nodes at once (see
+	 * walk_prefetched).
+	 */
+	static const size_t LOOKAHEAD = 16;
+	static const size_t SKIP = 16;
+	static const size_t CHAINS = 16;
+	/**
+	 * snapshot() flattens a map layered this deep instead of adding
+	 * another layer (see flatten).
+	 */
+	static const size_t MAX_LAYERS = 8;
+
+	table_type table;
+	LinkNode *order_head;
+	LinkNode *order_tail;
+	size_t num_elements;
+	/**
+	 * the sum of key_mix(hash_code) over all nodes (see key_fingerprint()).
+	 */
+	size_t key_sum;
+	unsigned long long seq_counter;
+	Hash hasher;
+	Equal key_equal;
+	/**
+	 * the size at the last reseed (see defend_chain).
+	 */
+	size_t reseed_mark;
+	/**
+	 * the table grows once size() would exceed capacity * max_load.
+	 */
+	double max_load;
+
+	/**
+	 * order index, only kept in indexed mode (see set_indexed).
+	 * order_slots holds the nodes in insertion order, with nullptr left
+	 * behind by erased ones; slot_seqs keeps their sequence numbers, holes
+	 * included, so the slots can be binary searched by seq; order_fenwick
+	 * is a Fenwick tree counting the live slots, so rank and select are
+	 * both O(log n). Nodes do not store their slot: slot_seqs is sorted,
+	 * so it is found from the node's seq (see seq_slot). The slots are
+	 * renumbered densely whenever they run out.
+	 */
+	bool index_enabled;
+	Node **order_slots;
+	unsigned long long *slot_seqs;
+	size_t *order_fenwick;
+	size_t slot_used;
+	size_t slot_capacity;
+
+	/**
+	 * the skip entries for_each() starts its prefetch chains from. the
+	 * order list is cut into chunks, the nodes whose seq / SKIP agree,
+	 * and each chunk has an entry holding its first node; entries are
+	 * sorted by chunk. an entry whose chunk lost all its nodes is left
+	 * with nullptr until the holes are swept out.
+	 */
+	struct skip_entry {
+		unsigned long long chunk;
+		LinkNode *first;
+	};
+	skip_entry *skips;
+	size_t skip_used;
+	size_t skip_capacity;
+	size_t skip_holes;
+
+	/**
+	 * a map frozen by snapshot(): the snapshots taken of it and the map
+	 * layered on it (see base) each hold a reference, and the last one
+	 * out destroys it.
+	 */
+	struct share_block {
+		linked_hashmap *frozen;
+		long refs;
+	};
+	/**
+	 * layers. snapshot() freezes the map as it is into base->frozen, and
+	 * carries on with empty structures on top of it: the elements base
+	 * holds stay where they are, shared with the snapshot, and only new
+	 * elements go into our own table and order list (the own layer).
+	 * the map's order is base's order, then ours; base_live counts the
+	 * elements of base that are still ours, and depth the layers below.
+	 * base itself may be layered on an older frozen map.
+	 * an own node has a seq above base's seq_counter (see owns()).
+	 */
+	share_block *base;
+	size_t base_live;
+	size_t depth;
+	/**
+	 * the shadow table maps a node to where its element lives for us,
+	 * for the nodes whose element moved: an element of a layer below
+	 * that was written is copied into a node of its own (see writable()),
+	 * and one that was erased maps to nullptr. the node a shadow entry is
+	 * for stays the element's identity, held by iterators and tables.
+	 * open addressing on the node's address, half full at most; a free
+	 * slot has from == nullptr.
+	 */
+	struct shadow_entry {
+		const LinkNode *from;
+		Node *to;
+	};
+	shadow_entry *shadows;
+	size_t shadow_used;
+	size_t shadow_capacity;
+	/**
+	 * the seqs of the elements of the layers below that we erased, in a
+	 * treap stored in an array (children are indices, nil is NIL), so
+	 * nth() and position_of() can step over them (see below_nth).
+	 * freed nodes are chained through left from rank_spare.
+	 */
+	struct rank_node {
+		unsigned long long seq;
+		size_t left, right, size;
+	};
+	static const size_t NIL = size_t(-1);
+	rank_node *ranks;
+	size_t rank_root;
+	size_t rank_spare;
+	size_t rank_used;
+	size_t rank_capacity;
+	/**
+	 * bumped whenever flatten() or settle() moves the map onto new
+	 * structures; iterators remember it, so that one still pointing into
+	 * the old ones is caught instead of read or written through.
+	 */
+	size_t epoch;
+
+	/**
+	 * a block of memory defragment() moves nodes into, in insertion
+	 * order. nodes in a slab are destroyed in place (see free_node), and
+	 * their memory only comes back with the whole slab. raw is what was
+	 * allocated, cells the first address in it aligned for a Node.
+	 */
+	struct node_slab {
+		unsigned char *raw;
+		unsigned char *cells;
+		size_t capacity;
+		size_t used;
+		bool holds(const Node *node) const {
+			const unsigned char *p = reinterpret_cast<const unsigned char*>(node);
+			std::less<const unsigned char*> less;
+			return cells != nullptr && !less(p, cells) && less(p, cells + capacity * sizeof(Node));
+		}
+	};
+	/**
+	 * slab is what the last finished defragment() pass filled; filling
+	 * is the slab of the pass in progress, if any, and defrag_next the
+	 * next node that pass will move (nullptr when there is no pass).
+	 */
+	node_slab slab, filling;
+	LinkNode *defrag_next;
+
+	/**
+	 * the sentinels of every map a move left without storage (see the
+	 *   move constructor): an empty order list, shared and never written.
+	 *   such a map has a table of capacity 0.
+	 */
+	struct vacant_list {
+		LinkNode head, tail;
+		vacant_list() {
+			head.order_next = &tail;
+			tail.order_prev = &head;
+		}
+	};
+	static vacant_list &vacant_ends() {
+		static vacant_list ends;
+		return ends;
+	}
+
+	void init_empty() {
+		order_head = new LinkNode();
+		order_tail = new LinkNode();
+		order_head->order_next = order_tail;
+		order_tail->order_prev = order_head;
+		index_enabled = false;
+		order_slots = nullptr;
+		slot_seqs = nullptr;
+		order_fenwick = nullptr;
+		slot_used = slot_capacity = 0;
+		skips = nullptr;
+		skip_used = skip_capacity = skip_holes = 0;
+		slab = filling = node_slab{nullptr, nullptr, 0, 0};
+		defrag_next = nullptr;
+	}
+
+	static size_t lowbit(size_t x) { return x & (~x + 1); }
+
+	/**
+	 * copy other's elements, keeping their hash codes and sequence
+	 *   numbers, into a table of the same capacity; nothing is rehashed.
+	 *   the copy is flat: a layered other (see base) is copied as it
+	 *   looks, into a table sized to fit.
+	 * each keep[i] pointing into other is redirected to its copy.
+	 */
+	linked_hashmap(const linked_hashmap &other, LinkNode **keep, size_t keep_count)
+		: num_elements(0), key_sum(other.key_sum), seq_counter(other.seq_counter), hasher(other.hasher), key_equal(other.key_equal),
+		  reseed_mark(other.reseed_mark), max_load(other.max_load), base(nullptr), base_live(0), depth(0),
+		  shadows(nullptr), shadow_used(0), shadow_capacity(0),
+		  ranks(nullptr), rank_root(NIL), rank_spare(NIL), rank_used(0), rank_capacity(0), epoch(0) {
+		size_t capacity = other.table.capacity() != 0 ? other.table.capacity() : INIT_CAPACITY;
+		while (other.size() > capacity * max_load) capacity *= 2;
+		table.init(capacity);
+		try {
+			init_empty();
+		} catch (...) {
+			table.destroy();
+			throw;
+		}
+		try {
+			for (const LinkNode *p = other.view_first(); p != other.order_tail; p = other.view_next(p)) {
+				const Node *src = other.current(p);
+				Node *node = new Node(in_place_tag(), src->hash_code, src->data);
+				node->seq = src->seq;
+				table.insert(node);
+				link_last(node);
+				num_elements++;
+				for (size_t i = 0; i < keep_count; i++)
+					if (keep[i] == p) keep[i] = node;
+			}
+			if (other.base == nullptr) table.copy_shape(other.table);
+			if (other.index_enabled) set_indexed(true);
+		} catch (...) {
+			free_storage();
+			throw;
+		}
+		for (size_t i = 0; i < keep_count; i++) {
+			if (keep[i] == other.order_head) keep[i] = order_head;
+			else if (keep[i] == other.order_tail) keep[i] = order_tail;
+		}
+	}
+
+	void free_storage() {
+		shadow_free();
+		rank_free();
+		if (order_head == nullptr || table.capacity() == 0) return;
+		LinkNode *cur = order_head->order_next;
+		while (cur != order_tail) {
+			LinkNode *next = cur->order_next;
+			free_node(static_cast<Node*>(cur));
+			cur = next;
+		}
+		table.destroy();
+		delete order_head;
+		delete order_tail;
+		index_free();
+		delete[] skips;
+		free_slabs();
+		order_head = order_tail = nullptr;
+	}
+
+	void free_node(Node *node) {
+		if (slab.holds(node) || filling.holds(node)) node->~Node();
+		else delete node;
+	}
+
+	/**
+	 * release both slabs and drop any pass in progress; no node may be
+	 * left in them.
+	 */
+	void free_slabs() {
+		delete[] slab.raw;
+		delete[] filling.raw;
+		slab = filling = node_slab{nullptr, nullptr, 0, 0};
+		defrag_next = nullptr;
+	}
+
+	struct layer_tag {};
+
+	/**
+	 * an empty map with other's hasher, load factor and indexed mode,
+	 *   for snapshot() to move other's elements into.
+	 */
+	linked_hashmap(const linked_hashmap &other, layer_tag)
+		: num_elements(0), key_sum(0), seq_counter(0), hasher(other.hasher), key_equal(other.key_equal),
+		  reseed_mark(0), max_load(other.max_load), base(nullptr), base_live(0), depth(0),
+		  shadows(nullptr), shadow_used(0), shadow_capacity(0),
+		  ranks(nullptr), rank_root(NIL), rank_spare(NIL), rank_used(0), rank_capacity(0), epoch(0) {
+		table.init(INIT_CAPACITY);
+		try {
+			init_empty();
+		} catch (...) {
+			table.destroy();
+			throw;
+		}
+		try {
+			if (other.index_enabled) set_indexed(true);
+		} catch (...) {
+			free_storage();
+			throw;
+		}
+	}
+
+	void swap_state(linked_hashmap &other) {
+		std::swap(table, other.table);
+		std::swap(order_head, other.order_head);
+		std::swap(order_tail, other.order_tail);
+		std::swap(num_elements, other.num_elements);
+		std::swap(key_sum, other.key_sum);
+		std::swap(seq_counter, other.seq_counter);
+		std::swap(hasher, other.hasher);
+		std::swap(key_equal, other.key_equal);
+		std::swap(reseed_mark, other.reseed_mark);
+		std::swap(max_load, other.max_load);
+		std::swap(index_enabled, other.index_enabled);
+		std::swap(order_slots, other.order_slots);
+		std::swap(slot_seqs, other.slot_seqs);
+		std::swap(order_fenwick, other.order_fenwick);
+		std::swap(slot_used, other.slot_used);
+		std::swap(slot_capacity, other.slot_capacity);
+		std::swap(skips, other.skips);
+		std::swap(skip_used, other.skip_used);
+		std::swap(skip_capacity, other.skip_capacity);
+		std::swap(skip_holes, other.skip_holes);
+		std::swap(base, other.base);
+		std::swap(base_live, other.base_live);
+		std::swap(depth, other.depth);
+		std::swap(shadows, other.shadows);
+		std::swap(shadow_used, other.shadow_used);
+		std::swap(shadow_capacity, other.shadow_capacity);
+		std::swap(ranks, other.ranks);
+		std::swap(rank_root, other.rank_root);
+		std::swap(rank_spare, other.rank_spare);
+		std::swap(rank_used, other.rank_used);
+		std::swap(rank_capacity, other.rank_capacity);
+		std::swap(slab, other.slab);
+		std::swap(filling, other.filling);
+		std::swap(defrag_next, other.defrag_next);
+	}
+
+	/**
+	 * exchange the sentinels of two maps, each keeping its own nodes in
+	 *   order between the ones it gets.
+	 */
+	void swap_ends(linked_hashmap &other) {
+		LinkNode *first = order_head->order_next, *last = order_tail->order_prev;
+		LinkNode *other_first = other.order_head->order_next, *other_last = other.order_tail->order_prev;
+		if (first == order_tail) first = nullptr;
+		if (other_first == other.order_tail) other_first = nullptr;
+		bool done = defrag_next == order_tail, other_done = other.defrag_next == other.order_tail;
+		std::swap(order_head, other.order_head);
+		std::swap(order_tail, other.order_tail);
+		relink_ends(first, last);
+		other.relink_ends(other_first, other_last);
+		if (done) defrag_next = order_tail;
+		if (other_done) other.defrag_next = other.order_tail;
+	}
+	void relink_ends(LinkNode *first, LinkNode *last) {
+		if (first == nullptr) {
+			order_head->order_next = order_tail;
+			order_tail->order_prev = order_head;
+			return;
+		}
+		order_head->order_next = first;
+		first->order_prev = order_head;
+		order_tail->order_prev = last;
+		last->order_next = order_tail;
+	}
+
+	/**
+	 * drop one reference to a share block; the last one out frees the
+	 *   frozen map and with it the structures it owns.
+	 * the count is touched atomically because snapshots are meant to be
+	 *   handed to, and released by, other threads.
+	 */
+	static void release(share_block *block) {
+		if (__atomic_sub_fetch(&block->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+			delete block->frozen;
+			delete block;
+		}
+	}
+
+	/**
+	 * called before every modification of the structures: fold the
+	 *   layers below that no snapshot reads any more into our own (see
+	 *   fold), and give a map a move left without storage its own; keep[]
+	 *   is redirected from the shared sentinels.
+	 */
+	void detach(LinkNode **keep = nullptr, size_t keep_count = 0) {
+		while (base != nullptr && __atomic_load_n(&base->refs, __ATOMIC_ACQUIRE) == 1) fold();
+		if (table.capacity() == 0) settle(keep, keep_count);
+	}
+
+	/**
+	 * merge the frozen map below, which nobody but us references any
+	 *   more, with our own layer: its structures become ours, with our
+	 *   nodes appended, and our shadow entries are applied to it; what
+	 *   we erased is erased there, and copies stay where they are. no
+	 *   node moves, so iterators and references stay valid.
+	 * O(our layer and shadow table), plus a rehash of the table below if
+	 *   our elements do not fit in it. what may throw comes first, and
+	 *   leaves the map as it was.
+	 */
+	void fold() {
+		share_block *block = base;
+		linked_hashmap &lower = *block->frozen;
+		size_t capacity = lower.table.capacity();
+		while (lower.num_elements + num_elements > capacity * max_load) capacity *= 2;
+		if (capacity != lower.table.capacity()) lower.table.rebuild(lower.order_head->order_next, lower.order_tail, capacity);
+		if (index_enabled && !lower.index_enabled) {
+			size_t slots = INIT_CAPACITY;
+			while (slots < (lower.num_elements + num_elements) * 2) slots *= 2;
+			lower.index_rebuild(slots);
+			lower.index_enabled = true;
+		}
+		if (index_enabled) lower.index_reserve(num_elements);
+		lower.skip_reserve(skip_used + 1);
+		lower.shadow_reserve(shadow_used);
+		lower.rank_reserve(shadow_used);
+		LinkNode *first = order_head->order_next, *p = first;
+		try {
+			for (; p != order_tail; p = p->order_next) lower.table.insert(static_cast<Node*>(p));
+		} catch (...) {
+			for (LinkNode *q = first; q != p; q = q->order_next) lower.table.erase(static_cast<Node*>(q));
+			throw;
+		}
+
+		for (size_t i = 0; i < shadow_capacity; i++) {
+			const LinkNode *from = shadows[i].from;
+			Node *to = shadows[i].to;
+			if (from == nullptr) continue;
+			if (static_cast<const Node*>(from)->seq > lower.seq_counter) lower.shadow_add(from, to);
+			else if (to != nullptr) lower.shadow_set(from, to);
+			else if (lower.owns(from)) lower.erase_node(static_cast<Node*>(const_cast<LinkNode*>(from)));
+			else lower.mark_erased(from);
+		}
+		delete[] shadows;
+		shadows = nullptr;
+		shadow_used = shadow_capacity = 0;
+
+		if (first != order_tail && skip_used > 0 && lower.order_tail->order_prev != lower.order_head
+			&& chunk_of(lower.order_tail->order_prev) == chunk_of(first)) {
+			// first no longer starts its chunk
+			skip_entry *entry = skip_find(first);
+			if (entry != nullptr) {
+				entry->first = nullptr;
+				skip_holes++;
+			}
+		}
+		for (size_t i = 0; i < skip_used; i++) lower.skips[lower.skip_used++] = skips[i];
+		lower.skip_holes += skip_holes;
+		if (index_enabled)
+			for (LinkNode *q = first; q != order_tail; q = q->order_next) lower.index_append(static_cast<Node*>(q));
+		else
+			lower.index_free();
+		if (lower.defrag_next == lower.order_tail) lower.defrag_next = first;
+		LinkNode *lower_first = lower.order_head->order_next;
+		if (lower_first != lower.order_tail) {
+			LinkNode *lower_last = lower.order_tail->order_prev;
+			order_head->order_next = lower_first;
+			lower_first->order_prev = order_head;
+			lower_last->order_next = first;
+			first->order_prev = lower_last;
+		}
+
+		table.destroy();
+		table = lower.table;
+		lower.table.forget();
+		index_free();
+		order_slots = lower.order_slots;
+		slot_seqs = lower.slot_seqs;
+		order_fenwick = lower.order_fenwick;
+		slot_used = lower.slot_used;
+		slot_capacity = lower.slot_capacity;
+		lower.order_slots = nullptr;
+		lower.slot_seqs = nullptr;
+		lower.order_fenwick = nullptr;
+		delete[] skips;
+		skips = lower.skips;
+		skip_used = lower.skip_used;
+		skip_capacity = lower.skip_capacity;
+		skip_holes = lower.skip_holes;
+		lower.skips = nullptr;
+		shadows = lower.shadows;
+		shadow_used = lower.shadow_used;
+		shadow_capacity = lower.shadow_capacity;
+		lower.shadows = nullptr;
+		lower.shadow_used = lower.shadow_capacity = 0;
+		rank_free();
+		ranks = lower.ranks;
+		rank_root = lower.rank_root;
+		rank_spare = lower.rank_spare;
+		rank_used = lower.rank_used;
+		rank_capacity = lower.rank_capacity;
+		lower.ranks = nullptr;
+		slab = lower.slab;
+		filling = lower.filling;
+		defrag_next = lower.defrag_next;
+		lower.slab = lower.filling = node_slab{nullptr, nullptr, 0, 0};
+		num_elements += lower.num_elements;
+		base = lower.base;
+		base_live = lower.base_live;
+		depth = lower.depth;
+		lower.base = nullptr;
+		delete lower.order_head;
+		delete lower.order_tail;
+		lower.order_head = lower.order_tail = nullptr;
+		delete &lower;
+		delete block;
+	}
+
+	/**
+	 * copy the map as it looks into flat structures of its own and let
+	 *   go of the layers below; O(n), and every iterator but keep[] goes
+	 *   stale.
+	 */
+	void flatten(LinkNode **keep = nullptr, size_t keep_count = 0) {
+		linked_hashmap fresh(*this, keep, keep_count);
+		swap_state(fresh);
+		epoch++;
+	}
+
+	/**
+	 * give a map a move left without storage a table and sentinels of
+	 *   its own; keep[] pointing at the shared sentinels is redirected.
+	 */
+	void settle(LinkNode **keep, size_t keep_count) {
+		LinkNode *head = order_head, *tail = order_tail;
+		table.init(INIT_CAPACITY);
+		try {
+			init_empty();
+		} catch (...) {
+			table.destroy();
+			order_head = head;
+			order_tail = tail;
+			throw;
+		}
+		for (size_t i = 0; i < keep_count; i++) {
+			if (keep[i] == head) keep[i] = order_head;
+			else if (keep[i] == tail) keep[i] = order_tail;
+		}
+		epoch++;
+	}
+
+	static size_t shadow_home(const LinkNode *node, size_t mask) { return key_mix(reinterpret_cast<size_t>(node)) & mask; }
+
+	shadow_entry *shadow_find(const LinkNode *node) const {
+		if (shadow_used == 0) return nullptr;
+		size_t mask = shadow_capacity - 1;
+		for (size_t i = shadow_home(node, mask);; i = (i + 1) & mask) {
+			if (shadows[i].from == node) return shadows + i;
+			if (shadows[i].from == nullptr) return nullptr;
+		}
+	}
+
+	/**
+	 * make room for extra more shadow entries.
+	 */
+	void shadow_reserve(size_t extra) {
+		if ((shadow_used + extra) * 2 <= shadow_capacity) return;
+		size_t capacity = shadow_capacity == 0 ? INIT_CAPACITY : shadow_capacity;
+		while ((shadow_used + extra) * 2 > capacity) capacity *= 2;
+		shadow_entry *grown = new shadow_entry[capacity];
+		for (size_t i = 0; i < capacity; i++) grown[i].from = nullptr;
+		shadow_entry *old = shadows;
+		size_t old_capacity = shadow_capacity;
+		shadows = grown;
+		shadow_capacity = capacity;
+		shadow_used = 0;
+		for (size_t i = 0; i < old_capacity; i++)
+			if (old[i].from != nullptr) shadow_add(old[i].from, old[i].to);
+		delete[] old;
+	}
+
+	/**
+	 * add an entry for node, which has none; room must be reserved.
+	 */
+	void shadow_add(const LinkNode *node, Node *to) {
+		size_t mask = shadow_capacity - 1, i = shadow_home(node, mask);
+		while (shadows[i].from != nullptr) i = (i + 1) & mask;
+		shadows[i] = shadow_entry{node, to};
+		shadow_used++;
+	}
+
+	/**
+	 * let node's element live in to, freeing the copy it had; room must
+	 *   be reserved.
+	 */
+	void shadow_set(const LinkNode *node, Node *to) {
+		shadow_entry *entry = shadow_find(node);
+		if (entry == nullptr) {
+			shadow_add(node, to);
+			return;
+		}
+		delete entry->to;
+		entry->to = to;
+	}
+
+	/**
+	 * node leaves the map: free its copy, if it has one, and drop its
+	 *   entry, moving later entries of the probe run back into the hole.
+	 */
+	void shadow_drop(const LinkNode *node) {
+		shadow_entry *entry = shadow_find(node);
+		if (entry == nullptr) return;
+		delete entry->to;
+		size_t mask = shadow_capacity - 1, hole = entry - shadows;
+		for (size_t i = (hole + 1) & mask; shadows[i].from != nullptr; i = (i + 1) & mask) {
+			// an entry may fill the hole unless its home lies after it
+			if (((i - shadow_home(shadows[i].from, mask)) & mask) >= ((i - hole) & mask)) {
+				shadows[hole] = shadows[i];
+				hole = i;
+			}
+		}
+		shadows[hole].from = nullptr;
+		shadow_used--;
+	}
+
+	void shadow_free() {
+		for (size_t i = 0; i < shadow_capacity; i++)
+			if (shadows[i].from != nullptr) delete shadows[i].to;
+		delete[] shadows;
+		shadows = nullptr;
+		shadow_used = shadow_capacity = 0;
+	}
+
+	size_t rank_size(size_t t) const { return t == NIL ? 0 : ranks[t].size; }
+	void rank_pull(size_t t) { ranks[t].size = rank_size(ranks[t].left) + 1 + rank_size(ranks[t].right); }
+
+	/**
+	 * join two treaps, every seq of a before those of b; the heap order
+	 *   is on a mix of the seqs.
+	 */
+	size_t rank_merge(size_t a, size_t b) {
+		if (a == NIL) return b;
+		if (b == NIL) return a;
+		if (key_mix(ranks[a].seq) > key_mix(ranks[b].seq)) {
+			ranks[a].right = rank_merge(ranks[a].right, b);
+			rank_pull(a);
+			return a;
+		}
+		ranks[b].left = rank_merge(a, ranks[b].left);
+		rank_pull(b);
+		return b;
+	}
+
+	/**
+	 * split t into the seqs below s (lo) and the others (hi).
+	 */
+	void rank_split(size_t t, unsigned long long s, size_t &lo, size_t &hi) {
+		if (t == NIL) {
+			lo = hi = NIL;
+			return;
+		}
+		if (ranks[t].seq < s) {
+			rank_split(ranks[t].right, s, ranks[t].right, hi);
+			lo = t;
+		} else {
+			rank_split(ranks[t].left, s, lo, ranks[t].left);
+			hi = t;
+		}
+		rank_pull(t);
+	}
+
+	/**
+	 * make room for extra more erased seqs.
+	 */
+	void rank_reserve(size_t extra) {
+		if (rank_used + extra <= rank_capacity) return;
+		size_t capacity = rank_capacity == 0 ? INIT_CAPACITY : rank_capacity * 2;
+		while (capacity < rank_used + extra) capacity *= 2;
+		rank_node *grown = new rank_node[capacity];
+		for (size_t i = 0; i < rank_capacity; i++) grown[i] = ranks[i];
+		for (size_t i = capacity; i-- > rank_capacity;) {
+			grown[i].left = rank_spare;
+			rank_spare = i;
+		}
+		delete[] ranks;
+		ranks = grown;
+		rank_capacity = capacity;
+	}
+
+	/**
+	 * room must be reserved.
+	 */
+	void rank_insert(unsigned long long s) {
+		size_t t = rank_spare, lo, hi;
+		rank_spare = ranks[t].left;
+		ranks[t] = rank_node{s, NIL, NIL, 1};
+		rank_used++;
+		rank_split(rank_root, s, lo, hi);
+		rank_root = rank_merge(rank_merge(lo, t), hi);
+	}
+
+	/**
+	 * the number of erased seqs below s.
+	 */
+	size_t rank_below(unsigned long long s) const {
+		size_t count = 0;
+		for (size_t t = rank_root; t != NIL;) {
+			if (ranks[t].seq < s) {
+				count += rank_size(ranks[t].left) + 1;
+				t = ranks[t].right;
+			} else {
+				t = ranks[t].left;
+			}
+		}
+		return count;
+	}
+
+	void rank_free() {
+		delete[] ranks;
+		ranks = nullptr;
+		rank_root = rank_spare = NIL;
+		rank_used = rank_capacity = 0;
+	}
+
+	const linked_hashmap *below() const { return base->frozen; }
+
+	/**
+	 * true if node, an element of the map, is in our own layer.
+	 */
+	bool owns(const LinkNode *node) const {
+		return base == nullptr || static_cast<const Node*>(node)->seq > base->frozen->seq_counter;
+	}
+
+	bool erased_here(const LinkNode *node) const {
+		const shadow_entry *entry = shadow_find(node);
+		return entry != nullptr && entry->to == nullptr;
+	}
+
+	/**
+	 * the node holding the element node stands for (see shadows): node
+	 *   itself, or the copy made in our layer or one below.
+	 */
+	const Node *current(const LinkNode *node) const {
+		for (const linked_hashmap *layer = this;; layer = layer->below()) {
+			const shadow_entry *entry = layer->shadow_find(node);
+			if (entry != nullptr) return entry->to;
+			if (layer->owns(node)) return static_cast<const Node*>(node);
+		}
+	}
+
+	/**
+	 * the node to write the element node stands for through: node itself
+	 *   if it is ours, or else its copy here, made on the first write.
+	 *   writable() first folds the layers no snapshot reads any more (see
+	 *   detach), which often makes node ours; unshare() leaves the
+	 *   structures alone, for loops that walk them.
+	 */
+	Node *writable(const LinkNode *node) {
+		if (base != nullptr && __atomic_load_n(&base->refs, __ATOMIC_ACQUIRE) == 1) detach();
+		return unshare(node);
+	}
+	Node *unshare(const LinkNode *node) {
+		if (shadow_entry *entry = shadow_find(node)) return entry->to;
+		if (owns(node)) return static_cast<Node*>(const_cast<LinkNode*>(node));
+		const Node *src = below()->current(node);
+		shadow_reserve(1);
+		Node *copy = new Node(in_place_tag(), src->hash_code, src->data);
+		copy->seq = src->seq;
+		shadow_add(node, copy);
+		return copy;
+	}
+
+	/**
+	 * the first element we hold from node on, node being an element of
+	 *   the layer below or its order_tail; past the layer below come our
+	 *   own nodes.
+	 */
+	LinkNode *skip_erased(LinkNode *node) const {
+		const linked_hashmap *lower = below();
+		while (node != lower->order_tail && erased_here(node)) node = lower->view_next(node);
+		return node != lower->order_tail ? node : order_head->order_next;
+	}
+
+	LinkNode *view_first() const {
+		if (base == nullptr) return order_head->order_next;
+		return skip_erased(below()->view_first());
+	}
+
+	/**
+	 * the element after node, an element of the map, or order_tail.
+	 */
+	LinkNode *view_next(const LinkNode *node) const {
+		if (base == nullptr || owns(node)) return node->order_next;
+		return skip_erased(below()->view_next(node));
+	}
+
+	/**
+	 * the element before node, an element of the map or order_tail, or
+	 *   nullptr if there is none.
+	 */
+	LinkNode *view_prev(const LinkNode *node) const {
+		if (base == nullptr || node == order_tail || owns(node)) {
+			if (node->order_prev != order_head) return node->order_prev;
+			if (base == nullptr) return nullptr;
+			node = below()->order_tail;
+		}
+		const linked_hashmap *lower = below();
+		for (LinkNode *p = lower->view_prev(node); p != nullptr; p = lower->view_prev(p))
+			if (!erased_here(p)) return p;
+		return nullptr;
+	}
+
+	/**
+	 * the element of the layers below holding key, unless we erased it.
+	 */
+	LinkNode *below_find(const Key &key, size_t hash_code) const {
+		if (base == nullptr) return nullptr;
+		LinkNode *node = below()->view_find(key, hash_code);
+		return node != nullptr && !erased_here(node) ? node : nullptr;
+	}
+
+	LinkNode *view_find(const Key &key, size_t hash_code) const {
+		Node *node = find_node(key, hash_code);
+		return node != nullptr ? node : below_find(key, hash_code);
+	}
+
+	/**
+	 * the buckets of a layered map are our table's, then those of the
+	 *   layers below, less what we erased.
+	 */
+	const Node *bucket_first_node(size_t b) const {
+		size_t own = table.bucket_count();
+		if (b < own) return table.bucket_first(b);
+		const linked_hashmap *lower = below();
+		for (const Node *p = lower->bucket_first_node(b - own); p != nullptr; p = lower->bucket_next_node(p, b - own))
+			if (!erased_here(p)) return p;
+		return nullptr;
+	}
+	const Node *bucket_next_node(const Node *node, size_t b) const {
+		size_t own = table.bucket_count();
+		if (b < own) return table.bucket_next(node, b);
+		const linked_hashmap *lower = below();
+		for (const Node *p = lower->bucket_next_node(node, b - own); p != nullptr; p = lower->bucket_next_node(p, b - own))
+			if (!erased_here(p)) return p;
+		return nullptr;
+	}
+	size_t bucket_in_view(const Key &key, size_t hash_code) const {
+		if (base != nullptr && find_node(key, hash_code) == nullptr && below_find(key, hash_code) != nullptr)
+			return table.bucket_count() + below()->bucket_in_view(key, hash_code);
+		return table.capacity() == 0 ? 0 : table.bucket_of(hash_code);
+	}
+
+	/**
+	 * record node, an element of the layers below, as erased; room must
+	 *   be reserved in the shadow table and the rank treap.
+	 */
+	void mark_erased(const LinkNode *node) {
+		const Node *identity = static_cast<const Node*>(node);
+		rank_insert(identity->seq);
+		shadow_set(node, nullptr);
+		key_sum -= key_mix(identity->hash_code);
+		base_live--;
+	}
+
+	/**
+	 * erase node, an element of the map.
+	 */
+	void erase_element(LinkNode *node) {
+		if (owns(node)) {
+			erase_node(static_cast<Node*>(node));
+			return;
+		}
+		shadow_reserve(1);
+		rank_reserve(1);
+		mark_erased(node);
+	}
+
+	/**
+	 * erase count elements of a layered map in insertion order from node
+	 *   on. the room is made first, so it cannot fail half way.
+	 */
+	void erase_view(LinkNode *node, size_t count) {
+		shadow_reserve(count);
+		rank_reserve(count);
+		for (; count > 0; count--) {
+			LinkNode *next = view_next(node);
+			if (owns(node)) erase_node(static_cast<Node*>(node));
+			else mark_erased(node);
+			node = next;
+		}
+	}
+
+	/**
+	 * true if nth() can use the order index all the way down.
+	 */
+	bool ranked() const { return index_enabled && (base == nullptr || below()->ranked()); }
+
+	const LinkNode *nth_node(size_t k) const {
+		if (k >= size()) throw index_out_of_bound();
+		if (k >= base_live) return own_nth(k - base_live);
+		if (below()->ranked()) return below_nth(k);
+		const LinkNode *p;
+		if (k < size() / 2) {
+			p = view_first();
+			for (size_t i = 0; i < k; i++) p = view_next(p);
+		} else {
+			p = view_prev(order_tail);
+			for (size_t i = size() - 1; i > k; i--) p = view_prev(p);
+		}
+		return p;
+	}
+
+	const LinkNode *own_nth(size_t k) const {
+		if (index_enabled) return order_slots[fenwick_select(k)];
+		const LinkNode *p;
+		if (k < num_elements / 2) {
+			p = order_head->order_next;
+			for (size_t i = 0; i < k; i++) p = p->order_next;
+		} else {
+			p = order_tail->order_prev;
+			for (size_t i = num_elements - 1; i > k; i--) p = p->order_prev;
+		}
+		return p;
+	}
+
+	/**
+	 * the k-th of the elements we hold from the layers below, by binary
+	 *   search over their positions there: the element at position j
+	 *   there has j less the ones we erased before it ahead of it here.
+	 */
+	const LinkNode *below_nth(size_t k) const {
+		const linked_hashmap *lower = below();
+		size_t lo = k, hi = k + rank_used;
+		while (lo < hi) {
+			size_t mid = lo + (hi - lo) / 2;
+			const Node *node = static_cast<const Node*>(lower->nth_node(mid));
+			if (mid + 1 - rank_below(node->seq + 1) > k) hi = mid;
+			else lo = mid + 1;
+		}
+		return lower->nth_node(lo);
+	}
+
+	/**
+	 * the position of node, an element of the map, in insertion order.
+	 */
+	size_t view_position(const LinkNode *node) const {
+		if (owns(node)) return base_live + own_position(node);
+		if (below()->ranked()) return below()->view_position(node) - rank_below(static_cast<const Node*>(node)->seq);
+		size_t pos = 0;
+		for (const LinkNode *p = view_prev(node); p != nullptr; p = view_prev(p)) pos++;
+		return pos;
+	}
+
+	size_t own_position(const LinkNode *node) const {
+		if (index_enabled) return fenwick_prefix(seq_slot(static_cast<const Node*>(node)->seq));
+		size_t pos = 0;
+		for (const LinkNode *p = node->order_prev; p != order_head; p = p->order_prev) pos++;
+		return pos;
+	}
+	void index_free() {
+		delete[] order_slots;
+		delete[] slot_seqs;
+		delete[] order_fenwick;
+		order_slots = nullptr;
+		slot_seqs = nullptr;
+		order_fenwick = nullptr;
+		slot_used = slot_capacity = 0;
+	}
+
+	/**
+	 * renumber every node densely in insertion order and rebuild the
+	 * Fenwick tree in O(capacity).
+	 */
+	void index_rebuild(size_t capacity) {
+		if (capacity != slot_capacity) {
+			Node **new_slots = new Node*[capacity];
+			unsigned long long *new_seqs = nullptr;
+			size_t *new_fenwick;
+			try {
+				new_seqs = new unsigned long long[capacity];
+				new_fenwick = new size_t[capacity + 1];
+			} catch (...) {
+				delete[] new_slots;
+				delete[] new_seqs;
+				throw;
+			}
+			index_free();
+			order_slots = new_slots;
+			slot_seqs = new_seqs;
+			order_fenwick = new_fenwick;
+			slot_capacity = capacity;
+		}
+		slot_used = 0;
+		for (LinkNode *p = order_head->order_next; p != order_tail; p = p->order_next) {
+			Node *node = static_cast<Node*>(p);
+			slot_seqs[slot_used] = node->seq;
+			order_slots[slot_used++] = node;
+		}
+		for (size_t i = slot_used; i < slot_capacity; i++) order_slots[i] = nullptr;
+		order_fenwick[0] = 0;
+		for (size_t i = 1; i <= slot_capacity; i++) order_fenwick[i] = (i <= slot_used);
+		for (size_t i = 1; i <= slot_capacity; i++) {
+			size_t j = i + lowbit(i);
+			if (j <= slot_capacity) order_fenwick[j] += order_fenwick[i];
+		}
+	}
+
+	void fenwick_add(size_t slot, size_t delta) {
+		for (size_t i = slot + 1; i <= slot_capacity; i += lowbit(i)) order_fenwick[i] += delta;
+	}
+
+	/**
+	 * number of live slots before slot.
+	 */
+	size_t fenwick_prefix(size_t slot) const {
+		size_t sum = 0;
+		for (size_t i = slot; i > 0; i -= lowbit(i)) sum += order_fenwick[i];
+		return sum;
+	}
+
+	/**
+	 * the slot holding the k-th (0-based) live node.
+	 */
+	size_t fenwick_select(size_t k) const {
+		size_t step = 1, pos = 0;
+		while (step * 2 <= slot_capacity) step *= 2;
+		for (; step > 0; step /= 2) {
+			if (pos + step <= slot_capacity && order_fenwick[pos + step] <= k) {
+				pos += step;
+				k -= order_fenwick[pos];
+			}
+		}
+		return pos;
+	}
+
+	/**
+	 * make room for extra more slots: compact if at least half of the
+	 * slots are holes, otherwise double (as often as needed).
+	 */
+	void index_reserve(size_t extra = 1) {
+		if (slot_used + extra <= slot_capacity) return;
+		size_t capacity = slot_capacity;
+		if ((num_elements + extra) * 2 > capacity) capacity *= 2;
+		while (num_elements + extra > capacity) capacity *= 2;
+		index_rebuild(capacity);
+	}
+
+	/**
+	 * the first slot whose seq is at least s, or slot_used; a node's own
+	 *   slot when s is its seq.
+	 */
+	size_t seq_slot(unsigned long long s) const {
+		size_t lo = 0, hi = slot_used;
+		while (lo < hi) {
+			size_t mid = lo + (hi - lo) / 2;
+			if (slot_seqs[mid] < s) lo = mid + 1;
+			else hi = mid;
+		}
+		return lo;
+	}
+
+	void index_append(Node *node) {
+		slot_seqs[slot_used] = node->seq;
+		order_slots[slot_used] = node;
+		fenwick_add(slot_used++, 1);
+	}
+
+	void index_remove(Node *node) {
+		size_t slot = seq_slot(node->seq);
+		order_slots[slot] = nullptr;
+		fenwick_add(slot, ~size_t(0));
+	}
+
+	static unsigned long long chunk_of(const LinkNode *node) { return static_cast<const Node*>(node)->seq / SKIP; }
+
+	/**
+	 * true if node, which must be in the order list, is the first of its
+	 *   chunk there.
+	 */
+	bool starts_chunk(const LinkNode *node) const {
+		return node->order_prev == order_head || chunk_of(node->order_prev) != chunk_of(node);
+	}
+
+	/**
+	 * make room for extra more skip entries, sweeping out the holes or
+	 *   growing the array.
+	 */
+	void skip_reserve(size_t extra) {
+		if (skip_used + extra <= skip_capacity) return;
+		if (skip_holes > 0) skip_sweep();
+		if (skip_used + extra <= skip_capacity) return;
+		size_t capacity = skip_capacity == 0 ? INIT_CAPACITY : skip_capacity * 2;
+		while (capacity < skip_used + extra) capacity *= 2;
+		skip_entry *grown = new skip_entry[capacity];
+		for (size_t i = 0; i < skip_used; i++) grown[i] = skips[i];
+		delete[] skips;
+		skips = grown;
+		skip_capacity = capacity;
+	}
+
+	void skip_sweep() {
+		size_t kept = 0;
+		for (size_t i = 0; i < skip_used; i++)
+			if (skips[i].first != nullptr) skips[kept++] = skips[i];
+		skip_used = kept;
+		skip_holes = 0;
+	}
+
+	/**
+	 * the entry of the chunk node starts, or nullptr.
+	 */
+	skip_entry *skip_find(const LinkNode *node) const {
+		unsigned long long chunk = chunk_of(node);
+		size_t lo = 0, hi = skip_used;
+		while (lo < hi) {
+			size_t mid = lo + (hi - lo) / 2;
+			if (skips[mid].chunk < chunk) lo = mid + 1;
+			else hi = mid;
+		}
+		for (; lo < skip_used && skips[lo].chunk == chunk; lo++)
+			if (skips[lo].first == node) return skips + lo;
+		return nullptr;
+	}
+
+	/**
+	 * node is about to leave the order list, after which next follows
+	 *   what preceded it. if node starts its chunk, next takes over the
+	 *   entry when it is in the same chunk; otherwise the chunk is empty.
+	 */
+	void skip_drop(LinkNode *node, LinkNode *next) {
+		if (!starts_chunk(node)) return;
+		skip_entry *entry = skip_find(node);
+		if (entry == nullptr) return;
+		if (next != order_tail && chunk_of(next) == entry->chunk) {
+			entry->first = next;
+			return;
+		}
+		entry->first = nullptr;
+		if (++skip_holes * 2 > skip_used) skip_sweep();
+	}
+
+	/**
+	 * put node last in the order list, with a skip entry if it starts a
+	 *   chunk. the caller has made room for the entry (see skip_reserve)
+	 *   where running out of memory here would leave the map broken.
+	 */
+	void link_last(Node *node) {
+		node->order_prev = order_tail->order_prev;
+		node->order_next = order_tail;
+		if (starts_chunk(node)) {
+			skip_reserve(1);
+			skips[skip_used++] = skip_entry{chunk_of(node), node};
+		}
+		order_tail->order_prev->order_next = node;
+		order_tail->order_prev = node;
+	}
+
+	/**
+	 * call f(node) for every node in insertion order, prefetching ahead:
+	 *   in indexed mode the node LOOKAHEAD places on, from order_slots.
+	 *   otherwise CHAINS chains run through the chunks ahead of the one
+	 *   visited, each started at a chunk's skip entry, and one of them
+	 *   goes a node further at every step, prefetching it; that keeps
+	 *   CHAINS misses in flight where a walk of the list has one. a chain
+	 *   that is done, or fell behind, starts again at the next chunk up
+	 *   to 2 * CHAINS chunks ahead.
+	 */
+	template<class F>
+	void walk_prefetched(F f) const {
+		if (index_enabled) {
+			for (size_t i = 0; i < slot_used; i++) {
+				if (i + LOOKAHEAD < slot_used) __builtin_prefetch(order_slots[i + LOOKAHEAD]);
+				if (order_slots[i] != nullptr) f(order_slots[i]);
+			}
+			return;
+		}
+		const LinkNode *chain[CHAINS];
+		unsigned long long chain_chunk[CHAINS];
+		for (size_t i = 0; i < CHAINS; i++) chain[i] = nullptr;
+		size_t next = 0, turn = 0;
+		for (LinkNode *p = order_head->order_next; p != order_tail;) {
+			Node *node = static_cast<Node*>(p);
+			unsigned long long here = node->seq / SKIP;
+			const LinkNode *&q = chain[turn];
+			// q was prefetched CHAINS steps ago
+			if (q != nullptr && (q == order_tail || chain_chunk[turn] <= here || chunk_of(q) != chain_chunk[turn])) q = nullptr;
+			if (q != nullptr) {
+				q = q->order_next;
+				__builtin_prefetch(q);
+			} else {
+				while (next < skip_used && (skips[next].first == nullptr || skips[next].chunk <= here)) next++;
+				if (next < skip_used && skips[next].chunk <= here + 2 * CHAINS) {
+					chain_chunk[turn] = skips[next].chunk;
+					q = skips[next++].first;
+					__builtin_prefetch(q);
+				}
+			}
+			turn = (turn + 1) % CHAINS;
+			p = p->order_next;
+			f(node);
+		}
+	}
+
+	void unlink_order(LinkNode *node) {
+		if (node == defrag_next) defrag_next = node->order_next;
+		skip_drop(node, node->order_next);
+		node->order_prev->order_next = node->order_next;
+		node->order_next->order_prev = node->order_prev;
+	}
+
+	/**
+	 * if probe is given, it receives the number of other nodes looked at.
+	 */
+	Node *find_node(const Key &key, size_t hash_code, size_t *probe = nullptr) const {
+		if (num_elements == 0) {
+			// nothing to find, and a moved-from map has no table to look in
+			if (probe) *probe = 0;
+			return nullptr;
+		}
+		size_t passed;
+		Node *node = table.find(key, hash_code, key_equal, passed);
+		if (probe) *probe = passed;
+		return node;
+	}
+
+	/**
+	 * the first node whose seq is at least s, or order_tail; on a layered
+	 *   map the layers below are searched first if s falls in them.
+	 * indexed: binary search on slot_seqs, then select the next live slot.
+	 * otherwise: walk back from the newest node, which only costs as much
+	 *   as the elements the caller is about to visit.
+	 */
+	const LinkNode *seq_lower_bound(unsigned long long s) const {
+		if (base != nullptr && s <= below()->seq_counter) return skip_erased(const_cast<LinkNode*>(below()->seq_lower_bound(s)));
+		if (index_enabled) {
+			size_t rank = fenwick_prefix(seq_slot(s));
+			return rank < num_elements ? order_slots[fenwick_select(rank)] : order_tail;
+		}
+		const LinkNode *p = order_tail;
+		while (p->order_prev != order_head && static_cast<const Node*>(p->order_prev)->seq >= s) p = p->order_prev;
+		return p;
+	}
+
+	/**
+	 * call f(slots, n, offset, batched) over node pointer arrays covering
+	 * the map in insertion order, where offset is where data.second sits
+	 * in a node. indexed: once, over order_slots, holes included, with
+	 * batched true. otherwise: once per node as the order list is
+	 * walked; the walk is bound by its loads, and gathering nodes into a
+	 * batch only to read them again was measured slower than this.
+	 * a layered map, or one with copies (see shadows), is walked too.
+	 * the value aggregates of aggregates.hpp scan through here.
+	 */
+	friend struct value_scan;
+	template<class F>
+	void for_value_slots(F f) const {
+		if (size() == 0) return;
+		const Node *first = current(view_first());
+		size_t offset = reinterpret_cast<const char*>(&first->data.second) - reinterpret_cast<const char*>(first);
+		if (index_enabled && base == nullptr && shadow_used == 0) {
+			f(static_cast<Node* const*>(order_slots), slot_used, offset, true);
+			return;
+		}
+		for (const LinkNode *p = view_first(); p != order_tail; p = view_next(p)) {
+			const Node *node = current(p);
+			f(&node, 1, offset, false);
+		}
+	}
+
+	/**
+	 * call f(node) for every element in insertion order, node being the
+	 *   element's identity (see shadows): what we hold of the layers
+	 *   below, then our own nodes through walk_prefetched.
+	 */
+	template<class F>
+	void walk_view(F f) const {
+		const LinkNode *p = view_first();
+		for (; p != order_tail && !owns(p); p = view_next(p)) f(p);
+		walk_prefetched([&](const Node *node) { f(node); });
+	}
+
+	void erase_node(Node *node) {
+		if (shadow_used != 0) shadow_drop(node);
+		if (index_enabled) index_remove(node);
+		table.erase(node);
+		unlink_order(node);
+		key_sum -= key_mix(node->hash_code);
+		free_node(node);
+		num_elements--;
+	}
+
+	/**
+	 * free a chain of nodes (linked through order_next) that have already
+	 * been cut out of the order list but are still in the table.
+	 * if they are more than half of what the map held, it is cheaper to
+	 * reindex the survivors into an emptied table than to unlink each one.
+	 */
+	void release_detached(LinkNode *removed, size_t count) {
+		if (count == 0) return;
+		if (count * 2 > num_elements) {
+			table.rebuild(order_head->order_next, order_tail, table.capacity());
+			if (index_enabled) index_rebuild(slot_capacity);
+		} else {
+			for (LinkNode *p = removed; p != nullptr; p = p->order_next) {
+				if (index_enabled) index_remove(static_cast<Node*>(p));
+				table.erase(static_cast<Node*>(p));
+			}
+		}
+		while (removed != nullptr) {
+			LinkNode *next = removed->order_next;
+			key_sum -= key_mix(static_cast<Node*>(removed)->hash_code);
+			if (shadow_used != 0) shadow_drop(removed);
+			free_node(static_cast<Node*>(removed));
+			removed = next;
+		}
+		num_elements -= count;
+	}
+
+	/**
+	 * cut [first, last) out of the order list with one splice and free it.
+	 * count must be the number of nodes in the range.
+	 */
+	void erase_range(LinkNode *first, LinkNode *last, size_t count) {
+		if (count == 0) return;
+		for (LinkNode *p = first; p != last; p = p->order_next) {
+			if (p == defrag_next) defrag_next = last;
+			skip_drop(p, last);
+		}
+		LinkNode *prev = first->order_prev;
+		last->order_prev->order_next = nullptr;
+		prev->order_next = last;
+		last->order_prev = prev;
+		release_detached(first, count);
+	}
 
-private:
-	struct LinkNode {
-		LinkNode *order_prev;
-		LinkNode *order_next;
-		LinkNode() : order_prev(nullptr), order_next(nullptr) {}
-	};
-	struct Node : LinkNode {
-		value_type data;
-		Node *next_in_bucket;
-		Node(const Key &k, const T &v) : LinkNode(), data(k, v), next_in_bucket(nullptr) {}
-	};
+	template<class H>
+	static auto try_reseed(H &h, int) -> decltype(h.reseed(), bool()) {
+		h.reseed();
+		return true;
+	}
+	template<class H>
+	static bool try_reseed(H &, long) { return false; }
 
-	static const size_t INIT_CAPACITY = 16;
-	static const double LOAD_FACTOR;
+	/**
+	 * pred(value) for retain() on a layered map: a pred that takes a
+	 *   const value reads the element where it is; one that could write
+	 *   gets it copied out of a snapshot first (see writable()).
+	 */
+	template<class Pred>
+	auto keeps(Pred &pred, const LinkNode *node, int) -> decltype(bool(pred(static_cast<const value_type &>(current(node)->data)))) {
+		return pred(static_cast<const value_type &>(current(node)->data));
+	}
+	template<class Pred>
+	bool keeps(Pred &pred, const LinkNode *node, long) { return pred(unshare(node)->data); }
 
-	Node **buckets;
-	LinkNode *order_head;
-	LinkNode *order_tail;
-	size_t bucket_capacity;
-	size_t num_elements;
-	Hash hasher;
-	Equal key_equal;
+	/**
+	 * called when an insert of node probed PROBE_LIMIT or more other nodes.
+	 * if the hasher can draw a new seed (it has reseed(), as seeded_hash
+	 *   does), rehash every key under a new one, which scatters keys that
+	 *   were chosen to collide under the old seed.
+	 * a reseed costs O(n), so it is allowed once per doubling of the size;
+	 *   keys that collide whatever the seed cannot make it happen more
+	 *   often than that. otherwise the table gets to react; chained
+	 *   storage treeifies the bucket. a layered map shares its hash codes
+	 *   with the layers below, and does not reseed.
+	 */
+	void defend_chain(Node *node) {
+		if (base != nullptr || num_elements < reseed_mark * 2 || !try_reseed(hasher, 0)) {
+			table.long_probe(node);
+			return;
+		}
+		reseed_mark = num_elements;
+		key_sum = 0;
+		for (LinkNode *p = order_head->order_next; p != order_tail; p = p->order_next) {
+			Node *node = static_cast<Node*>(p);
+			node->hash_code = hasher(node->data.first);
+			key_sum += key_mix(node->hash_code);
+		}
+		table.rebuild(order_head->order_next, order_tail, table.capacity());
+	}
 
-	size_t get_bucket_index(const Key &key) const {
-		return hasher(key) % bucket_capacity;
+	void rehash() {
+		table.rebuild(order_head->order_next, order_tail, table.capacity() * 2);
 	}
 
-	void init_empty() {
-		order_head = new LinkNode();
-		order_tail = new LinkNode();
-		order_head->order_next = order_tail;
-		order_tail->order_prev = order_head;
+	/**
+	 * grow the table (and the order index) once, so that extra more
+	 *   elements fit without another rehash.
+	 */
+	void reserve_more(size_t extra) {
+		size_t capacity = table.capacity();
+		while (num_elements + extra > capacity * max_load) capacity *= 2;
+		if (capacity != table.capacity()) table.rebuild(order_head->order_next, order_tail, capacity);
+		if (index_enabled) index_reserve(extra);
+		skip_reserve(extra / SKIP + 2);
 	}
 
-	void rehash() {
-		size_t new_capacity = bucket_capacity * 2;
-		Node **new_buckets = new Node*[new_capacity];
-		for (size_t i = 0; i < new_capacity; i++) new_buckets[i] = nullptr;
+	/**
+	 * stamp node, which must have its hash code and room reserved for it
+	 *   in the table, index and skips, and put it last in insertion order.
+	 */
+	void append_node(Node *node) {
+		node->seq = ++seq_counter;
+		table.insert(node);
+		if (index_enabled) index_append(node);
+		link_last(node);
+		key_sum += key_mix(node->hash_code);
+		num_elements++;
+	}
 
-		Node *cur = static_cast<Node*>(order_head->order_next);
-		while (cur != static_cast<Node*>(order_tail)) {
-			size_t idx = hasher(cur->data.first) % new_capacity;
-			cur->next_in_bucket = new_buckets[idx];
-			new_buckets[idx] = cur;
-			cur = static_cast<Node*>(cur->order_next);
-		}
+	/**
+	 * a hasher without state hashes alike in every map, so the hash codes
+	 *   cached in another map's nodes can be taken over as they are.
+	 */
+	size_t hash_of(const Node *node) const {
+		return STATELESS_HASH ? node->hash_code : hasher(node->data.first);
+	}
+
+	/**
+	 * spread a hash code over the whole word before it is summed, so
+	 *   that sums of small or structured codes (std::hash of integers is
+	 *   the identity) do not cancel out.
+	 */
+	static size_t key_mix(size_t h) {
+		unsigned long long x = h;
+		x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+		return (size_t)(x ^ (x >> 31));
+	}
 
-		delete[] buckets;
-		buckets = new_buckets;
-		bucket_capacity = new_capacity;
+	/**
+	 * the element holding node's key in other, or nullptr.
+	 */
+	const LinkNode *find_in(const linked_hashmap &other, const Node *node) const {
+		size_t hash_code = STATELESS_HASH ? node->hash_code : other.hasher(node->data.first);
+		return other.view_find(node->data.first, hash_code);
 	}
 
+	/**
+	 * what merge_from does with a key both maps hold.
+	 */
+	static void merge_value(T &, const T &, merge_keep) {}
+	static void merge_value(T &mine, const T &theirs, merge_overwrite) { mine = theirs; }
+	static void merge_value(T &mine, T &&theirs, merge_overwrite) { mine = std::move(theirs); }
+	template<class F>
+	static void merge_value(T &mine, const T &theirs, F &combine) { mine = combine(static_cast<const T &>(mine), theirs); }
+	/**
+	 * false for the policy that never writes, so that merge_from leaves
+	 *   an element a snapshot shares uncopied.
+	 */
+	static bool merge_writes(merge_keep) { return false; }
+	template<class Policy>
+	static bool merge_writes(const Policy &) { return true; }
+
 public:
 	/**
 	 * see BidirectionalIterator at CppReference for help.
@@ -100,7 +1992,9 @@ public:
 	private:
 		LinkNode *node;
 		linked_hashmap *map_ptr;
-		Node *get_node() const { return static_cast<Node*>(node); }
+		// the map's epoch when this was made; see linked_hashmap::epoch
+		size_t epoch;
+		bool stale() const { return map_ptr == nullptr || node == nullptr || epoch != map_ptr->epoch; }
 	public:
 		// The following code is written for the C++ type_traits library.
 		// Type traits is a C++ feature for describing certain properties of a type.
@@ -119,53 +2013,57 @@ public:
 		using iterator_category = std::output_iterator_tag;
 
 
-		iterator() : node(nullptr), map_ptr(nullptr) {}
-		iterator(LinkNode *n, linked_hashmap *m) : node(n), map_ptr(m) {}
-		iterator(const iterator &other) : node(other.node), map_ptr(other.map_ptr) {}
+		iterator() : node(nullptr), map_ptr(nullptr), epoch(0) {}
+		iterator(LinkNode *n, linked_hashmap *m) : node(n), map_ptr(m), epoch(m->epoch) {}
+		iterator(const iterator &other) : node(other.node), map_ptr(other.map_ptr), epoch(other.epoch) {}
 		/**
 		 * TODO iter++
 		 */
 		iterator operator++(int) {
-			if (map_ptr == nullptr || node == nullptr) throw invalid_iterator();
+			if (stale()) throw invalid_iterator();
 			if (node == map_ptr->order_tail) throw invalid_iterator();
 			iterator tmp = *this;
-			node = node->order_next;
+			node = map_ptr->view_next(node);
 			return tmp;
 		}
 		/**
 		 * TODO ++iter
 		 */
 		iterator & operator++() {
-			if (map_ptr == nullptr || node == nullptr) throw invalid_iterator();
+			if (stale()) throw invalid_iterator();
 			if (node == map_ptr->order_tail) throw invalid_iterator();
-			node = node->order_next;
+			node = map_ptr->view_next(node);
 			return *this;
 		}
 		/**
 		 * TODO iter--
 		 */
 		iterator operator--(int) {
-			if (map_ptr == nullptr || node == nullptr) throw invalid_iterator();
-			if (node == map_ptr->order_head->order_next) throw invalid_iterator();
+			if (stale() || node == map_ptr->order_head) throw invalid_iterator();
+			LinkNode *prev = map_ptr->view_prev(node);
+			if (prev == nullptr) throw invalid_iterator();
 			iterator tmp = *this;
-			node = node->order_prev;
+			node = prev;
 			return tmp;
 		}
 		/**
 		 * TODO --iter
 		 */
 		iterator & operator--() {
-			if (map_ptr == nullptr || node == nullptr) throw invalid_iterator();
-			if (node == map_ptr->order_head->order_next) throw invalid_iterator();
-			node = node->order_prev;
+			if (stale() || node == map_ptr->order_head) throw invalid_iterator();
+			LinkNode *prev = map_ptr->view_prev(node);
+			if (prev == nullptr) throw invalid_iterator();
+			node = prev;
 			return *this;
 		}
 		/**
 		 * a operator to check whether two iterators are same (pointing to the same memory).
+		 * an element a snapshot shares is copied before it is handed out
+		 *   for writing (see snapshot()).
 		 */
 		value_type & operator*() const {
-			if (map_ptr == nullptr || node == nullptr || node == map_ptr->order_tail || node == map_ptr->order_head) throw invalid_iterator();
-			return get_node()->data;
+			if (stale() || node == map_ptr->order_tail || node == map_ptr->order_head) throw invalid_iterator();
+			return map_ptr->writable(node)->data;
 		}
 		bool operator==(const iterator &rhs) const { return node == rhs.node && map_ptr == rhs.map_ptr; }
 		bool operator==(const const_iterator &rhs) const { return node == rhs.node && map_ptr == rhs.map_ptr; }
@@ -179,7 +2077,10 @@ public:
 		 * for the support of it->first. 
 		 * See <http://kelvinh.github.io/blog/2013/11/20/overloading-of-member-access-operator-dash-greater-than-symbol-in-cpp/> for help.
 		 */
-		value_type* operator->() const noexcept { return &(get_node()->data); }
+		value_type* operator->() const {
+			if (stale() || node == map_ptr->order_tail || node == map_ptr->order_head) throw invalid_iterator();
+			return &(map_ptr->writable(node)->data);
+		}
 
 		friend class linked_hashmap;
 		friend class const_iterator;
@@ -189,7 +2090,8 @@ public:
 	private:
 		const LinkNode *node;
 		const linked_hashmap *map_ptr;
-		const Node *get_node() const { return static_cast<const Node*>(node); }
+		size_t epoch;
+		bool stale() const { return map_ptr == nullptr || node == nullptr || epoch != map_ptr->epoch; }
 	public:
 		using difference_type = std::ptrdiff_t;
 		using value_type = typename linked_hashmap::value_type;
@@ -197,46 +2099,143 @@ public:
 		using reference = const value_type&;
 		using iterator_category = std::output_iterator_tag;
 
-		const_iterator() : node(nullptr), map_ptr(nullptr) {}
-		const_iterator(const LinkNode *n, const linked_hashmap *m) : node(n), map_ptr(m) {}
-		const_iterator(const const_iterator &other) : node(other.node), map_ptr(other.map_ptr) {}
-		const_iterator(const iterator &other) : node(other.node), map_ptr(other.map_ptr) {}
+		const_iterator() : node(nullptr), map_ptr(nullptr), epoch(0) {}
+		const_iterator(const LinkNode *n, const linked_hashmap *m) : node(n), map_ptr(m), epoch(m->epoch) {}
+		const_iterator(const const_iterator &other) : node(other.node), map_ptr(other.map_ptr), epoch(other.epoch) {}
+		const_iterator(const iterator &other) : node(other.node), map_ptr(other.map_ptr), epoch(other.epoch) {}
 
 		const_iterator operator++(int) {
-			if (map_ptr == nullptr || node == nullptr) throw invalid_iterator();
+			if (stale()) throw invalid_iterator();
 			if (node == map_ptr->order_tail) throw invalid_iterator();
 			const_iterator tmp = *this;
-			node = node->order_next;
+			node = map_ptr->view_next(node);
 			return tmp;
 		}
 		const_iterator & operator++() {
-			if (map_ptr == nullptr || node == nullptr) throw invalid_iterator();
+			if (stale()) throw invalid_iterator();
 			if (node == map_ptr->order_tail) throw invalid_iterator();
-			node = node->order_next;
+			node = map_ptr->view_next(node);
 			return *this;
 		}
 		const_iterator operator--(int) {
-			if (map_ptr == nullptr || node == nullptr) throw invalid_iterator();
-			if (node == map_ptr->order_head->order_next) throw invalid_iterator();
+			if (stale() || node == map_ptr->order_head) throw invalid_iterator();
+			const LinkNode *prev = map_ptr->view_prev(node);
+			if (prev == nullptr) throw invalid_iterator();
 			const_iterator tmp = *this;
-			node = node->order_prev;
+			node = prev;
 			return tmp;
 		}
 		const_iterator & operator--() {
-			if (map_ptr == nullptr || node == nullptr) throw invalid_iterator();
-			if (node == map_ptr->order_head->order_next) throw invalid_iterator();
-			node = node->order_prev;
+			if (stale() || node == map_ptr->order_head) throw invalid_iterator();
+			const LinkNode *prev = map_ptr->view_prev(node);
+			if (prev == nullptr) throw invalid_iterator();
+			node = prev;
 			return *this;
 		}
 		const value_type & operator*() const {
-			if (map_ptr == nullptr || node == nullptr || node == map_ptr->order_tail || node == map_ptr->order_head) throw invalid_iterator();
-			return get_node()->data;
+			if (stale() || node == map_ptr->order_tail || node == map_ptr->order_head) throw invalid_iterator();
+			return map_ptr->current(node)->data;
 		}
 		bool operator==(const iterator &rhs) const { return node == rhs.node && map_ptr == rhs.map_ptr; }
 		bool operator==(const const_iterator &rhs) const { return node == rhs.node && map_ptr == rhs.map_ptr; }
 		bool operator!=(const iterator &rhs) const { return !(*this == rhs); }
 		bool operator!=(const const_iterator &rhs) const { return !(*this == rhs); }
-		const value_type* operator->() const noexcept { return &(get_node()->data); }
+		const value_type* operator->() const {
+			if (stale() || node == map_ptr->order_tail || node == map_ptr->order_head) throw invalid_iterator();
+			return &(map_ptr->current(node)->data);
+		}
+
+		friend class linked_hashmap;
+	};
+
+	/**
+	 * walks the elements held by a range of buckets (see buckets()),
+	 *   bucket by bucket; within a bucket, in the table's own order.
+	 * read-only, and invalidated by any insert or erase.
+	 */
+	class bucket_iterator {
+	private:
+		const linked_hashmap *map_ptr;
+		size_t bucket, last;
+		const Node *node;
+		bucket_iterator(const linked_hashmap *m, size_t first, size_t l) : map_ptr(m), bucket(first), last(l), node(nullptr) {
+			settle();
+		}
+		/**
+		 * from bucket on, find the first bucket that holds a node.
+		 */
+		void settle() {
+			for (; bucket < last; bucket++) {
+				node = map_ptr->bucket_first_node(bucket);
+				if (node != nullptr) return;
+			}
+		}
+	public:
+		using difference_type = std::ptrdiff_t;
+		using value_type = typename linked_hashmap::value_type;
+		using pointer = const value_type*;
+		using reference = const value_type&;
+		using iterator_category = std::forward_iterator_tag;
+
+		bucket_iterator() : map_ptr(nullptr), bucket(0), last(0), node(nullptr) {}
+		bucket_iterator & operator++() {
+			if (node == nullptr) throw invalid_iterator();
+			node = map_ptr->bucket_next_node(node, bucket);
+			if (node == nullptr) {
+				bucket++;
+				settle();
+			}
+			return *this;
+		}
+		bucket_iterator operator++(int) {
+			bucket_iterator tmp = *this;
+			++*this;
+			return tmp;
+		}
+		const value_type & operator*() const {
+			if (node == nullptr) throw invalid_iterator();
+			return map_ptr->current(node)->data;
+		}
+		const value_type * operator->() const noexcept { return &map_ptr->current(node)->data; }
+		bool operator==(const bucket_iterator &rhs) const { return node == rhs.node && map_ptr == rhs.map_ptr; }
+		bool operator!=(const bucket_iterator &rhs) const { return !(*this == rhs); }
+
+		friend class linked_hashmap;
+	};
+
+	/**
+	 * the elements held by buckets [first, last), for a range-for.
+	 */
+	class bucket_range {
+	private:
+		const linked_hashmap *map_ptr;
+		size_t first, last;
+		bucket_range(const linked_hashmap *m, size_t f, size_t l) : map_ptr(m), first(f), last(l) {}
+	public:
+		bucket_iterator begin() const { return bucket_iterator(map_ptr, first, last); }
+		bucket_iterator end() const { return bucket_iterator(map_ptr, last, last); }
+		size_t first_bucket() const { return first; }
+		size_t last_bucket() const { return last; }
+
+		friend class linked_hashmap;
+	};
+
+	/**
+	 * k ranges of buckets (see partition()), split as evenly as the
+	 *   bucket count allows; [i] is the i-th, made on demand.
+	 */
+	class bucket_partition {
+	private:
+		const linked_hashmap *map_ptr;
+		size_t parts, total;
+		bucket_partition(const linked_hashmap *m, size_t k) : map_ptr(m), parts(k), total(m->bucket_count()) {}
+	public:
+		size_t size() const { return parts; }
+		bucket_range operator[](size_t i) const {
+			if (i >= parts) throw index_out_of_bound();
+			return bucket_range(map_ptr, total / parts * i + (i < total % parts ? i : total % parts),
+				total / parts * (i + 1) + (i + 1 < total % parts ? i + 1 : total % parts));
+		}
 
 		friend class linked_hashmap;
 	};
@@ -245,18 +2244,30 @@ public:
 	/**
 	 * TODO two constructors
 	 */
-	linked_hashmap() : bucket_capacity(INIT_CAPACITY), num_elements(0) {
-		buckets = new Node*[INIT_CAPACITY];
-		for (size_t i = 0; i < INIT_CAPACITY; i++) buckets[i] = nullptr;
+	linked_hashmap() : num_elements(0), key_sum(0), seq_counter(0), reseed_mark(0), max_load(table_type::default_load_factor()),
+		base(nullptr), base_live(0), depth(0), shadows(nullptr), shadow_used(0), shadow_capacity(0),
+		ranks(nullptr), rank_root(NIL), rank_spare(NIL), rank_used(0), rank_capacity(0), epoch(0) {
+		table.init(INIT_CAPACITY);
 		init_empty();
 	}
-	linked_hashmap(const linked_hashmap &other) : bucket_capacity(other.bucket_capacity), num_elements(0) {
-		buckets = new Node*[bucket_capacity];
-		for (size_t i = 0; i < bucket_capacity; i++) buckets[i] = nullptr;
-		init_empty();
-		for (const_iterator it = other.cbegin(); it != other.cend(); ++it) {
-			insert(*it);
-		}
+	/**
+	 * a copy keeps the source's sequence numbers and indexed mode.
+	 */
+	linked_hashmap(const linked_hashmap &other) : linked_hashmap(other, nullptr, 0) {}
+	/**
+	 * take over other's elements (and snapshots) in O(1), allocating
+	 *   nothing. other is left empty and without storage (it has no
+	 *   buckets) until it is next modified.
+	 */
+	linked_hashmap(linked_hashmap &&other) noexcept
+		: order_head(&vacant_ends().head), order_tail(&vacant_ends().tail), num_elements(0), key_sum(0), seq_counter(0),
+		  reseed_mark(0), max_load(table_type::default_load_factor()), index_enabled(false),
+		  order_slots(nullptr), slot_seqs(nullptr), order_fenwick(nullptr), slot_used(0), slot_capacity(0),
+		  skips(nullptr), skip_used(0), skip_capacity(0), skip_holes(0), base(nullptr), base_live(0), depth(0),
+		  shadows(nullptr), shadow_used(0), shadow_capacity(0),
+		  ranks(nullptr), rank_root(NIL), rank_spare(NIL), rank_used(0), rank_capacity(0), epoch(0),
+		  slab{nullptr, nullptr, 0, 0}, filling{nullptr, nullptr, 0, 0}, defrag_next(nullptr) {
+		swap_state(other);
 	}
  
 	/**
@@ -264,29 +2275,104 @@ public:
 	 */
 	linked_hashmap & operator=(const linked_hashmap &other) {
 		if (this == &other) return *this;
-		clear();
-		delete[] buckets;
-		delete static_cast<LinkNode*>(order_head);
-		delete static_cast<LinkNode*>(order_tail);
-		bucket_capacity = other.bucket_capacity;
-		num_elements = 0;
-		buckets = new Node*[bucket_capacity];
-		for (size_t i = 0; i < bucket_capacity; i++) buckets[i] = nullptr;
-		init_empty();
-		for (const_iterator it = other.cbegin(); it != other.cend(); ++it) {
-			insert(*it);
-		}
+		linked_hashmap copy(other);
+		swap_state(copy);
+		return *this;
+	}
+	linked_hashmap & operator=(linked_hashmap &&other) noexcept {
+		if (this == &other) return *this;
+		linked_hashmap moved(std::move(other));
+		swap_state(moved);
 		return *this;
 	}
  
 	/**
 	 * TODO Destructors
+	 * the layers below are left to the snapshots still reading them.
 	 */
 	~linked_hashmap() {
-		clear();
-		delete[] buckets;
-		delete static_cast<LinkNode*>(order_head);
-		delete static_cast<LinkNode*>(order_tail);
+		free_storage();
+		if (base != nullptr) release(base);
+	}
+
+	/**
+	 * a read-only view of the map as it was when snapshot() was called.
+	 * it stays valid, and unchanged, after the map is modified or
+	 *   destroyed; use it like a const linked_hashmap through -> and *.
+	 * different threads may read and release snapshots while the map's
+	 *   owner keeps modifying it.
+	 */
+	class snapshot_view {
+	private:
+		share_block *block;
+		explicit snapshot_view(share_block *b) : block(b) {}
+	public:
+		snapshot_view(const snapshot_view &other) : block(other.block) {
+			__atomic_add_fetch(&block->refs, 1, __ATOMIC_RELAXED);
+		}
+		snapshot_view & operator=(const snapshot_view &other) {
+			if (block == other.block) return *this;
+			__atomic_add_fetch(&other.block->refs, 1, __ATOMIC_RELAXED);
+			release(block);
+			block = other.block;
+			return *this;
+		}
+		~snapshot_view() { release(block); }
+		const linked_hashmap & operator*() const { return *block->frozen; }
+		const linked_hashmap * operator->() const { return block->frozen; }
+
+		friend class linked_hashmap;
+	};
+
+	/**
+	 * take a snapshot in O(1). the map as it is becomes the snapshot's,
+	 *   frozen, and the map carries on in a layer of its own on top of it
+	 *   (see base): new elements go into the layer, and erasing an older
+	 *   one is recorded there. an older element is copied, by itself,
+	 *   the first time it is handed out for writing: through an iterator,
+	 *   at(), operator[], for_each() or merge_from() on a non-const map.
+	 *   the snapshot never sees a later change, and the map pays for
+	 *   the elements it changes, not for its size.
+	 * iterators stay valid. references and pointers to values taken
+	 *   before the snapshot must not be used after it: writing through
+	 *   them would change the snapshot.
+	 * an older element is found through the layers, with a probe of a
+	 *   small table per layer. once no snapshot reads a layer any more,
+	 *   the next modification folds it back in, in O(what changed since).
+	 *   while snapshots stay alive, each one taken after a change adds a
+	 *   layer; past MAX_LAYERS the map copies itself flat in O(n), which
+	 *   makes every iterator stale (using one throws invalid_iterator).
+	 * an element written while shared keeps its copy until it is erased
+	 *   or defragment() moves it (see bench/snapshot.cpp).
+	 */
+	snapshot_view snapshot() {
+		detach();
+		if (base != nullptr && num_elements == 0 && shadow_used == 0 && seq_counter == below()->seq_counter
+			&& index_enabled == below()->index_enabled && max_load == below()->max_load) {
+			// nothing changed since the last one
+			__atomic_add_fetch(&base->refs, 1, __ATOMIC_RELAXED);
+			return snapshot_view(base);
+		}
+		if (depth >= MAX_LAYERS) flatten();
+		share_block *block = new share_block;
+		linked_hashmap *frozen;
+		try {
+			frozen = new linked_hashmap(*this, layer_tag());
+		} catch (...) {
+			delete block;
+			throw;
+		}
+		swap_state(*frozen);
+		swap_ends(*frozen);
+		seq_counter = frozen->seq_counter;
+		key_sum = frozen->key_sum;
+		reseed_mark = frozen->reseed_mark;
+		block->frozen = frozen;
+		block->refs = 2;
+		base = block;
+		base_live = frozen->size();
+		depth = frozen->depth + 1;
+		return snapshot_view(block);
 	}
  
 	/**
@@ -296,14 +2382,14 @@ public:
 	 * If no such element exists, an exception of type `index_out_of_bound'
 	 */
 	T & at(const Key &key) {
-		iterator it = find(key);
-		if (it == end()) throw index_out_of_bound();
-		return it->second;
+		LinkNode *node = view_find(key, hasher(key));
+		if (node == nullptr) throw index_out_of_bound();
+		return writable(node)->data.second;
 	}
 	const T & at(const Key &key) const {
-		const_iterator it = find(key);
-		if (it == cend()) throw index_out_of_bound();
-		return it->second;
+		const LinkNode *node = view_find(key, hasher(key));
+		if (node == nullptr) throw index_out_of_bound();
+		return current(node)->data.second;
 	}
  
 	/**
@@ -312,12 +2398,8 @@ public:
 	 * Returns a reference to the value that is mapped to a key equivalent to key,
 	 *   performing an insertion if such key does not already exist.
 	 */
-	T & operator[](const Key &key) {
-		iterator it = find(key);
-		if (it != end()) return it->second;
-		pair<iterator, bool> p = insert(value_type(key, T()));
-		return p.first->second;
-	}
+	T & operator[](const Key &key) { return try_emplace(key).first->second; }
+	T & operator[](Key &&key) { return try_emplace(std::move(key)).first->second; }
  
 	/**
 	 * behave like at() throw index_out_of_bound if such key does not exist.
@@ -329,96 +2411,513 @@ public:
 	/**
 	 * return a iterator to the beginning
 	 */
-	iterator begin() { return iterator(static_cast<LinkNode*>(order_head->order_next), this); }
-	const_iterator cbegin() const { return const_iterator(static_cast<const LinkNode*>(order_head->order_next), this); }
+	iterator begin() {
+		return iterator(view_first(), this);
+	}
+	const_iterator cbegin() const { return const_iterator(view_first(), this); }
  
 	/**
 	 * return a iterator to the end
 	 * in fact, it returns past-the-end.
 	 */
-	iterator end() { return iterator(static_cast<LinkNode*>(order_tail), this); }
+	iterator end() {
+		return iterator(static_cast<LinkNode*>(order_tail), this);
+	}
 	const_iterator cend() const { return const_iterator(static_cast<const LinkNode*>(order_tail), this); }
  
 	/**
 	 * checks whether the container is empty
 	 * return true if empty, otherwise false.
 	 */
-	bool empty() const { return num_elements == 0; }
+	bool empty() const { return size() == 0; }
  
 	/**
 	 * returns the number of elements.
 	 */
-	size_t size() const { return num_elements; }
+	size_t size() const { return num_elements + base_live; }
  
 	/**
 	 * clears the contents
 	 */
 	void clear() {
+		detach();
+		if (base != nullptr) {
+			release(base);
+			base = nullptr;
+			base_live = depth = 0;
+		}
+		shadow_free();
+		rank_free();
 		Node *cur = static_cast<Node*>(order_head->order_next);
 		while (cur != static_cast<Node*>(order_tail)) {
 			Node *nxt = static_cast<Node*>(cur->order_next);
-			delete cur;
+			free_node(cur);
 			cur = nxt;
 		}
+		free_slabs();
 		order_head->order_next = order_tail;
 		order_tail->order_prev = order_head;
-		for (size_t i = 0; i < bucket_capacity; i++) buckets[i] = nullptr;
+		table.clear();
+		skip_used = skip_holes = 0;
 		num_elements = 0;
+		key_sum = 0;
+		if (index_enabled) index_rebuild(slot_capacity);
 	}
  
+private:
+	/**
+	 * the insert behind insert(), try_emplace() and operator[]: find key,
+	 *   and only if it is not there, build a node from args (a Node
+	 *   constructor's tag and arguments, or a ready node that emplace()
+	 *   made) and append it. key may refer into args.
+	 */
+	template<class... Args>
+	pair<iterator, bool> insert_unique(const Key &key, Args &&... args) {
+		detach();
+		size_t hash_code = hasher(key), probe;
+		Node *found = find_node(key, hash_code, &probe);
+		if (found != nullptr) return pair<iterator, bool>(iterator(found, this), false);
+		if (LinkNode *older = below_find(key, hash_code)) return pair<iterator, bool>(iterator(older, this), false);
+
+		bool grown = num_elements + 1 > table.capacity() * max_load;
+		if (grown) rehash();
+		if (index_enabled) index_reserve();
+		skip_reserve(1);
+
+		Node *new_node = make_node(hash_code, std::forward<Args>(args)...);
+		append_node(new_node);
+		if (!grown && probe + 1 >= table_type::PROBE_LIMIT) defend_chain(new_node);
+		return pair<iterator, bool>(iterator(static_cast<LinkNode*>(new_node), this), true);
+	}
+
+	template<class Tag, class... Args>
+	static Node *make_node(size_t hash_code, Tag tag, Args &&... args) { return new Node(tag, hash_code, std::forward<Args>(args)...); }
+	static Node *make_node(size_t hash_code, Node *node) {
+		node->hash_code = hash_code;
+		return node;
+	}
+
+public:
 	/**
 	 * insert an element.
 	 * return a pair, the first of the pair is
 	 *   the iterator to the new element (or the element that prevented the insertion), 
 	 *   the second one is true if insert successfully, or false.
 	 */
-	pair<iterator, bool> insert(const value_type &value) {
-		iterator it = find(value.first);
-		if (it != end()) return pair<iterator, bool>(it, false);
+	pair<iterator, bool> insert(const value_type &value) { return insert_unique(value.first, in_place_tag(), value); }
+	pair<iterator, bool> insert(value_type &&value) { return insert_unique(value.first, in_place_tag(), std::move(value)); }
 
-		if (num_elements + 1 > bucket_capacity * LOAD_FACTOR) rehash();
+	/**
+	 * if key is not there, insert it with a value constructed in place
+	 *   from args; otherwise leave the map (and args) alone.
+	 * return as insert() does.
+	 */
+	template<class... Args>
+	pair<iterator, bool> try_emplace(const Key &key, Args &&... args) {
+		return insert_unique(key, key_args_tag(), key, std::forward<Args>(args)...);
+	}
+	template<class... Args>
+	pair<iterator, bool> try_emplace(Key &&key, Args &&... args) {
+		return insert_unique(key, key_args_tag(), std::move(key), std::forward<Args>(args)...);
+	}
 
-		Node *new_node = new Node(value.first, value.second);
-		size_t idx = get_bucket_index(value.first);
-		new_node->next_in_bucket = buckets[idx];
-		buckets[idx] = new_node;
+	/**
+	 * insert a value_type constructed in place from args (a key and a
+	 *   value, or std::piecewise_construct and two tuples). the element is
+	 *   built before the key can be looked up, and destroyed again if the
+	 *   key is there; try_emplace() builds nothing in that case.
+	 * return as insert() does.
+	 */
+	template<class... Args>
+	pair<iterator, bool> emplace(Args &&... args) {
+		detach();
+		Node *node = new Node(in_place_tag(), 0, std::forward<Args>(args)...);
+		try {
+			pair<iterator, bool> result = insert_unique(node->data.first, node);
+			if (!result.second) delete node;
+			return result;
+		} catch (...) {
+			if (node->order_next == nullptr) delete node;
+			throw;
+		}
+	}
 
-		new_node->order_prev = order_tail->order_prev;
-		new_node->order_next = order_tail;
-		order_tail->order_prev->order_next = new_node;
-		order_tail->order_prev = new_node;
+	/**
+	 * add every element of other to this map, new keys going to the end in
+	 *   other's insertion order. for a key both maps hold, policy decides:
+	 *   merge_keep() keeps our value, merge_overwrite() takes other's, and
+	 *   any other callable f makes it f(ours, theirs).
+	 * the table grows at most once, sized as if no key were shared.
+	 * return the number of keys added.
+	 */
+	template<class Policy>
+	size_t merge_from(const linked_hashmap &other, Policy policy) {
+		detach();
+		reserve_more(other.size());
+		size_t added = 0;
+		for (const LinkNode *p = other.view_first(); p != other.order_tail; p = other.view_next(p)) {
+			const Node *src = other.current(p);
+			size_t hash_code = hash_of(src), probe;
+			LinkNode *found = find_node(src->data.first, hash_code, &probe);
+			if (found == nullptr) found = below_find(src->data.first, hash_code);
+			if (found != nullptr) {
+				if (merge_writes(policy)) merge_value(unshare(found)->data.second, src->data.second, policy);
+				continue;
+			}
+			Node *node = new Node(in_place_tag(), hash_code, src->data);
+			append_node(node);
+			added++;
+			if (probe + 1 >= table_type::PROBE_LIMIT) defend_chain(node);
+		}
+		return added;
+	}
 
-		num_elements++;
-		return pair<iterator, bool>(iterator(static_cast<LinkNode*>(new_node), this), true);
+	/**
+	 * as above, but other's nodes are moved over instead of copied (and
+	 *   values of shared keys moved for merge_overwrite); other is left
+	 *   empty. elements other shares with snapshots (see snapshot()), or
+	 *   has moved into slabs (see defragment()), are copied.
+	 */
+	template<class Policy>
+	size_t merge_from(linked_hashmap &&other, Policy policy) {
+		if (other.size() == 0) return 0;
+		if (&other == this || other.base != nullptr || other.shadow_used != 0 || other.slab.cells != nullptr || other.filling.cells != nullptr) {
+			size_t added = merge_from(static_cast<const linked_hashmap &>(other), policy);
+			if (&other != this) other.clear();
+			return added;
+		}
+		detach();
+		reserve_more(other.num_elements);
+		size_t added = 0;
+		try {
+			while (other.num_elements > 0) {
+				Node *node = static_cast<Node*>(other.order_head->order_next);
+				other.unlink_order(node);
+				other.key_sum -= key_mix(node->hash_code);
+				other.num_elements--;
+				size_t hash_code = hash_of(node), probe;
+				LinkNode *found = find_node(node->data.first, hash_code, &probe);
+				if (found == nullptr) found = below_find(node->data.first, hash_code);
+				try {
+					if (found != nullptr) {
+						if (merge_writes(policy)) merge_value(unshare(found)->data.second, std::move(node->data.second), policy);
+					}
+					else {
+						node->hash_code = hash_code;
+						append_node(node);
+					}
+				} catch (...) {
+					delete node;
+					throw;
+				}
+				if (found != nullptr) {
+					delete node;
+					continue;
+				}
+				added++;
+				if (probe + 1 >= table_type::PROBE_LIMIT) defend_chain(node);
+			}
+		} catch (...) {
+			// other's table still lists the nodes taken so far
+			other.table.rebuild(other.order_head->order_next, other.order_tail, other.table.capacity());
+			if (other.index_enabled) other.index_rebuild(other.slot_capacity);
+			throw;
+		}
+		other.table.clear();
+		if (other.index_enabled) other.index_rebuild(other.slot_capacity);
+		return added;
 	}
- 
+
 	/**
 	 * erase the element at pos.
+	 * return an iterator to the element that followed pos in insertion order.
 	 *
 	 * throw if pos pointed to a bad element (pos == this->end() || pos points an element out of this)
 	 */
-	void erase(iterator pos) {
-		if (pos.map_ptr != this || pos.node == nullptr) throw invalid_iterator();
+	iterator erase(iterator pos) {
+		if (pos.map_ptr != this || pos.stale()) throw invalid_iterator();
 		if (pos.node == order_tail || pos.node == order_head) throw invalid_iterator();
+		detach(&pos.node, 1);
+
+		LinkNode *next = view_next(pos.node);
+		erase_element(pos.node);
+		return iterator(next, this);
+	}
+
+	/**
+	 * erase the element with key equivalent to key, if any.
+	 * return the number of elements removed (0 or 1).
+	 */
+	size_t erase(const Key &key) {
+		detach();
+		LinkNode *node = view_find(key, hasher(key));
+		if (node == nullptr) return 0;
+		erase_element(node);
+		return 1;
+	}
+ 
+	/**
+	 * erase the elements in [first, last), in insertion order.
+	 * return last.
+	 *
+	 * throw invalid_iterator if the iterators are not from this map,
+	 *   or if last does not follow first.
+	 */
+	iterator erase(iterator first, iterator last) {
+		if (first.map_ptr != this || last.map_ptr != this || first.stale() || last.stale()) throw invalid_iterator();
+		if (first.node == order_head || last.node == order_head) throw invalid_iterator();
+		LinkNode *range[2] = {first.node, last.node};
+		detach(range, 2);
+		first.node = range[0];
+		last.node = range[1];
+		size_t count = 0;
+		for (LinkNode *p = first.node; p != last.node; p = view_next(p)) {
+			if (p == order_tail) throw invalid_iterator();
+			count++;
+		}
+		if (base == nullptr) erase_range(first.node, last.node, count);
+		else erase_view(first.node, count);
+		return iterator(last.node, this);
+	}
 
-		Node *cur = static_cast<Node*>(pos.node);
-		size_t idx = get_bucket_index(cur->data.first);
-		Node *prev = nullptr;
-		Node *p = buckets[idx];
-		while (p != cur) {
-			prev = p;
-			p = p->next_in_bucket;
+	/**
+	 * erase the n oldest elements (all of them if there are fewer).
+	 * return the number of elements removed.
+	 */
+	size_t pop_front(size_t n) {
+		detach();
+		if (n >= size()) {
+			n = size();
+			clear();
+			return n;
 		}
-		if (prev) prev->next_in_bucket = cur->next_in_bucket;
-		else buckets[idx] = cur->next_in_bucket;
+		if (base != nullptr) {
+			erase_view(view_first(), n);
+			return n;
+		}
+		LinkNode *last = order_head->order_next;
+		for (size_t i = 0; i < n; i++) last = last->order_next;
+		erase_range(order_head->order_next, last, n);
+		return n;
+	}
 
-		cur->order_prev->order_next = cur->order_next;
-		cur->order_next->order_prev = cur->order_prev;
+	/**
+	 * keep only the elements for which pred(value) returns true.
+	 * walks the insertion order once; removed elements are unlinked from
+	 * the table without being hashed again and freed together (on a
+	 * layered map, see snapshot(), they are erased one by one).
+	 * return the number of elements removed.
+	 */
+	template<class Pred>
+	size_t retain(Pred pred) {
+		detach();
+		size_t count = 0;
+		if (base != nullptr) {
+			for (LinkNode *cur = view_first(); cur != order_tail;) {
+				LinkNode *next = view_next(cur);
+				if (!keeps(pred, cur, 0)) {
+					erase_element(cur);
+					count++;
+				}
+				cur = next;
+			}
+			return count;
+		}
+		LinkNode *removed = nullptr;
+		try {
+			LinkNode *cur = order_head->order_next;
+			while (cur != order_tail) {
+				LinkNode *next = cur->order_next;
+				if (!pred(unshare(cur)->data)) {
+					unlink_order(cur);
+					cur->order_next = removed;
+					removed = cur;
+					count++;
+				}
+				cur = next;
+			}
+		} catch (...) {
+			release_detached(removed, count);
+			throw;
+		}
+		release_detached(removed, count);
+		return count;
+	}
 
-		delete cur;
-		num_elements--;
+	/**
+	 * the table grows (doubling) before size() would exceed
+	 *   max_load_factor() times its capacity. the default depends on the
+	 *   storage policy: 0.75 for chains, 0.9 for robin_hood_storage.
+	 * setting it grows the table right away if needed.
+	 * throw runtime_error unless 0 < ml <= the policy's limit (below 1 for
+	 *   open addressing, which needs a free slot to end every probe).
+	 */
+	double max_load_factor() const { return max_load; }
+	void max_load_factor(double ml) {
+		if (!(ml > 0) || ml > table_type::max_load_factor_limit()) throw runtime_error();
+		detach();
+		size_t capacity = table.capacity();
+		while (num_elements > capacity * ml) capacity *= 2;
+		if (capacity != table.capacity()) table.rebuild(order_head->order_next, order_tail, capacity);
+		max_load = ml;
 	}
- 
+	double load_factor() const { return num_elements == 0 ? 0 : (double)num_elements / table.capacity(); }
+
+	/**
+	 * move nodes into one fresh block of memory in insertion order, so
+	 *   that iteration and rehashing walk memory forwards instead of
+	 *   jumping around the heap after heavy churn.
+	 * a pass moves at most budget nodes per call, in insertion order;
+	 *   call again to continue it, with the map modified in between if
+	 *   need be. it covers the elements there were when it started,
+	 *   plus later ones while room is left. the block the previous pass
+	 *   filled is released when a pass ends; memory of elements erased
+	 *   from a block only comes back then, or on clear().
+	 * every iterator to a node that is moved is invalidated, except the
+	 *   ones in keep[], which are redirected to it. a map still layered
+	 *   on a snapshot (see snapshot()) is first copied flat, which makes
+	 *   every other iterator stale; an element copied on write is moved
+	 *   from its copy, and the copy freed.
+	 * return true once the pass is over (and false if budget ran out).
+	 */
+	bool defragment(size_t budget = size_t(-1), iterator *keep = nullptr, size_t keep_count = 0) {
+		for (size_t i = 0; i < keep_count; i++)
+			if (keep[i].map_ptr != this || keep[i].stale()) throw invalid_iterator();
+		LinkNode **kept = keep_count > 0 ? new LinkNode*[keep_count] : nullptr;
+		for (size_t i = 0; i < keep_count; i++) kept[i] = keep[i].node;
+		try {
+			detach(kept, keep_count);
+			if (base != nullptr) flatten(kept, keep_count);
+			if (defrag_next == nullptr) {
+				if (num_elements == 0) {
+					delete[] kept;
+					return true;
+				}
+				filling.raw = new unsigned char[num_elements * sizeof(Node) + alignof(Node)];
+				size_t misalign = (size_t)filling.raw % alignof(Node);
+				filling.cells = filling.raw + (misalign ? alignof(Node) - misalign : 0);
+				filling.capacity = num_elements;
+				filling.used = 0;
+				defrag_next = order_head->order_next;
+			}
+			for (; budget > 0 && defrag_next != order_tail && filling.used < filling.capacity; budget--) {
+				Node *old = static_cast<Node*>(defrag_next);
+				__builtin_prefetch(old->order_next);
+				shadow_entry *copied = shadow_find(old);
+				Node *source = copied != nullptr ? copied->to : old;
+				Node *node = new (filling.cells + filling.used * sizeof(Node)) Node(in_place_tag(), old->hash_code, std::move(source->data));
+				filling.used++;
+				node->seq = old->seq;
+				if (starts_chunk(old)) {
+					skip_entry *entry = skip_find(old);
+					if (entry != nullptr) entry->first = node;
+				}
+				table.erase(old);
+				table.insert(node);
+				if (index_enabled) order_slots[seq_slot(old->seq)] = node;
+				node->order_prev = old->order_prev;
+				node->order_next = old->order_next;
+				node->order_prev->order_next = node;
+				node->order_next->order_prev = node;
+				defrag_next = node->order_next;
+				for (size_t i = 0; i < keep_count; i++)
+					if (kept[i] == old) kept[i] = node;
+				if (copied != nullptr) shadow_drop(old);
+				free_node(old);
+			}
+		} catch (...) {
+			delete[] kept;
+			throw;
+		}
+		for (size_t i = 0; i < keep_count; i++) keep[i] = iterator(kept[i], this);
+		delete[] kept;
+		if (defrag_next != order_tail && filling.used < filling.capacity) return false;
+		delete[] slab.raw;
+		slab = filling;
+		filling = node_slab{nullptr, nullptr, 0, 0};
+		defrag_next = nullptr;
+		return true;
+	}
+
+	/**
+	 * turn indexed mode on or off.
+	 * in indexed mode the map keeps an order-statistic index over the
+	 *   insertion order, making nth(), position_of() and iterate_from_seq()
+	 *   O(log n) at the cost of O(log n) insert and erase and three words
+	 *   per slot of the index: one slot per element, plus the free room
+	 *   and the holes erases leave until the slots are renumbered (see
+	 *   index_reserve). nodes hold nothing for it, so a map that is not
+	 *   indexed does not pay for it.
+	 * without it nth() and position_of() are O(n) walks of the order list.
+	 * a map layered on a snapshot (see snapshot()) only indexes its own
+	 *   layer; the layers below keep the mode they were frozen in, and
+	 *   positions in them are O(log^2 n) if they are indexed too.
+	 */
+	void set_indexed(bool enable) {
+		if (enable == index_enabled) return;
+		detach();
+		if (enable) {
+			size_t capacity = INIT_CAPACITY;
+			while (capacity < num_elements * 2) capacity *= 2;
+			index_rebuild(capacity);
+		} else {
+			index_free();
+		}
+		index_enabled = enable;
+	}
+	bool indexed() const { return index_enabled; }
+
+	/**
+	 * return an iterator to the k-th (0-based) element in insertion order.
+	 * throw index_out_of_bound if k >= size().
+	 */
+	iterator nth(size_t k) {
+		return iterator(const_cast<LinkNode*>(nth_node(k)), this);
+	}
+	const_iterator nth(size_t k) const {
+		return const_iterator(nth_node(k), this);
+	}
+
+	/**
+	 * return the 0-based insertion-order position of the element at it,
+	 *   or size() for end().
+	 * throw invalid_iterator if it does not belong to this map.
+	 */
+	size_t position_of(const const_iterator &it) const {
+		if (it.map_ptr != this || it.stale() || it.node == order_head) throw invalid_iterator();
+		if (it.node == order_tail) return size();
+		return view_position(it.node);
+	}
+
+	/**
+	 * return the insertion sequence number of the element at it.
+	 * every successful insert stamps the next number of a 64-bit counter
+	 *   that only grows over the lifetime of the map (clear() included).
+	 * throw invalid_iterator if it is end() or not from this map.
+	 */
+	unsigned long long seq(const const_iterator &it) const {
+		if (it.map_ptr != this || it.stale() || it.node == order_head || it.node == order_tail) throw invalid_iterator();
+		return static_cast<const Node*>(it.node)->seq;
+	}
+
+	/**
+	 * return the sequence number of the most recent insert, 0 if none.
+	 */
+	unsigned long long last_seq() const { return seq_counter; }
+
+	/**
+	 * return an iterator to the oldest element whose sequence number is
+	 *   at least s, or end() if there is none. a consumer that remembers
+	 *   last_seq() can resume with iterate_from_seq(last + 1) and walk to
+	 *   end() to see exactly the elements inserted since.
+	 */
+	iterator iterate_from_seq(unsigned long long s) {
+		return iterator(const_cast<LinkNode*>(seq_lower_bound(s)), this);
+	}
+	const_iterator iterate_from_seq(unsigned long long s) const {
+		return const_iterator(seq_lower_bound(s), this);
+	}
+
 	/**
 	 * Returns the number of elements with key 
 	 *   that compares equivalent to the specified argument,
@@ -434,27 +2933,138 @@ public:
 	 *   If no such element is found, past-the-end (see end()) iterator is returned.
 	 */
 	iterator find(const Key &key) {
-		size_t idx = get_bucket_index(key);
-		Node *p = buckets[idx];
-		while (p != nullptr) {
-			if (key_equal(p->data.first, key)) return iterator(p, this);
-			p = p->next_in_bucket;
-		}
-		return end();
+		LinkNode *p = view_find(key, hasher(key));
+		return p ? iterator(p, this) : end();
 	}
 	const_iterator find(const Key &key) const {
-		size_t idx = get_bucket_index(key);
-		Node *p = buckets[idx];
-		while (p != nullptr) {
-			if (key_equal(p->data.first, key)) return const_iterator(p, this);
-			p = p->next_in_bucket;
+		const LinkNode *p = view_find(key, hasher(key));
+		return p ? const_iterator(p, this) : cend();
+	}
+
+	/**
+	 * call f(value) for every element in insertion order, like a loop
+	 *   from begin() to end(), but prefetching elements a few places
+	 *   ahead, so that a map whose nodes lie scattered over the heap is
+	 *   not walked one cache miss at a time. f must not insert or erase.
+	 * the elements of a layered map that the layers below hold are
+	 *   walked one at a time, and on a non-const map copied when a
+	 *   snapshot shares them (see snapshot()).
+	 */
+	template<class F>
+	void for_each(F f) {
+		detach();
+		walk_view([&](const LinkNode *node) { f(unshare(node)->data); });
+	}
+	template<class F>
+	void for_each(F f) const {
+		walk_view([&](const LinkNode *node) { f(static_cast<const value_type &>(current(node)->data)); });
+	}
+
+	/**
+	 * the table seen as buckets. with chained_storage they are the
+	 *   chains; with open addressing each slot is a bucket holding at
+	 *   most one element (a cuckoo_storage bucket holds four), and a
+	 *   stash, where the policy has one, is one more bucket at the end.
+	 * bucket(key) is the bucket key is placed in first: open addressing
+	 *   may hold it a few buckets further on, or in the other cuckoo
+	 *   bucket or the stash.
+	 * the buckets are numbered by a hash of the key alone, so a range of
+	 *   them is a range of hash values; every insert or erase may move
+	 *   elements between buckets.
+	 * a map layered on a snapshot (see snapshot()) numbers the buckets of
+	 *   its own table first, then those of the layers below.
+	 */
+	size_t bucket_count() const { return table.bucket_count() + (base != nullptr ? below()->bucket_count() : 0); }
+	size_t bucket_size(size_t n) const {
+		if (n >= bucket_count()) throw index_out_of_bound();
+		size_t count = 0;
+		for (const Node *p = bucket_first_node(n); p != nullptr; p = bucket_next_node(p, n)) count++;
+		return count;
+	}
+	size_t bucket(const Key &key) const { return bucket_in_view(key, hasher(key)); }
+
+	/**
+	 * the elements held by buckets [first, last); throw
+	 *   index_out_of_bound if last > bucket_count() or first > last.
+	 */
+	bucket_range buckets(size_t first, size_t last) const {
+		if (first > last || last > bucket_count()) throw index_out_of_bound();
+		return bucket_range(this, first, last);
+	}
+	bucket_range buckets(size_t n) const { return buckets(n, n + 1); }
+
+	/**
+	 * split the buckets into k disjoint ranges that together hold every
+	 *   element, so that k threads can each scan one while nobody
+	 *   modifies the map. nothing is allocated or copied.
+	 * throw runtime_error if k is 0.
+	 */
+	bucket_partition partition(size_t k) const {
+		if (k == 0) throw runtime_error();
+		return bucket_partition(this, k);
+	}
+
+	/**
+	 * an O(1) fingerprint of the set of keys, kept up to date by every
+	 *   insert and erase: a sum of mixed hash codes, so it does not depend
+	 *   on insertion order. maps holding the same keys have the same
+	 *   fingerprint as long as their hashers agree, which holds for a
+	 *   hasher without state and for copies of one map (seeded_hash
+	 *   draws a seed per map, and a reseed changes the fingerprint).
+	 * it covers keys only and says nothing about values, which change
+	 *   through references the map never sees: two maps with equal
+	 *   fingerprints may still differ in any value, so use operator== to
+	 *   tell whether a map changed.
+	 */
+	size_t key_fingerprint() const { return key_sum; }
+
+	/**
+	 * true if both maps hold the same keys with equal (by operator==)
+	 *   values, whatever their insertion order.
+	 * sizes are compared first, then key fingerprints when the hasher has no
+	 *   state; other is probed for each of our keys with the cached hash
+	 *   code where that is valid there.
+	 */
+	bool operator==(const linked_hashmap &other) const {
+		if (this == &other) return true;
+		if (size() != other.size()) return false;
+		if (STATELESS_HASH && key_sum != other.key_sum) return false;
+		for (const LinkNode *p = view_first(); p != order_tail; p = view_next(p)) {
+			const Node *node = current(p);
+			const LinkNode *found = find_in(other, node);
+			if (found == nullptr || !(other.current(found)->data.second == node->data.second)) return false;
 		}
-		return cend();
+		return true;
+	}
+	bool operator!=(const linked_hashmap &other) const { return !(*this == other); }
+
+	/**
+	 * true if both maps hold equal keys with equal values in the same
+	 *   insertion order; the two order lists are walked side by side.
+	 */
+	bool equal_in_order(const linked_hashmap &other) const {
+		if (this == &other) return true;
+		if (size() != other.size()) return false;
+		if (STATELESS_HASH && key_sum != other.key_sum) return false;
+		const LinkNode *q = other.view_first();
+		for (const LinkNode *p = view_first(); p != order_tail; p = view_next(p), q = other.view_next(q)) {
+			const Node *a = current(p), *b = other.current(q);
+			if (STATELESS_HASH && a->hash_code != b->hash_code) return false;
+			if (!key_equal(a->data.first, b->data.first) || !(a->data.second == b->data.second)) return false;
+		}
+		return true;
 	}
 };
 
-template<class Key, class T, class Hash, class Equal>
-const double linked_hashmap<Key, T, Hash, Equal>::LOAD_FACTOR = 0.75;
+/**
+ * erase every element of map for which pred(value) returns true.
+ * return the number of elements removed.
+ */
+template<class Key, class T, class Hash, class Equal, class Storage, class Pred>
+size_t erase_if(linked_hashmap<Key, T, Hash, Equal, Storage> &map, Pred pred) {
+	// a generic lambda, so that retain() sees whether pred takes a const value
+	return map.retain([&pred](auto &value) -> decltype(!pred(value)) { return !pred(value); });
+}
 
 }
 
@@ -0,0 +1,540 @@
+/**
+ * implement an immutable, structurally shared linked_hashmap
+ */
+#ifndef SJTU_PERSISTENT_LINKEDHASHMAP_HPP
+#define SJTU_PERSISTENT_LINKEDHASHMAP_HPP
+
+// only for std::equal_to<T> and std::hash<T>
+#include <functional>
+#include <cstddef>
+#include "utility.hpp"
+#include "exceptions.hpp"
+
+namespace sjtu {
+    /**
+     * persistent_linked_hashmap never changes once built: with() and
+     * without() return new versions in O(log n) and leave the old one
+     * intact. Versions share every part they have in common, so N
+     * versions with small differences cost about O(N log n) memory
+     * instead of N full copies. Copying a version is O(1).
+     *
+     * Keys are found through a hash array mapped trie (HAMT) consuming
+     * 5 bits of the hash per level. Insertion order is kept by a second,
+     * sparse trie keyed by each entry's insertion sequence number, which
+     * is walked in key order to iterate. As in linked_hashmap, replacing
+     * the value of an existing key does not change its position.
+     *
+     * Versions may be read, copied and destroyed from several threads.
+     */
+template<
+	class Key,
+	class T,
+	class Hash = std::hash<Key>,
+	class Equal = std::equal_to<Key>
+> class persistent_linked_hashmap {
+public:
+	typedef pair<const Key, T> value_type;
+
+private:
+	static const size_t BITS = 5;
+	static const size_t WIDTH = 1 << BITS;
+	static const size_t HASH_BITS = sizeof(size_t) * 8;
+	static const size_t MAX_DEPTH = (64 + BITS - 1) / BITS;
+
+	struct entry {
+		value_type data;
+		size_t hash_code;
+		unsigned long long seq;
+		long refs;
+		entry(const Key &k, const T &v, size_t h, unsigned long long s) : data(k, v), hash_code(h), seq(s), refs(1) {}
+	};
+
+	struct trie_node;
+	/**
+	 * a child slot: an entry, or a deeper node.
+	 */
+	struct child {
+		entry *leaf;
+		trie_node *sub;
+	};
+	/**
+	 * a trie level. bitmap has a bit set for every occupied one of the 32
+	 * branches and children holds them packed in branch order. nodes past
+	 * the last hash bits are collision nodes: bitmap is 0 and children
+	 * lists entries whose hashes are all equal.
+	 */
+	struct trie_node {
+		long refs;
+		unsigned int bitmap;
+		size_t count;
+		child *children;
+		trie_node(unsigned int bm, size_t n) : refs(1), bitmap(bm), count(n), children(n ? new child[n] : nullptr) {}
+		~trie_node() { delete[] children; }
+	};
+
+	trie_node *key_root;
+	trie_node *seq_root;
+	size_t seq_height;
+	size_t num_elements;
+	unsigned long long seq_counter;
+	Hash hasher;
+	Equal key_equal;
+
+	static void retain(entry *e) { __atomic_add_fetch(&e->refs, 1, __ATOMIC_RELAXED); }
+	static void retain(trie_node *n) { if (n) __atomic_add_fetch(&n->refs, 1, __ATOMIC_RELAXED); }
+	static void release(entry *e) {
+		if (__atomic_sub_fetch(&e->refs, 1, __ATOMIC_ACQ_REL) == 0) delete e;
+	}
+	static void release(trie_node *n) {
+		if (n == nullptr || __atomic_sub_fetch(&n->refs, 1, __ATOMIC_ACQ_REL) != 0) return;
+		for (size_t i = 0; i < n->count; i++) release(n->children[i]);
+		delete n;
+	}
+
+	static unsigned int branch(unsigned long long bits, size_t shift) {
+		return shift < 64 ? (unsigned int)((bits >> shift) & (WIDTH - 1)) : 0;
+	}
+	static size_t slot_of(unsigned int bitmap, unsigned int bit) {
+		return __builtin_popcount(bitmap & ((1u << bit) - 1));
+	}
+
+	static void retain(const child &c) {
+		if (c.leaf) retain(c.leaf);
+		else retain(c.sub);
+	}
+	static void release(const child &c) {
+		if (c.leaf) release(c.leaf);
+		else release(c.sub);
+	}
+
+	/**
+	 * copy n's children into a node with a gap at pos for the caller to
+	 *   fill (or, with remove, without the child at pos), retaining every
+	 *   shared child.
+	 */
+	static trie_node *copy_node(const trie_node *n, unsigned int bitmap, size_t pos, bool remove) {
+		trie_node *copy = new trie_node(bitmap, remove ? n->count - 1 : n->count + 1);
+		for (size_t i = 0, j = 0; i < n->count; i++, j++) {
+			if (i == pos) {
+				if (remove) {
+					j--;
+					continue;
+				}
+				j++;
+			}
+			copy->children[j] = n->children[i];
+			retain(copy->children[j]);
+		}
+		return copy;
+	}
+	/**
+	 * copy n, retaining every child except the one at pos, which the
+	 *   caller is about to overwrite.
+	 */
+	static trie_node *clone_node(const trie_node *n, size_t pos) {
+		trie_node *copy = new trie_node(n->bitmap, n->count);
+		for (size_t i = 0; i < n->count; i++) {
+			copy->children[i] = n->children[i];
+			if (i != pos) retain(copy->children[i]);
+		}
+		return copy;
+	}
+
+	static child leaf_child(entry *e) { child c = {e, nullptr}; return c; }
+	static child node_child(trie_node *n) { child c = {nullptr, n}; return c; }
+
+	/**
+	 * copy n with fresh in place of the child at pos, the copy taking
+	 *   over the reference fresh holds. if the copy cannot be made,
+	 *   fresh is released, so a path copied below is not lost.
+	 */
+	static trie_node *with_child(const trie_node *n, size_t pos, const child &fresh) {
+		trie_node *copy;
+		try {
+			copy = clone_node(n, pos);
+		} catch (...) {
+			release(fresh);
+			throw;
+		}
+		copy->children[pos] = fresh;
+		return copy;
+	}
+
+	const entry *find_entry(const Key &key, size_t hash_code) const {
+		const trie_node *n = key_root;
+		for (size_t shift = 0; n != nullptr; shift += BITS) {
+			if (shift >= HASH_BITS) {
+				for (size_t i = 0; i < n->count; i++)
+					if (key_equal(n->children[i].leaf->data.first, key)) return n->children[i].leaf;
+				return nullptr;
+			}
+			unsigned int bit = branch(hash_code, shift);
+			if (!(n->bitmap & (1u << bit))) return nullptr;
+			const child &c = n->children[slot_of(n->bitmap, bit)];
+			if (c.leaf) return key_equal(c.leaf->data.first, key) ? c.leaf : nullptr;
+			n = c.sub;
+		}
+		return nullptr;
+	}
+
+	/**
+	 * a node holding just a and b (retaining both), which collide on
+	 *   every bit before shift.
+	 */
+	static trie_node *pair_node(entry *a, entry *b, size_t shift) {
+		if (shift >= HASH_BITS) {
+			trie_node *n = new trie_node(0, 2);
+			n->children[0] = leaf_child(a);
+			n->children[1] = leaf_child(b);
+			retain(a);
+			retain(b);
+			return n;
+		}
+		unsigned int ba = branch(a->hash_code, shift), bb = branch(b->hash_code, shift);
+		if (ba == bb) {
+			trie_node *inner = pair_node(a, b, shift + BITS), *n;
+			try {
+				n = new trie_node(1u << ba, 1);
+			} catch (...) {
+				release(inner);
+				throw;
+			}
+			n->children[0] = node_child(inner);
+			return n;
+		}
+		trie_node *n = new trie_node((1u << ba) | (1u << bb), 2);
+		n->children[ba < bb ? 0 : 1] = leaf_child(a);
+		n->children[ba < bb ? 1 : 0] = leaf_child(b);
+		retain(a);
+		retain(b);
+		return n;
+	}
+
+	/**
+	 * path-copy n with e added (and retained), or with e replacing the
+	 *   entry of the same key (which is then returned through replaced).
+	 * every level copies its node only once the level below has been
+	 *   built, so a throw on the way leaves nothing to undo above it.
+	 */
+	trie_node *key_assoc(const trie_node *n, size_t shift, entry *e, entry *&replaced) const {
+		if (n == nullptr) {
+			trie_node *leaf = new trie_node(1u << branch(e->hash_code, shift), 1);
+			leaf->children[0] = leaf_child(e);
+			retain(e);
+			return leaf;
+		}
+		if (shift >= HASH_BITS) {
+			size_t i = 0;
+			while (i < n->count && !key_equal(n->children[i].leaf->data.first, e->data.first)) i++;
+			trie_node *copy = i < n->count ? clone_node(n, i) : copy_node(n, 0, n->count, false);
+			if (i < n->count) replaced = n->children[i].leaf;
+			copy->children[i] = leaf_child(e);
+			retain(e);
+			return copy;
+		}
+		unsigned int bit = branch(e->hash_code, shift);
+		size_t pos = slot_of(n->bitmap, bit);
+		if (!(n->bitmap & (1u << bit))) {
+			trie_node *copy = copy_node(n, n->bitmap | (1u << bit), pos, false);
+			copy->children[pos] = leaf_child(e);
+			retain(e);
+			return copy;
+		}
+		const child &c = n->children[pos];
+		if (c.sub) return with_child(n, pos, node_child(key_assoc(c.sub, shift + BITS, e, replaced)));
+		if (!key_equal(c.leaf->data.first, e->data.first))
+			return with_child(n, pos, node_child(pair_node(c.leaf, e, shift + BITS)));
+		retain(e);
+		trie_node *copy = with_child(n, pos, leaf_child(e));
+		replaced = c.leaf;
+		return copy;
+	}
+
+	/**
+	 * path-copy n without the entry of key, returned through removed.
+	 * returns n itself (with a new reference) when the key is absent, and
+	 *   nullptr when the node ends up empty.
+	 */
+	trie_node *key_dissoc(trie_node *n, size_t shift, const Key &key, size_t hash_code, entry *&removed) const {
+		size_t pos = 0;
+		if (shift >= HASH_BITS) {
+			while (pos < n->count && !key_equal(n->children[pos].leaf->data.first, key)) pos++;
+			if (pos == n->count) {
+				retain(n);
+				return n;
+			}
+			trie_node *copy = n->count == 1 ? nullptr : copy_node(n, 0, pos, true);
+			removed = n->children[pos].leaf;
+			return copy;
+		}
+		unsigned int bit = branch(hash_code, shift);
+		if (!(n->bitmap & (1u << bit))) {
+			retain(n);
+			return n;
+		}
+		pos = slot_of(n->bitmap, bit);
+		const child &c = n->children[pos];
+		if (c.leaf) {
+			if (!key_equal(c.leaf->data.first, key)) {
+				retain(n);
+				return n;
+			}
+			trie_node *copy = n->count == 1 ? nullptr : copy_node(n, n->bitmap & ~(1u << bit), pos, true);
+			removed = c.leaf;
+			return copy;
+		}
+		trie_node *sub = key_dissoc(c.sub, shift + BITS, key, hash_code, removed);
+		if (removed == nullptr) {
+			release(sub);
+			retain(n);
+			return n;
+		}
+		if (sub == nullptr) return n->count == 1 ? nullptr : copy_node(n, n->bitmap & ~(1u << bit), pos, true);
+		return with_child(n, pos, node_child(sub));
+	}
+
+	/**
+	 * path-copy the order trie below n (covering 5 * level bits of seq)
+	 *   with e stored under e->seq, replacing whatever was there.
+	 */
+	static trie_node *seq_assoc(const trie_node *n, size_t level, entry *e) {
+		unsigned int bit = branch(e->seq, level * BITS);
+		bool present = n != nullptr && (n->bitmap & (1u << bit));
+		size_t pos = n == nullptr ? 0 : slot_of(n->bitmap, bit);
+		// the level below first, as in key_assoc
+		child fresh;
+		if (level == 0) {
+			retain(e);
+			fresh = leaf_child(e);
+		} else {
+			fresh = node_child(seq_assoc(present ? n->children[pos].sub : nullptr, level - 1, e));
+		}
+		if (present) return with_child(n, pos, fresh);
+		trie_node *copy;
+		try {
+			copy = n == nullptr ? new trie_node(1u << bit, 1) : copy_node(n, n->bitmap | (1u << bit), pos, false);
+		} catch (...) {
+			release(fresh);
+			throw;
+		}
+		copy->children[pos] = fresh;
+		return copy;
+	}
+
+	/**
+	 * path-copy the order trie below n without seq; nullptr if it empties.
+	 */
+	static trie_node *seq_dissoc(const trie_node *n, size_t level, unsigned long long seq) {
+		unsigned int bit = branch(seq, level * BITS);
+		size_t pos = slot_of(n->bitmap, bit);
+		trie_node *sub = level == 0 ? nullptr : seq_dissoc(n->children[pos].sub, level - 1, seq);
+		if (sub == nullptr) return n->count == 1 ? nullptr : copy_node(n, n->bitmap & ~(1u << bit), pos, true);
+		return with_child(n, pos, node_child(sub));
+	}
+
+	persistent_linked_hashmap(trie_node *keys, trie_node *seqs, size_t height, size_t n, unsigned long long counter, const Hash &h, const Equal &eq)
+		: key_root(keys), seq_root(seqs), seq_height(height), num_elements(n), seq_counter(counter), hasher(h), key_equal(eq) {}
+
+public:
+	/**
+	 * iterates in insertion order; stays valid as long as the version it
+	 *   came from is alive, since it walks that version's trie nodes.
+	 */
+	class const_iterator {
+	private:
+		const trie_node *path[MAX_DEPTH + 1];
+		size_t pos[MAX_DEPTH + 1];
+		size_t depth;
+		const entry *cur;
+		const persistent_linked_hashmap *map_ptr;
+
+		/**
+		 * descend from path[depth - 1] along first children to a leaf.
+		 */
+		void descend() {
+			while (true) {
+				const child &c = path[depth - 1]->children[pos[depth - 1]];
+				if (c.leaf) {
+					cur = c.leaf;
+					return;
+				}
+				path[depth] = c.sub;
+				pos[depth] = 0;
+				depth++;
+			}
+		}
+	public:
+		using difference_type = std::ptrdiff_t;
+		using value_type = typename persistent_linked_hashmap::value_type;
+		using pointer = const value_type*;
+		using reference = const value_type&;
+		using iterator_category = std::forward_iterator_tag;
+
+		const_iterator() : depth(0), cur(nullptr), map_ptr(nullptr) {}
+
+		const_iterator & operator++() {
+			if (map_ptr == nullptr || cur == nullptr) throw invalid_iterator();
+			while (depth > 0 && ++pos[depth - 1] == path[depth - 1]->count) depth--;
+			if (depth == 0) cur = nullptr;
+			else descend();
+			return *this;
+		}
+		const_iterator operator++(int) {
+			const_iterator tmp = *this;
+			++*this;
+			return tmp;
+		}
+		const value_type & operator*() const {
+			if (cur == nullptr) throw invalid_iterator();
+			return cur->data;
+		}
+		const value_type * operator->() const noexcept { return &cur->data; }
+		bool operator==(const const_iterator &rhs) const { return cur == rhs.cur && map_ptr == rhs.map_ptr; }
+		bool operator!=(const const_iterator &rhs) const { return !(*this == rhs); }
+
+		friend class persistent_linked_hashmap;
+	};
+
+	persistent_linked_hashmap() : key_root(nullptr), seq_root(nullptr), seq_height(0), num_elements(0), seq_counter(0) {}
+	persistent_linked_hashmap(const persistent_linked_hashmap &other)
+		: key_root(other.key_root), seq_root(other.seq_root), seq_height(other.seq_height),
+		  num_elements(other.num_elements), seq_counter(other.seq_counter), hasher(other.hasher), key_equal(other.key_equal) {
+		retain(key_root);
+		retain(seq_root);
+	}
+	persistent_linked_hashmap & operator=(const persistent_linked_hashmap &other) {
+		if (this == &other) return *this;
+		retain(other.key_root);
+		retain(other.seq_root);
+		release(key_root);
+		release(seq_root);
+		key_root = other.key_root;
+		seq_root = other.seq_root;
+		seq_height = other.seq_height;
+		num_elements = other.num_elements;
+		seq_counter = other.seq_counter;
+		hasher = other.hasher;
+		key_equal = other.key_equal;
+		return *this;
+	}
+	~persistent_linked_hashmap() {
+		release(key_root);
+		release(seq_root);
+	}
+
+	/**
+	 * return a version in which key maps to value. a new key goes to the
+	 *   end of the insertion order; an existing one keeps its position.
+	 */
+	persistent_linked_hashmap with(const Key &key, const T &value) const {
+		size_t hash_code = hasher(key);
+		const entry *old = find_entry(key, hash_code);
+		entry *e = new entry(key, value, hash_code, old ? old->seq : seq_counter + 1);
+		// both tries retain e; the reference new gave is dropped at the end
+		size_t height = seq_root ? seq_height : 1;
+		trie_node *seqs = seq_root, *new_seqs = nullptr, *keys;
+		entry *replaced = nullptr;
+		retain(seqs);
+		try {
+			// grow the order trie by a level whenever seq outgrows it
+			while (height < MAX_DEPTH && (e->seq >> (height * BITS)) != 0) {
+				if (seqs != nullptr) {
+					trie_node *grown = new trie_node(1, 1);
+					grown->children[0] = node_child(seqs);
+					seqs = grown;
+				}
+				height++;
+			}
+			new_seqs = seq_assoc(seqs, height - 1, e);
+			keys = key_assoc(key_root, 0, e, replaced);
+		} catch (...) {
+			release(seqs);
+			release(new_seqs);
+			release(e);
+			throw;
+		}
+		release(seqs);
+		release(e);
+		return persistent_linked_hashmap(keys, new_seqs, height, num_elements + (replaced ? 0 : 1),
+			replaced ? seq_counter : e->seq, hasher, key_equal);
+	}
+
+	/**
+	 * return a version without key (this version again if it is absent).
+	 */
+	persistent_linked_hashmap without(const Key &key) const {
+		if (key_root == nullptr) return *this;
+		entry *removed = nullptr;
+		trie_node *keys = key_dissoc(key_root, 0, key, hasher(key), removed);
+		if (removed == nullptr) {
+			release(keys);
+			return *this;
+		}
+		// removed stays alive through this version's tries meanwhile
+		trie_node *seqs;
+		try {
+			seqs = seq_dissoc(seq_root, seq_height - 1, removed->seq);
+		} catch (...) {
+			release(keys);
+			throw;
+		}
+		return persistent_linked_hashmap(keys, seqs, seqs ? seq_height : 0, num_elements - 1, seq_counter, hasher, key_equal);
+	}
+
+	/**
+	 * access specified element with bounds checking.
+	 * throw index_out_of_bound if such key does not exist.
+	 */
+	const T & at(const Key &key) const {
+		const entry *e = find_entry(key, hasher(key));
+		if (e == nullptr) throw index_out_of_bound();
+		return e->data.second;
+	}
+	const T & operator[](const Key &key) const { return at(key); }
+
+	size_t count(const Key &key) const { return find_entry(key, hasher(key)) ? 1 : 0; }
+
+	/**
+	 * return an iterator to key's element, or cend().
+	 */
+	const_iterator find(const Key &key) const {
+		const entry *e = find_entry(key, hasher(key));
+		if (e == nullptr) return cend();
+		const_iterator it;
+		it.map_ptr = this;
+		it.cur = e;
+		const trie_node *n = seq_root;
+		for (size_t level = seq_height; level > 0; level--) {
+			unsigned int bit = branch(e->seq, (level - 1) * BITS);
+			it.path[it.depth] = n;
+			it.pos[it.depth++] = slot_of(n->bitmap, bit);
+			n = n->children[slot_of(n->bitmap, bit)].sub;
+		}
+		return it;
+	}
+
+	const_iterator cbegin() const {
+		const_iterator it;
+		it.map_ptr = this;
+		if (seq_root == nullptr) return it;
+		it.path[0] = seq_root;
+		it.pos[0] = 0;
+		it.depth = 1;
+		it.descend();
+		return it;
+	}
+	const_iterator cend() const {
+		const_iterator it;
+		it.map_ptr = this;
+		return it;
+	}
+	const_iterator begin() const { return cbegin(); }
+	const_iterator end() const { return cend(); }
+
+	bool empty() const { return num_elements == 0; }
+	size_t size() const { return num_elements; }
+};
+
+}
+
+#endif
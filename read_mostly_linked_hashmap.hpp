@@ -0,0 +1,262 @@
+/**
+ * implement a linked_hashmap for one writer thread and many readers
+ */
+#ifndef SJTU_READ_MOSTLY_LINKEDHASHMAP_HPP
+#define SJTU_READ_MOSTLY_LINKEDHASHMAP_HPP
+
+// only for std::equal_to<T> and std::hash<T>
+#include <functional>
+#include <cstddef>
+#include <thread>
+#include <utility>
+#include "linked_hashmap.hpp"
+#include "exceptions.hpp"
+
+namespace sjtu {
+    /**
+     * read_mostly_linked_hashmap is for maps that one thread updates
+     * while many others look things up. It keeps two linked_hashmaps
+     * with the same contents: readers use one while the writer changes
+     * the other, then the writer sends new readers over to the changed
+     * copy, waits for the last reader of the old one to leave, and
+     * applies the same change to it.
+     *
+     * A read never waits, never retries and never writes a cache line
+     * another thread writes: a reader announces itself in a line of its
+     * own, which only the writer looks at. Nothing a reader can reach is
+     * modified or freed under it, whatever T is and whatever the storage
+     * policy does to its table. The writer pays for this by doing every
+     * change twice and by waiting for the reads in progress on the copy
+     * it is about to change; keep reads short.
+     *
+     * Only one thread may call the writer's functions (modify, insert,
+     * assign, erase, clear and writer_view) at a time. Readers each
+     * hold a reader, and a reader belongs to one thread at a time.
+     */
+template<
+	class Key,
+	class T,
+	class Hash = std::hash<Key>,
+	class Equal = std::equal_to<Key>,
+	class Storage = chained_storage
+> class read_mostly_linked_hashmap {
+public:
+	typedef linked_hashmap<Key, T, Hash, Equal, Storage> map_type;
+	typedef typename map_type::value_type value_type;
+
+private:
+	static const size_t LINE = 64;
+
+	/**
+	 * what one reader tells the writer: how many of its reads are in
+	 *   progress under each of the two read indicators.
+	 */
+	struct alignas(64) slot {
+		long active[2];
+		int taken;
+	};
+
+	/**
+	 * the copies are written by the writer while readers read their
+	 *   neighbour, so they do not share a cache line.
+	 */
+	struct padded_map {
+		map_type map;
+		char pad[LINE];
+	};
+
+	padded_map copies[2];
+	// the copy new reads go to, and the read indicator they arrive on
+	size_t left_right;
+	size_t version_index;
+	unsigned long long versions;
+	// copies[1 - left_right] missed a change and must be rebuilt
+	bool behind;
+	char pad[LINE];
+	unsigned char *raw;
+	slot *slots;
+	size_t slot_count;
+
+	void wait_empty(size_t vi) const {
+		for (size_t i = 0; i < slot_count; i++)
+			while (__atomic_load_n(&slots[i].active[vi], __ATOMIC_SEQ_CST) != 0) std::this_thread::yield();
+	}
+
+	/**
+	 * once this returns, every read still in progress started after it
+	 *   was called, so it is on the copy left_right points to.
+	 */
+	void toggle_version_and_wait() {
+		size_t prev = version_index, next = 1 - prev;
+		wait_empty(next);
+		__atomic_store_n(&version_index, next, __ATOMIC_SEQ_CST);
+		wait_empty(prev);
+	}
+
+	/**
+	 * make the copy readers are not on equal to the one they are on,
+	 *   built aside and moved in so that a failed copy changes nothing;
+	 *   behind stays set until this succeeds.
+	 */
+	void catch_up() {
+		behind = true;
+		map_type fresh(copies[left_right].map);
+		copies[1 - left_right].map = std::move(fresh);
+		behind = false;
+	}
+
+public:
+	/**
+	 * a reader's handle on the map, taking one of its max_readers()
+	 *   slots until destroyed.
+	 */
+	class reader {
+	private:
+		const read_mostly_linked_hashmap *owner;
+		slot *own;
+
+		struct departure {
+			long *count;
+			~departure() { __atomic_store_n(count, *count - 1, __ATOMIC_RELEASE); }
+		};
+
+	public:
+		/**
+		 * throw runtime_error if every slot is taken.
+		 */
+		explicit reader(const read_mostly_linked_hashmap &map) : owner(&map), own(nullptr) {
+			for (size_t i = 0; i < map.slot_count && own == nullptr; i++) {
+				int expected = 0;
+				if (__atomic_compare_exchange_n(&map.slots[i].taken, &expected, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+					own = map.slots + i;
+			}
+			if (own == nullptr) throw runtime_error();
+		}
+		reader(const reader &) = delete;
+		reader & operator=(const reader &) = delete;
+		~reader() { __atomic_store_n(&own->taken, 0, __ATOMIC_RELEASE); }
+
+		/**
+		 * return f(map), f seeing the map as of some complete
+		 *   modification. f must not keep references or iterators into
+		 *   the map past its return.
+		 */
+		template<class F>
+		auto read(F f) const -> decltype(f(std::declval<const map_type &>())) {
+			size_t vi = __atomic_load_n(&owner->version_index, __ATOMIC_SEQ_CST);
+			__atomic_store_n(&own->active[vi], own->active[vi] + 1, __ATOMIC_SEQ_CST);
+			departure leave = {&own->active[vi]};
+			return f(static_cast<const map_type &>(owner->copies[__atomic_load_n(&owner->left_right, __ATOMIC_SEQ_CST)].map));
+		}
+
+		/**
+		 * copy the value of key into value; false if key is absent.
+		 */
+		bool find(const Key &key, T &value) const {
+			return read([&](const map_type &map) {
+				typename map_type::const_iterator it = map.find(key);
+				if (it == map.cend()) return false;
+				value = it->second;
+				return true;
+			});
+		}
+		size_t count(const Key &key) const {
+			return read([&](const map_type &map) { return map.count(key); });
+		}
+		size_t size() const {
+			return read([](const map_type &map) { return map.size(); });
+		}
+	};
+
+	/**
+	 * room for max_readers readers at a time.
+	 */
+	explicit read_mostly_linked_hashmap(size_t max_readers = 64) : left_right(0), version_index(0), versions(0), behind(false), raw(nullptr), slots(nullptr), slot_count(max_readers) {
+		raw = new unsigned char[(slot_count + 1) * sizeof(slot)];
+		size_t misalign = (size_t)raw % sizeof(slot);
+		slots = reinterpret_cast<slot*>(raw + (misalign ? sizeof(slot) - misalign : 0));
+		for (size_t i = 0; i < slot_count; i++) {
+			slots[i].active[0] = slots[i].active[1] = 0;
+			slots[i].taken = 0;
+		}
+	}
+	read_mostly_linked_hashmap(const read_mostly_linked_hashmap &) = delete;
+	read_mostly_linked_hashmap & operator=(const read_mostly_linked_hashmap &) = delete;
+	/**
+	 * every reader must be gone.
+	 */
+	~read_mostly_linked_hashmap() { delete[] raw; }
+
+	/**
+	 * call f(map) on each copy in turn: f must make the same change to
+	 *   both, that is, depend on nothing but the map's contents and what
+	 *   it captures. returns once readers see the change.
+	 * if f throws on the first copy, that copy is rebuilt from the other
+	 *   and the exception passed on; readers never saw it. if it throws
+	 *   on the second, which can only be for lack of memory, that copy is
+	 *   rebuilt from the first. a rebuild that itself runs out of memory
+	 *   is retried at the start of the next modify(), which throws if it
+	 *   fails again, before f is called.
+	 */
+	template<class F>
+	void modify(F f) {
+		if (behind) catch_up();
+		map_type &next = copies[1 - left_right].map, &prev = copies[left_right].map;
+		try {
+			f(next);
+		} catch (...) {
+			try {
+				catch_up();
+			} catch (...) {
+			}
+			throw;
+		}
+		__atomic_store_n(&left_right, 1 - left_right, __ATOMIC_SEQ_CST);
+		toggle_version_and_wait();
+		try {
+			f(prev);
+		} catch (...) {
+			try {
+				catch_up();
+			} catch (...) {
+			}
+		}
+		__atomic_store_n(&versions, versions + 1, __ATOMIC_RELEASE);
+	}
+
+	/**
+	 * the usual updates, each one modify().
+	 */
+	bool insert(const value_type &value) {
+		bool added = false;
+		modify([&](map_type &map) { added = map.insert(value).second; });
+		return added;
+	}
+	void assign(const Key &key, const T &value) {
+		modify([&](map_type &map) { map[key] = value; });
+	}
+	size_t erase(const Key &key) {
+		size_t erased = 0;
+		modify([&](map_type &map) { erased = map.erase(key); });
+		return erased;
+	}
+	void clear() {
+		modify([](map_type &map) { map.clear(); });
+	}
+
+	/**
+	 * the contents as readers now see them. for the writer only, which
+	 *   may read them without a reader since nobody else changes them.
+	 */
+	const map_type & writer_view() const { return copies[left_right].map; }
+
+	/**
+	 * how many modifications readers can see; any thread may ask.
+	 */
+	unsigned long long version() const { return __atomic_load_n(&versions, __ATOMIC_ACQUIRE); }
+	size_t max_readers() const { return slot_count; }
+};
+
+}
+
+#endif
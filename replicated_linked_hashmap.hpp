@@ -0,0 +1,314 @@
+/**
+ * implement a linked_hashmap copied once per reading thread
+ */
+#ifndef SJTU_REPLICATED_LINKEDHASHMAP_HPP
+#define SJTU_REPLICATED_LINKEDHASHMAP_HPP
+
+// only for std::equal_to<T> and std::hash<T>
+#include <functional>
+#include <cstddef>
+#include <mutex>
+#include "linked_hashmap.hpp"
+#include "exceptions.hpp"
+
+namespace sjtu {
+    /**
+     * replicated_linked_hashmap is for small maps that are read all the
+     * time and changed now and then. Every reading thread (or group of
+     * threads sharing a core) holds a replica: a linked_hashmap of its
+     * own, built on that thread, so its reads touch nothing another core
+     * writes. Updates go into a log of at most log_capacity changes, and
+     * each replica applies what it has not seen yet when its thread calls
+     * quiesce(), at a point where it holds no reference into the map.
+     *
+     * Updates never wait for a replica to apply changes or copy the map:
+     * a replica only holds the update lock to take references to the log
+     * entries it missed, or to take a snapshot of the map (see
+     * linked_hashmap::snapshot), and does the work after letting go. A
+     * replica that fell more than log_capacity changes behind has lost
+     * the start of what it missed, and copies the map afresh at its next
+     * quiesce() instead, so a thread holding a replica should keep
+     * calling quiesce() to stay on the cheap path. lag() tells how far a
+     * replica is behind, max_lag() the worst of them.
+     *
+     * Any thread may update, including one that holds a replica. A
+     * replica belongs to one thread at a time.
+     */
+template<
+	class Key,
+	class T,
+	class Hash = std::hash<Key>,
+	class Equal = std::equal_to<Key>,
+	class Storage = chained_storage
+> class replicated_linked_hashmap {
+public:
+	typedef linked_hashmap<Key, T, Hash, Equal, Storage> map_type;
+	typedef typename map_type::value_type value_type;
+
+private:
+	static const size_t LINE = 64;
+
+	typedef std::function<void(map_type &)> change;
+
+	/**
+	 * a logged change, never modified once logged. the log holds one
+	 *   reference, and a replica replaying it another, so it outlives
+	 *   its slot being reused while a replica still runs it.
+	 */
+	struct entry {
+		change apply;
+		long refs;
+		explicit entry(const change &f) : apply(f), refs(1) {}
+	};
+
+	static void drop(entry *e) {
+		if (__atomic_sub_fetch(&e->refs, 1, __ATOMIC_ACQ_REL) == 0) delete e;
+	}
+
+	/**
+	 * an entry built before taking the update lock; dropped unless
+	 *   publish() took it.
+	 */
+	struct entry_guard {
+		entry *e;
+		explicit entry_guard(const change &f) : e(new entry(f)) {}
+		~entry_guard() { if (e != nullptr) drop(e); }
+	};
+
+	/**
+	 * one reader's copy. applied is written by its reader only and read
+	 *   by updaters; the padding keeps the next replica off its lines.
+	 *   pending holds the entries a quiesce() is replaying.
+	 */
+	struct replica_state {
+		char pad_before[LINE];
+		map_type map;
+		unsigned long long applied;
+		int taken;
+		entry **pending;
+		char pad_after[LINE];
+		explicit replica_state(size_t log_capacity) : applied(0), taken(0), pending(new entry *[log_capacity]) {}
+		~replica_state() { delete[] pending; }
+	};
+
+	// the contents every new replica starts from, and the log after it
+	map_type master;
+	entry **log;
+	size_t log_capacity;
+	std::mutex update_lock;
+	char pad[LINE];
+	// changes logged so far; read by every quiesce()
+	unsigned long long head;
+	char pad_after[LINE];
+	replica_state **replicas;
+	size_t replica_count;
+
+	/**
+	 * log the guarded entry for the replicas once it ran on master;
+	 *   update_lock is ours. the caller builds the entry before touching
+	 *   master, and nothing here can throw, so master never holds a
+	 *   change the log lacks. the entry it replaces is the oldest one; a
+	 *   replica still missing that has overrun the log (see quiesce()).
+	 */
+	void publish(entry_guard &guard) {
+		entry *&slot = log[head % log_capacity];
+		if (slot != nullptr) drop(slot);
+		slot = guard.e;
+		guard.e = nullptr;
+		__atomic_store_n(&head, head + 1, __ATOMIC_RELEASE);
+	}
+
+public:
+	/**
+	 * a thread's replica, taken from the map's max_replicas() until
+	 *   destroyed. it starts as a copy of the map's latest contents.
+	 */
+	class replica {
+	private:
+		replicated_linked_hashmap *owner;
+		replica_state *own;
+
+	public:
+		/**
+		 * throw runtime_error if every replica is taken.
+		 */
+		explicit replica(replicated_linked_hashmap &map) : owner(&map), own(nullptr) {
+			std::unique_lock<std::mutex> guard(map.update_lock);
+			for (size_t i = 0; i < map.replica_count && own == nullptr; i++)
+				if (__atomic_load_n(&map.replicas[i]->taken, __ATOMIC_RELAXED) == 0) own = map.replicas[i];
+			if (own == nullptr) throw runtime_error();
+			typename map_type::snapshot_view latest = map.master.snapshot();
+			own->applied = map.head;
+			__atomic_store_n(&own->taken, 1, __ATOMIC_RELEASE);
+			guard.unlock();
+			// copied here, so that the copy is in memory near this thread
+			try {
+				own->map = *latest;
+			} catch (...) {
+				__atomic_store_n(&own->taken, 0, __ATOMIC_RELEASE);
+				throw;
+			}
+		}
+		replica(const replica &) = delete;
+		replica & operator=(const replica &) = delete;
+		~replica() { __atomic_store_n(&own->taken, 0, __ATOMIC_RELEASE); }
+
+		/**
+		 * apply the changes logged since the last call, or copy the map
+		 *   again if more than log_size() of them were. references and
+		 *   iterators into view() may be invalidated.
+		 * holds the map's update lock only to take a reference to each
+		 *   change it missed, or a snapshot of the map; it applies or
+		 *   copies them after letting go.
+		 */
+		void quiesce() {
+			if (__atomic_load_n(&owner->head, __ATOMIC_ACQUIRE) == own->applied) return;
+			std::unique_lock<std::mutex> guard(owner->update_lock);
+			unsigned long long target = owner->head;
+			if (target - own->applied > owner->log_capacity) {
+				typename map_type::snapshot_view latest = owner->master.snapshot();
+				guard.unlock();
+				own->map = *latest;
+				__atomic_store_n(&own->applied, target, __ATOMIC_RELEASE);
+				return;
+			}
+			size_t count = 0;
+			for (unsigned long long i = own->applied; i < target; i++) {
+				entry *e = owner->log[i % owner->log_capacity];
+				__atomic_add_fetch(&e->refs, 1, __ATOMIC_RELAXED);
+				own->pending[count++] = e;
+			}
+			guard.unlock();
+			size_t done = 0;
+			try {
+				for (; done < count; done++) {
+					own->pending[done]->apply(own->map);
+					__atomic_store_n(&own->applied, own->applied + 1, __ATOMIC_RELEASE);
+					drop(own->pending[done]);
+				}
+			} catch (...) {
+				for (; done < count; done++) drop(own->pending[done]);
+				throw;
+			}
+		}
+
+		/**
+		 * the replica as of the last quiesce().
+		 */
+		const map_type & view() const { return own->map; }
+		/**
+		 * copy the value of key into value; false if key is absent.
+		 */
+		bool find(const Key &key, T &value) const {
+			typename map_type::const_iterator it = own->map.find(key);
+			if (it == own->map.cend()) return false;
+			value = it->second;
+			return true;
+		}
+		size_t count(const Key &key) const { return own->map.count(key); }
+		size_t size() const { return own->map.size(); }
+
+		/**
+		 * how many changes were logged that quiesce() has yet to apply.
+		 */
+		unsigned long long lag() const { return __atomic_load_n(&owner->head, __ATOMIC_ACQUIRE) - own->applied; }
+	};
+
+	/**
+	 * room for max_replicas replicas, which may each fall up to
+	 *   log_capacity changes behind.
+	 */
+	explicit replicated_linked_hashmap(size_t max_replicas = 64, size_t log_capacity = 1024)
+		: log(nullptr), log_capacity(log_capacity), head(0), replicas(nullptr), replica_count(0) {
+		if (log_capacity == 0) throw runtime_error();
+		log = new entry *[log_capacity]();
+		try {
+			replicas = new replica_state *[max_replicas];
+			for (; replica_count < max_replicas; replica_count++) replicas[replica_count] = new replica_state(log_capacity);
+		} catch (...) {
+			free_replicas();
+			throw;
+		}
+	}
+	replicated_linked_hashmap(const replicated_linked_hashmap &) = delete;
+	replicated_linked_hashmap & operator=(const replicated_linked_hashmap &) = delete;
+	/**
+	 * every replica must be gone.
+	 */
+	~replicated_linked_hashmap() { free_replicas(); }
+
+private:
+	void free_replicas() {
+		for (size_t i = 0; i < replica_count; i++) delete replicas[i];
+		delete[] replicas;
+		for (size_t i = 0; i < log_capacity; i++) if (log[i] != nullptr) drop(log[i]);
+		delete[] log;
+	}
+
+public:
+	/**
+	 * log f(map) for every replica, f having run on the map's own copy
+	 *   first. f is kept and run again on each replica by the replica's
+	 *   thread, maybe on several at once, so it must make the same change
+	 *   to every copy and touch nothing but the copy it is given.
+	 *   if it throws on the map's own copy, nothing is logged, so it
+	 *   must leave that copy as it was.
+	 */
+	void modify(const std::function<void(map_type &)> &f) {
+		entry_guard entry(f);
+		std::lock_guard<std::mutex> guard(update_lock);
+		entry.e->apply(master);
+		publish(entry);
+	}
+
+	/**
+	 * the usual updates. an insert or erase that changes nothing is not
+	 *   logged.
+	 */
+	bool insert(const value_type &value) {
+		entry_guard entry([value](map_type &map) { map.insert(value); });
+		std::lock_guard<std::mutex> guard(update_lock);
+		if (!master.insert(value).second) return false;
+		publish(entry);
+		return true;
+	}
+	void assign(const Key &key, const T &value) {
+		modify([key, value](map_type &map) {
+			typename map_type::iterator it = map.find(key);
+			if (it != map.end()) it->second = value;
+			else map.insert(value_type(key, value));
+		});
+	}
+	size_t erase(const Key &key) {
+		entry_guard entry([key](map_type &map) { map.erase(key); });
+		std::lock_guard<std::mutex> guard(update_lock);
+		if (master.erase(key) == 0) return 0;
+		publish(entry);
+		return 1;
+	}
+	void clear() {
+		modify([](map_type &map) { map.clear(); });
+	}
+
+	/**
+	 * how many changes were logged, and how many the replica furthest
+	 *   behind has yet to apply; any thread may ask.
+	 */
+	unsigned long long version() const { return __atomic_load_n(&head, __ATOMIC_ACQUIRE); }
+	unsigned long long max_lag() const {
+		unsigned long long h = version(), lag = 0;
+		for (size_t i = 0; i < replica_count; i++) {
+			replica_state *r = replicas[i];
+			if (__atomic_load_n(&r->taken, __ATOMIC_ACQUIRE) == 0) continue;
+			unsigned long long applied = __atomic_load_n(&r->applied, __ATOMIC_ACQUIRE);
+			if (applied < h && h - applied > lag) lag = h - applied;
+		}
+		return lag;
+	}
+	size_t max_replicas() const { return replica_count; }
+	size_t log_size() const { return log_capacity; }
+};
+
+}
+
+#endif
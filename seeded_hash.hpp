@@ -0,0 +1,130 @@
+/**
+ * implement a keyed hash for hash-flooding resistance, to be used as
+ * the Hash of a linked_hashmap
+ */
+#ifndef SJTU_SEEDED_HASH_HPP
+#define SJTU_SEEDED_HASH_HPP
+
+// only for std::hash<T>
+#include <functional>
+#include <cstddef>
+#include "linked_hashmap.hpp"
+
+namespace sjtu {
+    /**
+     * seeded_hash is SipHash-2-4 keyed with a 128-bit seed chosen at
+     * random for every instance, so an attacker who does not know the
+     * seed cannot pick keys that share a bucket.
+     *
+     * Keys that expose contiguous bytes through data() and size()
+     * (std::string and the like) are hashed byte by byte; any other key
+     * is first reduced by Base and the result is hashed. In that case
+     * keys that collide under Base still collide, whatever the seed.
+     *
+     * The seed is mixed from the cycle counter (where there is one),
+     * addresses that move with ASLR and a process-wide counter. It is
+     * meant to be unpredictable from outside, not cryptographically random.
+     */
+template<
+	class Key,
+	class Base = std::hash<Key>
+> class seeded_hash {
+private:
+	typedef unsigned long long word;
+
+	word k0, k1;
+	Base base;
+
+	// only element types of one byte are hashed as raw bytes
+	template<size_t N, class Dummy = void> struct byte_sized {};
+	template<class Dummy> struct byte_sized<1, Dummy> { typedef size_t type; };
+
+	static word rotl(word x, int b) { return (x << b) | (x >> (64 - b)); }
+
+	static void sip_round(word &v0, word &v1, word &v2, word &v3) {
+		v0 += v1; v1 = rotl(v1, 13); v1 ^= v0; v0 = rotl(v0, 32);
+		v2 += v3; v3 = rotl(v3, 16); v3 ^= v2;
+		v0 += v3; v3 = rotl(v3, 21); v3 ^= v0;
+		v2 += v1; v1 = rotl(v1, 17); v1 ^= v2; v2 = rotl(v2, 32);
+	}
+
+	static word splitmix(word x) {
+		x += 0x9e3779b97f4a7c15ULL;
+		x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+		return x ^ (x >> 31);
+	}
+
+	word random_word() const {
+		static word counter = 0;
+		int local = 0;
+		word x = __atomic_add_fetch(&counter, 0x9e3779b97f4a7c15ULL, __ATOMIC_RELAXED);
+		x ^= (word)(size_t)&local;
+		x ^= rotl((word)(size_t)this, 29) ^ rotl((word)(size_t)&counter, 47);
+#if defined(__x86_64__) || defined(__i386__)
+		x ^= rotl(__builtin_ia32_rdtsc(), 13);
+#endif
+		return splitmix(x);
+	}
+
+	template<class K>
+	auto hash_key(const K &key, int) const -> typename byte_sized<sizeof(*key.data())>::type {
+		return siphash(reinterpret_cast<const unsigned char*>(key.data()), key.size());
+	}
+	template<class K>
+	size_t hash_key(const K &key, long) const {
+		word h = base(key);
+		unsigned char bytes[8];
+		for (int i = 0; i < 8; i++) bytes[i] = (unsigned char)(h >> (8 * i));
+		return siphash(bytes, 8);
+	}
+
+public:
+	seeded_hash() { reseed(); }
+	/**
+	 * a fixed seed, for reproducible hashes.
+	 */
+	seeded_hash(word seed0, word seed1) : k0(seed0), k1(seed1) {}
+
+	/**
+	 * draw a fresh seed. every hash computed before is invalidated.
+	 */
+	void reseed() {
+		k0 = random_word();
+		k1 = random_word();
+	}
+
+	/**
+	 * SipHash-2-4 of len bytes under this instance's seed.
+	 */
+	size_t siphash(const unsigned char *in, size_t len) const {
+		word v0 = 0x736f6d6570736575ULL ^ k0;
+		word v1 = 0x646f72616e646f6dULL ^ k1;
+		word v2 = 0x6c7967656e657261ULL ^ k0;
+		word v3 = 0x7465646279746573ULL ^ k1;
+		size_t end = len - len % 8;
+		for (size_t i = 0; i < end; i += 8) {
+			word m = 0;
+			for (int j = 0; j < 8; j++) m |= (word)in[i + j] << (8 * j);
+			v3 ^= m;
+			sip_round(v0, v1, v2, v3);
+			sip_round(v0, v1, v2, v3);
+			v0 ^= m;
+		}
+		word b = (word)len << 56;
+		for (size_t j = 0; end + j < len; j++) b |= (word)in[end + j] << (8 * j);
+		v3 ^= b;
+		sip_round(v0, v1, v2, v3);
+		sip_round(v0, v1, v2, v3);
+		v0 ^= b;
+		v2 ^= 0xff;
+		for (int i = 0; i < 4; i++) sip_round(v0, v1, v2, v3);
+		return (size_t)(v0 ^ v1 ^ v2 ^ v3);
+	}
+
+	size_t operator()(const Key &key) const { return hash_key(key, 0); }
+};
+
+}
+
+#endif
@@ -0,0 +1,508 @@
+/**
+ * implement the vector kernels behind linked_hashmap's value aggregates
+ */
+#ifndef SJTU_SIMD_HPP
+#define SJTU_SIMD_HPP
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SJTU_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+namespace sjtu {
+    /**
+     * the instruction sets a kernel may use, each including the ones
+     * before it. a kernel family without a variant for some level runs
+     * its best variant below it.
+     */
+enum simd_level {
+	simd_scalar = 0,
+	simd_sse2 = 1,
+	simd_sse42 = 2,
+	simd_avx2 = 3,
+	simd_avx512bw = 4
+};
+
+inline const char *simd_level_name(simd_level level) {
+	static const char *const names[] = {"scalar", "sse2", "sse4.2", "avx2", "avx512bw"};
+	return names[level];
+}
+
+    /**
+     * the best level this cpu runs, detected once through cpuid.
+     */
+inline simd_level cpu_simd_level() {
+#ifdef SJTU_SIMD_X86
+	static const simd_level level = []() {
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vl"))
+			return simd_avx512bw;
+		if (__builtin_cpu_supports("avx2")) return simd_avx2;
+		if (__builtin_cpu_supports("sse4.2")) return simd_sse42;
+		return simd_sse2;
+	}();
+	return level;
+#else
+	return simd_scalar;
+#endif
+}
+
+inline simd_level &active_simd_slot() {
+	static simd_level level = []() {
+		simd_level cpu = cpu_simd_level();
+		const char *forced = std::getenv("SJTU_SIMD");
+		if (forced == nullptr) return cpu;
+		for (int l = simd_scalar; l <= simd_avx512bw; l++) {
+			if (std::strcmp(forced, simd_level_name(simd_level(l))) == 0)
+				return simd_level(l) < cpu ? simd_level(l) : cpu;
+		}
+		if (std::strcmp(forced, "sse42") == 0) return simd_sse42 < cpu ? simd_sse42 : cpu;
+		return cpu;
+	}();
+	return level;
+}
+
+    /**
+     * the level the maps' kernels use: cpu_simd_level(), unless the
+     * environment variable SJTU_SIMD names a lower one (scalar, sse2,
+     * sse4.2, avx2, avx512bw), read at the first call. naming a level
+     * the cpu lacks gives the cpu's own.
+     */
+inline simd_level active_simd_level() { return active_simd_slot(); }
+
+    /**
+     * change the active level, for tests and benchmarks; clamped to the
+     * cpu's. return the level set. not synchronized: call it while no
+     * other thread is using a map.
+     */
+inline simd_level set_active_simd_level(simd_level level) {
+	simd_level cpu = cpu_simd_level();
+	return active_simd_slot() = level < cpu ? level : cpu;
+}
+
+    /**
+     * what sum_values adds in: long long or unsigned long long for
+     * integers, as T's signedness, and double (or long double) for
+     * floating point. integer sums wrap around on overflow.
+     */
+template<class T>
+struct value_sum {
+	typedef typename std::conditional<std::is_floating_point<T>::value,
+		typename std::conditional<(sizeof(T) > sizeof(double)), T, double>::type,
+		typename std::conditional<std::is_signed<T>::value, long long, unsigned long long>::type
+	>::type type;
+};
+
+    /**
+     * aggregates over the values of an array of node pointers, in array
+     * order. slots[i] may be nullptr (a hole), which is skipped; else the
+     * value sits offset bytes into *slots[i].
+     *
+     * 4- and 8-byte values are widened into 64-bit lanes (signed,
+     * unsigned or double) and gathered four at a time with AVX2 masked
+     * gathers, the mask dropping holes, eight at a time with AVX-512
+     * gathers into mask registers, or two at a time under SSE4.2, whose
+     * 64-bit compares give min and max. anything else, and SSE2 alone,
+     * take the scalar loop. every kernel clamps the level it is asked
+     * for to cpu_simd_level().
+     */
+template<class T>
+class value_kernels {
+private:
+	enum lane_kind { no_lanes, signed_lanes, unsigned_lanes, double_lanes };
+	static const lane_kind kind =
+		std::is_same<T, bool>::value || (sizeof(T) != 4 && sizeof(T) != 8) ? no_lanes
+		: std::is_floating_point<T>::value ? (sizeof(T) <= sizeof(double) ? double_lanes : no_lanes)
+		: std::is_signed<T>::value ? signed_lanes : unsigned_lanes;
+	typedef typename value_sum<T>::type sum_type;
+	typedef std::integral_constant<lane_kind, kind> kind_tag;
+
+	static T value_at(const void *node, size_t offset) {
+		T v;
+		std::memcpy(&v, static_cast<const char*>(node) + offset, sizeof(T));
+		return v;
+	}
+
+	static long long to_lane(T v) {
+		if (kind == double_lanes) {
+			double d = (double)v;
+			long long bits;
+			std::memcpy(&bits, &d, sizeof(bits));
+			return bits;
+		}
+		if (kind == unsigned_lanes) return (long long)(unsigned long long)v;
+		return (long long)v;
+	}
+	static T from_lane(long long bits) {
+		if (kind == double_lanes) {
+			double d;
+			std::memcpy(&d, &bits, sizeof(d));
+			return (T)d;
+		}
+		if (kind == unsigned_lanes) return (T)(unsigned long long)bits;
+		return (T)bits;
+	}
+
+	static simd_level usable(simd_level level) {
+		simd_level cpu = cpu_simd_level();
+		if (cpu < level) level = cpu;
+		if (kind == no_lanes || level < simd_sse42) return simd_scalar;
+		return level;
+	}
+
+	template<class Ptr>
+	static void scalar_sum(Ptr const *slots, size_t n, size_t offset, sum_type &acc) {
+		for (size_t i = 0; i < n; i++)
+			if (slots[i]) add(acc, value_at(slots[i], offset), std::is_integral<T>());
+	}
+	static void add(sum_type &acc, T v, std::true_type) { acc = (sum_type)((unsigned long long)acc + (unsigned long long)(sum_type)v); }
+	static void add(sum_type &acc, T v, std::false_type) { acc += v; }
+
+	template<class Ptr>
+	static void scalar_min_max(Ptr const *slots, size_t n, size_t offset, T &lo, T &hi) {
+		for (size_t i = 0; i < n; i++) {
+			if (!slots[i]) continue;
+			T v = value_at(slots[i], offset);
+			if (v < lo) lo = v;
+			if (hi < v) hi = v;
+		}
+	}
+
+#ifdef SJTU_SIMD_X86
+	/**
+	 * four lanes from slots[0..3]; live gets all ones in the lanes that
+	 *   are not holes, and holes read as 0.
+	 */
+	__attribute__((target("avx2")))
+	static __m256i avx2_load(const void *slots, size_t offset, __m256i &live) {
+		__m256i p = _mm256_loadu_si256(static_cast<const __m256i*>(slots));
+		live = _mm256_xor_si256(_mm256_cmpeq_epi64(p, _mm256_setzero_si256()), _mm256_set1_epi64x(-1));
+		__m256i addr = _mm256_add_epi64(p, _mm256_set1_epi64x((long long)offset));
+		if (sizeof(T) == 8)
+			return _mm256_mask_i64gather_epi64(_mm256_setzero_si256(), (const long long*)0, addr, live, 1);
+		__m128i mask = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(live, _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6)));
+		__m128i v = _mm256_mask_i64gather_epi32(_mm_setzero_si128(), (const int*)0, addr, mask, 1);
+		if (kind == double_lanes) return _mm256_castpd_si256(_mm256_cvtps_pd(_mm_castsi128_ps(v)));
+		if (kind == unsigned_lanes) return _mm256_cvtepu32_epi64(v);
+		return _mm256_cvtepi32_epi64(v);
+	}
+
+	/**
+	 * lanes where a < b; unsigned lanes are compared with their top bit
+	 *   flipped, so that the signed compare orders them.
+	 */
+	__attribute__((target("avx2")))
+	static __m256i avx2_less(__m256i a, __m256i b) {
+		if (kind == double_lanes)
+			return _mm256_castpd_si256(_mm256_cmp_pd(_mm256_castsi256_pd(a), _mm256_castsi256_pd(b), _CMP_LT_OQ));
+		if (kind == unsigned_lanes) {
+			__m256i bias = _mm256_set1_epi64x((long long)(1ULL << 63));
+			a = _mm256_xor_si256(a, bias);
+			b = _mm256_xor_si256(b, bias);
+		}
+		return _mm256_cmpgt_epi64(b, a);
+	}
+
+	template<class Ptr>
+	__attribute__((target("avx2")))
+	static void avx2_sum(Ptr const *slots, size_t n, size_t offset, sum_type &acc) {
+		__m256i isum = _mm256_setzero_si256();
+		__m256d dsum = _mm256_setzero_pd();
+		size_t i = 0;
+		for (; i + 4 <= n; i += 4) {
+			__m256i live, v = avx2_load(slots + i, offset, live);
+			if (kind == double_lanes) dsum = _mm256_add_pd(dsum, _mm256_castsi256_pd(v));
+			else isum = _mm256_add_epi64(isum, v);
+		}
+		long long lanes[4];
+		if (kind == double_lanes) _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), _mm256_castpd_si256(dsum));
+		else _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), isum);
+		for (int k = 0; k < 4; k++) add_lane(acc, lanes[k], kind_tag());
+		scalar_sum(slots + i, n - i, offset, acc);
+	}
+
+	template<class Ptr>
+	__attribute__((target("avx2")))
+	static void avx2_min_max(Ptr const *slots, size_t n, size_t offset, T &lo, T &hi) {
+		__m256i vlo = _mm256_set1_epi64x(to_lane(lo)), vhi = _mm256_set1_epi64x(to_lane(hi));
+		size_t i = 0;
+		for (; i + 4 <= n; i += 4) {
+			__m256i live, v = avx2_load(slots + i, offset, live);
+			vlo = _mm256_blendv_epi8(vlo, v, _mm256_and_si256(live, avx2_less(v, vlo)));
+			vhi = _mm256_blendv_epi8(vhi, v, _mm256_and_si256(live, avx2_less(vhi, v)));
+		}
+		long long los[4], his[4];
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(los), vlo);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(his), vhi);
+		for (int k = 0; k < 4; k++) {
+			if (from_lane(los[k]) < lo) lo = from_lane(los[k]);
+			if (hi < from_lane(his[k])) hi = from_lane(his[k]);
+		}
+		scalar_min_max(slots + i, n - i, offset, lo, hi);
+	}
+
+	/**
+	 * eight lanes from slots[0..7], with the holes as a mask register;
+	 *   AVX-512 compares unsigned lanes directly.
+	 */
+	__attribute__((target("avx512f,avx512bw")))
+	static __m512i avx512_load(const void *slots, size_t offset, __mmask8 &live) {
+		__m512i p = _mm512_loadu_si512(slots);
+		live = _mm512_test_epi64_mask(p, p);
+		__m512i addr = _mm512_add_epi64(p, _mm512_set1_epi64((long long)offset));
+		if (sizeof(T) == 8)
+			return _mm512_mask_i64gather_epi64(_mm512_setzero_si512(), live, addr, (const void*)0, 1);
+		__m256i v = _mm512_mask_i64gather_epi32(_mm256_setzero_si256(), live, addr, (const void*)0, 1);
+		if (kind == double_lanes) return _mm512_castpd_si512(_mm512_maskz_cvtps_pd(0xff, _mm256_castsi256_ps(v)));
+		if (kind == unsigned_lanes) return _mm512_maskz_cvtepu32_epi64(0xff, v);
+		return _mm512_maskz_cvtepi32_epi64(0xff, v);
+	}
+
+	__attribute__((target("avx512f,avx512bw")))
+	static __mmask8 avx512_less(__m512i a, __m512i b) {
+		if (kind == double_lanes) return _mm512_cmp_pd_mask(_mm512_castsi512_pd(a), _mm512_castsi512_pd(b), _CMP_LT_OQ);
+		if (kind == unsigned_lanes) return _mm512_cmplt_epu64_mask(a, b);
+		return _mm512_cmplt_epi64_mask(a, b);
+	}
+
+	template<class Ptr>
+	__attribute__((target("avx512f,avx512bw")))
+	static void avx512_sum(Ptr const *slots, size_t n, size_t offset, sum_type &acc) {
+		__m512i isum = _mm512_setzero_si512();
+		__m512d dsum = _mm512_setzero_pd();
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8) {
+			__mmask8 live;
+			__m512i v = avx512_load(slots + i, offset, live);
+			if (kind == double_lanes) dsum = _mm512_add_pd(dsum, _mm512_castsi512_pd(v));
+			else isum = _mm512_add_epi64(isum, v);
+		}
+		long long lanes[8];
+		if (kind == double_lanes) _mm512_storeu_si512(lanes, _mm512_castpd_si512(dsum));
+		else _mm512_storeu_si512(lanes, isum);
+		for (int k = 0; k < 8; k++) add_lane(acc, lanes[k], kind_tag());
+		scalar_sum(slots + i, n - i, offset, acc);
+	}
+
+	template<class Ptr>
+	__attribute__((target("avx512f,avx512bw")))
+	static void avx512_min_max(Ptr const *slots, size_t n, size_t offset, T &lo, T &hi) {
+		__m512i vlo = _mm512_set1_epi64(to_lane(lo)), vhi = _mm512_set1_epi64(to_lane(hi));
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8) {
+			__mmask8 live;
+			__m512i v = avx512_load(slots + i, offset, live);
+			vlo = _mm512_mask_blend_epi64(live & avx512_less(v, vlo), vlo, v);
+			vhi = _mm512_mask_blend_epi64(live & avx512_less(vhi, v), vhi, v);
+		}
+		long long los[8], his[8];
+		_mm512_storeu_si512(los, vlo);
+		_mm512_storeu_si512(his, vhi);
+		for (int k = 0; k < 8; k++) {
+			if (from_lane(los[k]) < lo) lo = from_lane(los[k]);
+			if (hi < from_lane(his[k])) hi = from_lane(his[k]);
+		}
+		scalar_min_max(slots + i, n - i, offset, lo, hi);
+	}
+
+	/**
+	 * two lanes from slots[0..1]; SSE has no gather, so the loads are
+	 *   scalar and only the hole mask is vector.
+	 */
+	__attribute__((target("sse4.2")))
+	static __m128i sse_load(const void *slots, size_t offset, __m128i &live) {
+		__m128i p = _mm_loadu_si128(static_cast<const __m128i*>(slots));
+		live = _mm_xor_si128(_mm_cmpeq_epi64(p, _mm_setzero_si128()), _mm_set1_epi64x(-1));
+		const void *a[2];
+		std::memcpy(a, slots, sizeof(a));
+		return _mm_set_epi64x(a[1] ? to_lane(value_at(a[1], offset)) : 0, a[0] ? to_lane(value_at(a[0], offset)) : 0);
+	}
+
+	__attribute__((target("sse4.2")))
+	static __m128i sse_less(__m128i a, __m128i b) {
+		if (kind == double_lanes) return _mm_castpd_si128(_mm_cmplt_pd(_mm_castsi128_pd(a), _mm_castsi128_pd(b)));
+		if (kind == unsigned_lanes) {
+			__m128i bias = _mm_set1_epi64x((long long)(1ULL << 63));
+			a = _mm_xor_si128(a, bias);
+			b = _mm_xor_si128(b, bias);
+		}
+		return _mm_cmpgt_epi64(b, a);
+	}
+
+	template<class Ptr>
+	__attribute__((target("sse4.2")))
+	static void sse_sum(Ptr const *slots, size_t n, size_t offset, sum_type &acc) {
+		__m128i isum = _mm_setzero_si128();
+		__m128d dsum = _mm_setzero_pd();
+		size_t i = 0;
+		for (; i + 2 <= n; i += 2) {
+			__m128i live, v = sse_load(slots + i, offset, live);
+			if (kind == double_lanes) dsum = _mm_add_pd(dsum, _mm_castsi128_pd(v));
+			else isum = _mm_add_epi64(isum, v);
+		}
+		long long lanes[2];
+		if (kind == double_lanes) _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), _mm_castpd_si128(dsum));
+		else _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), isum);
+		for (int k = 0; k < 2; k++) add_lane(acc, lanes[k], kind_tag());
+		scalar_sum(slots + i, n - i, offset, acc);
+	}
+
+	template<class Ptr>
+	__attribute__((target("sse4.2")))
+	static void sse_min_max(Ptr const *slots, size_t n, size_t offset, T &lo, T &hi) {
+		__m128i vlo = _mm_set1_epi64x(to_lane(lo)), vhi = _mm_set1_epi64x(to_lane(hi));
+		size_t i = 0;
+		for (; i + 2 <= n; i += 2) {
+			__m128i live, v = sse_load(slots + i, offset, live);
+			vlo = _mm_blendv_epi8(vlo, v, _mm_and_si128(live, sse_less(v, vlo)));
+			vhi = _mm_blendv_epi8(vhi, v, _mm_and_si128(live, sse_less(vhi, v)));
+		}
+		long long los[2], his[2];
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(los), vlo);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(his), vhi);
+		for (int k = 0; k < 2; k++) {
+			if (from_lane(los[k]) < lo) lo = from_lane(los[k]);
+			if (hi < from_lane(his[k])) hi = from_lane(his[k]);
+		}
+		scalar_min_max(slots + i, n - i, offset, lo, hi);
+	}
+#endif
+
+	static void add_lane(sum_type &acc, long long bits, std::integral_constant<lane_kind, double_lanes>) {
+		double d;
+		std::memcpy(&d, &bits, sizeof(d));
+		acc += d;
+	}
+	template<class Tag>
+	static void add_lane(sum_type &acc, long long bits, Tag) {
+		acc = (sum_type)((unsigned long long)acc + (unsigned long long)bits);
+	}
+
+public:
+	/**
+	 * add every value to acc.
+	 */
+	template<class Ptr>
+	static void sum(Ptr const *slots, size_t n, size_t offset, sum_type &acc, simd_level level) {
+		switch (usable(level)) {
+#ifdef SJTU_SIMD_X86
+		case simd_avx512bw: avx512_sum(slots, n, offset, acc); return;
+		case simd_avx2: avx2_sum(slots, n, offset, acc); return;
+		case simd_sse42: sse_sum(slots, n, offset, acc); return;
+#endif
+		default: scalar_sum(slots, n, offset, acc);
+		}
+	}
+
+	/**
+	 * lower lo and raise hi to cover every value. values that compare
+	 *   false both ways (NaN) are skipped.
+	 */
+	template<class Ptr>
+	static void min_max(Ptr const *slots, size_t n, size_t offset, T &lo, T &hi, simd_level level) {
+		switch (usable(level)) {
+#ifdef SJTU_SIMD_X86
+		case simd_avx512bw: avx512_min_max(slots, n, offset, lo, hi); return;
+		case simd_avx2: avx2_min_max(slots, n, offset, lo, hi); return;
+		case simd_sse42: sse_min_max(slots, n, offset, lo, hi); return;
+#endif
+		default: scalar_min_max(slots, n, offset, lo, hi);
+		}
+	}
+
+	/**
+	 * the number of values for which pred returns true. pred is opaque
+	 *   code, so only the loads could be vectorized; gathering blocks of
+	 *   values to run pred over them measured slower than this loop at
+	 *   every level, so every level runs it.
+	 */
+	template<class Ptr, class Pred>
+	static size_t count_if(Ptr const *slots, size_t n, size_t offset, Pred &pred, simd_level) {
+		size_t count = 0;
+		for (size_t i = 0; i < n; i++)
+			if (slots[i] && pred(value_at(slots[i], offset))) count++;
+		return count;
+	}
+};
+
+
+    /**
+     * the probing kernels of the open-addressed storage policies, built
+     * once per level. probe_kernels::active() is the set for
+     * active_simd_level(); at(level) any set the cpu runs.
+     *
+     * only cuckoo_storage uses them. a vector compare over Robin Hood
+     * {dist, frag} windows was measured slower than the scalar probe at
+     * every load factor: the slot to read next then depends on the data
+     * of the compare, where the scalar loop lets the cpu run ahead on
+     * branch prediction.
+     */
+struct probe_kernels {
+	simd_level level;
+	/**
+	 * a and b point at the four fragments of a cuckoo_storage bucket
+	 *   each. bit i of the result is a[i] == frag, bit 4 + i is
+	 *   b[i] == frag.
+	 */
+	unsigned int (*bucket_match)(const unsigned int *a, const unsigned int *b, unsigned int frag);
+
+	static const probe_kernels &at(simd_level level) {
+		static const probe_kernels sets[] = {
+			{simd_scalar, scalar_bucket_match},
+#ifdef SJTU_SIMD_X86
+			{simd_sse2, sse2_bucket_match},
+			{simd_sse42, sse2_bucket_match},
+			{simd_avx2, avx2_bucket_match},
+			{simd_avx512bw, avx512_bucket_match},
+#endif
+		};
+		simd_level cpu = cpu_simd_level();
+		return sets[level < cpu ? level : cpu];
+	}
+	static const probe_kernels &active() { return at(active_simd_level()); }
+
+private:
+	static unsigned int scalar_bucket_match(const unsigned int *a, const unsigned int *b, unsigned int frag) {
+		unsigned int match = 0;
+		for (int i = 0; i < 4; i++) match |= (unsigned int)(a[i] == frag) << i | (unsigned int)(b[i] == frag) << (4 + i);
+		return match;
+	}
+
+#ifdef SJTU_SIMD_X86
+	__attribute__((target("sse2")))
+	static unsigned int sse2_bucket_match(const unsigned int *a, const unsigned int *b, unsigned int frag) {
+		__m128i f = _mm_set1_epi32((int)frag);
+		__m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a));
+		__m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b));
+		return (unsigned int)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(va, f)))
+			| (unsigned int)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(vb, f))) << 4;
+	}
+
+	__attribute__((target("avx2")))
+	static unsigned int avx2_bucket_match(const unsigned int *a, const unsigned int *b, unsigned int frag) {
+		__m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a))),
+			_mm_loadu_si128(reinterpret_cast<const __m128i*>(b)), 1);
+		return (unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(v, _mm256_set1_epi32((int)frag))));
+	}
+
+	/**
+	 * the same compare straight into a mask register.
+	 */
+	__attribute__((target("avx2,avx512f,avx512vl")))
+	static unsigned int avx512_bucket_match(const unsigned int *a, const unsigned int *b, unsigned int frag) {
+		__m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a))),
+			_mm_loadu_si128(reinterpret_cast<const __m128i*>(b)), 1);
+		return _mm256_cmpeq_epi32_mask(v, _mm256_set1_epi32((int)frag));
+	}
+#endif
+};
+
+}
+
+#endif
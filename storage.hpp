@@ -0,0 +1,943 @@
+/**
+ * implement the open-addressed storage policies of linked_hashmap
+ */
+#ifndef SJTU_STORAGE_HPP
+#define SJTU_STORAGE_HPP
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include "linked_hashmap.hpp"
+#include "simd.hpp"
+
+namespace sjtu {
+    /**
+     * robin_hood_storage: open addressing with linear probing, where an
+     * insert takes the slot of any node closer to its home slot than the
+     * inserted one is to its own, and erase shifts the following nodes
+     * back instead of leaving tombstones. probe lengths stay short and
+     * even at load factors around 0.9, and nodes need no links of their
+     * own. keys colliding on their whole hash code make probes long; it
+     * has no tree fallback, so pair it with seeded_hash for untrusted keys.
+     */
+struct robin_hood_storage {
+	template<class Node>
+	struct hook {};
+
+	template<class Key, class Node, class Equal>
+	class table {
+	public:
+		static const size_t PROBE_LIMIT = 64;
+
+	private:
+		/**
+		 * meta[i].dist is 0 for an empty slot, else 1 + how far slots[i]
+		 * sits from its home slot; meta[i].frag holds the low bits of its
+		 * hash code. probing walks meta, eight bytes a slot, and touches a
+		 * node only when both say it could be the one.
+		 */
+		struct slot_meta {
+			unsigned int dist;
+			unsigned int frag;
+		};
+		Node **slots;
+		slot_meta *meta;
+		size_t slot_capacity;
+		unsigned int shift;
+
+		/**
+		 * Fibonacci hashing: the top bits of hash_code times 2^64 / phi,
+		 * so that hashers returning the key itself still spread.
+		 */
+		size_t home(size_t hash_code) const {
+			return (size_t)(((unsigned long long)hash_code * 0x9e3779b97f4a7c15ULL) >> shift);
+		}
+
+		void place(Node *node) {
+			size_t mask = slot_capacity - 1, i = home(node->hash_code);
+			slot_meta m = {1, (unsigned int)node->hash_code};
+			while (true) {
+				if (meta[i].dist == 0) {
+					slots[i] = node;
+					meta[i] = m;
+					return;
+				}
+				if (meta[i].dist < m.dist) {
+					Node *t = slots[i];
+					slots[i] = node;
+					node = t;
+					slot_meta tm = meta[i];
+					meta[i] = m;
+					m = tm;
+				}
+				i = (i + 1) & mask;
+				m.dist++;
+			}
+		}
+
+		void allocate(size_t capacity) {
+			Node **new_slots = new Node*[capacity];
+			slot_meta *new_meta;
+			try {
+				new_meta = new slot_meta[capacity];
+			} catch (...) {
+				delete[] new_slots;
+				throw;
+			}
+			delete[] slots;
+			delete[] meta;
+			slots = new_slots;
+			meta = new_meta;
+			slot_capacity = capacity;
+			shift = 64;
+			for (size_t c = capacity; c > 1; c >>= 1) shift--;
+			clear();
+		}
+
+	public:
+		table() : slots(nullptr), meta(nullptr), slot_capacity(0), shift(64) {}
+
+		static double default_load_factor() { return 0.9; }
+		static double max_load_factor_limit() { return 0.99; }
+
+		void init(size_t capacity) { allocate(capacity); }
+		void destroy() {
+			delete[] slots;
+			delete[] meta;
+			forget();
+		}
+		void forget() {
+			slots = nullptr;
+			meta = nullptr;
+			slot_capacity = 0;
+		}
+		size_t capacity() const { return slot_capacity; }
+
+		size_t bucket_count() const { return slot_capacity; }
+		size_t bucket_of(size_t hash_code) const { return home(hash_code); }
+		Node *bucket_first(size_t b) const { return meta[b].dist ? slots[b] : nullptr; }
+		Node *bucket_next(const Node *, size_t) const { return nullptr; }
+
+		/**
+		 * a probe ends at the first slot whose node is closer to home than
+		 *   key would be, since an insert of key would have taken it.
+		 */
+		Node *find(const Key &key, size_t hash_code, const Equal &key_equal, size_t &probe) const {
+			size_t mask = slot_capacity - 1, i = home(hash_code);
+			unsigned int d = 1, frag = (unsigned int)hash_code;
+			for (;; i = (i + 1) & mask, d++) {
+				if (meta[i].dist < d) break;
+				if (meta[i].frag != frag) continue;
+				Node *node = slots[i];
+				if (node->hash_code == hash_code && key_equal(node->data.first, key)) {
+					probe = d - 1;
+					return node;
+				}
+			}
+			probe = d - 1;
+			return nullptr;
+		}
+
+		void insert(Node *node) { place(node); }
+
+		/**
+		 * backward-shift deletion: pull every following node that is not
+		 *   at home one slot back, so no tombstone is needed.
+		 */
+		void erase(Node *node) {
+			size_t mask = slot_capacity - 1, i = home(node->hash_code);
+			while (meta[i].dist == 0 || slots[i] != node) i = (i + 1) & mask;
+			size_t j = (i + 1) & mask;
+			while (meta[j].dist > 1) {
+				slots[i] = slots[j];
+				meta[i] = meta[j];
+				meta[i].dist--;
+				i = j;
+				j = (j + 1) & mask;
+			}
+			meta[i].dist = 0;
+		}
+
+		void clear() {
+			for (size_t i = 0; i < slot_capacity; i++) meta[i].dist = 0;
+		}
+
+		template<class Link>
+		void rebuild(Link *first, Link *last, size_t capacity) {
+			if (capacity != slot_capacity) allocate(capacity);
+			else clear();
+			for (Link *p = first; p != last; p = p->order_next) place(static_cast<Node*>(p));
+		}
+
+		void copy_shape(const table &) {}
+		void long_probe(Node *) {}
+	};
+};
+
+    /**
+     * cuckoo_storage: every key may only sit in one of two buckets of
+     * four slots, picked by two hash functions of its hash code, so a
+     * find reads at most two 64-byte bucket lines (plus the stash, which
+     * is empty unless inserts have failed). inserts evict residents to
+     * their other bucket when both are full, so they cost more; this is
+     * meant for tables that are read far more than written.
+     * above simd_scalar a find matches the fragments of both buckets in
+     * one vector compare (see probe_kernels). that halves the cost of a
+     * miss on a table in cache, but both lines must arrive before any
+     * node is read, so hits on a table far out of cache get slower;
+     * SJTU_SIMD=scalar keeps the bucket-at-a-time loop. a table takes
+     * the kernels of the active level when it is allocated, so a change
+     * of level reaches a map at its next rehash.
+     * keys an insert cannot place go to a small stash scanned by every
+     * find. once an insert finds PROBE_LIMIT keys there and the hasher
+     * cannot be reseeded, the table doubles. keys colliding on their
+     * whole hash code stay in the stash whatever the size; it has no tree
+     * fallback, so pair it with seeded_hash for untrusted keys.
+     */
+struct cuckoo_storage {
+	template<class Node>
+	struct hook {};
+
+	template<class Key, class Node, class Equal>
+	class table {
+	public:
+		static const size_t PROBE_LIMIT = 8;
+
+	private:
+		static const size_t WAYS = 4;
+		static const size_t MAX_KICKS = 128;
+		// long_probe grows the table to at most this many slots per node
+		static const size_t MAX_SPREAD = 8;
+
+		/**
+		 * one cache line: the low 32 bits of every resident's hash code,
+		 * checked before a node is touched, and the residents themselves
+		 * (nullptr for a free slot).
+		 */
+		struct alignas(64) bucket {
+			unsigned int frag[WAYS];
+			Node *node[WAYS];
+		};
+
+		unsigned char *raw;
+		bucket *buckets;
+		size_t num_buckets;
+		unsigned int shift;
+		Node **stash;
+		size_t stash_size;
+		size_t stash_capacity;
+		size_t residents;
+		/**
+		 * the stash size at which long_probe grows the table; raised after
+		 * a growth that left keys there, so that those cannot make the
+		 * table double again until the stash has doubled too.
+		 */
+		size_t stash_limit;
+		const probe_kernels *kernels;
+		/**
+		 * picks which resident an insert evicts; any sequence that does
+		 * not keep returning to the same slot will do.
+		 */
+		size_t kick_state;
+
+		size_t first_bucket(size_t hash_code) const {
+			return (size_t)(((unsigned long long)hash_code * 0x9e3779b97f4a7c15ULL) >> shift);
+		}
+		size_t second_bucket(size_t hash_code) const {
+			size_t b = (size_t)(((unsigned long long)hash_code * 0xc2b2ae3d27d4eb4fULL) >> shift);
+			return b != first_bucket(hash_code) ? b : b ^ 1;
+		}
+
+		bool put(size_t b, Node *node) {
+			for (size_t i = 0; i < WAYS; i++) {
+				if (buckets[b].node[i] == nullptr) {
+					buckets[b].node[i] = node;
+					buckets[b].frag[i] = (unsigned int)node->hash_code;
+					return true;
+				}
+			}
+			return false;
+		}
+
+		/**
+		 * make room for one more stash entry, so that pushing it cannot fail.
+		 */
+		void stash_reserve() {
+			if (stash_size < stash_capacity) return;
+			size_t capacity = stash_capacity ? stash_capacity * 2 : 4;
+			Node **grown = new Node*[capacity];
+			for (size_t i = 0; i < stash_size; i++) grown[i] = stash[i];
+			delete[] stash;
+			stash = grown;
+			stash_capacity = capacity;
+		}
+
+		/**
+		 * place node, evicting residents along a random walk when both of
+		 *   its buckets are full; the last one evicted after MAX_KICKS goes
+		 *   to the stash.
+		 * the stash has room before the first eviction: once residents have
+		 *   moved, the one left over must have somewhere to go.
+		 */
+		void place(Node *node) {
+			size_t b = first_bucket(node->hash_code);
+			if (put(b, node) || put(second_bucket(node->hash_code), node)) return;
+			stash_reserve();
+			for (size_t kick = 0; kick < MAX_KICKS; kick++) {
+				kick_state = kick_state * 6364136223846793005ULL + 1442695040888963407ULL;
+				size_t i = (kick_state >> 60) % WAYS;
+				Node *evicted = buckets[b].node[i];
+				buckets[b].node[i] = node;
+				buckets[b].frag[i] = (unsigned int)node->hash_code;
+				node = evicted;
+				size_t first = first_bucket(node->hash_code);
+				b = b == first ? second_bucket(node->hash_code) : first;
+				if (put(b, node)) return;
+			}
+			stash[stash_size++] = node;
+		}
+
+		void allocate(size_t capacity) {
+			size_t count = capacity / WAYS < 2 ? 2 : capacity / WAYS;
+			unsigned char *new_raw = new unsigned char[count * sizeof(bucket) + sizeof(bucket)];
+			delete[] raw;
+			raw = new_raw;
+			size_t misalign = (size_t)raw % sizeof(bucket);
+			buckets = reinterpret_cast<bucket*>(raw + (misalign ? sizeof(bucket) - misalign : 0));
+			num_buckets = count;
+			shift = 64;
+			for (size_t c = count; c > 1; c >>= 1) shift--;
+			kernels = &probe_kernels::active();
+			clear();
+		}
+
+		/**
+		 * place every node again in a table of twice the capacity.
+		 * the array the nodes are gathered in serves as the stash while
+		 *   they are placed: each placement adds at most one entry, behind
+		 *   the node being read, so nothing can fail halfway.
+		 */
+		void grow() {
+			size_t count = 0;
+			Node **all = new Node*[capacity() + stash_size];
+			for (size_t b = 0; b < num_buckets; b++)
+				for (size_t i = 0; i < WAYS; i++)
+					if (buckets[b].node[i] != nullptr) all[count++] = buckets[b].node[i];
+			for (size_t i = 0; i < stash_size; i++) all[count++] = stash[i];
+			try {
+				allocate(capacity() * 2);
+			} catch (...) {
+				delete[] all;
+				throw;
+			}
+			residents = count;
+			delete[] stash;
+			stash = all;
+			stash_capacity = count;
+			for (size_t i = 0; i < count; i++) place(all[i]);
+			// give back the room the gathering took, if there is memory to
+			try {
+				size_t capacity = stash_size > 4 ? stash_size : 4;
+				Node **kept = new Node*[capacity];
+				for (size_t i = 0; i < stash_size; i++) kept[i] = stash[i];
+				delete[] stash;
+				stash = kept;
+				stash_capacity = capacity;
+			} catch (...) {
+			}
+		}
+
+	public:
+		table() : raw(nullptr), buckets(nullptr), num_buckets(0), shift(64), stash(nullptr), stash_size(0), stash_capacity(0),
+			residents(0), stash_limit(PROBE_LIMIT), kernels(nullptr), kick_state(0) {}
+
+		static double default_load_factor() { return 0.9; }
+		static double max_load_factor_limit() { return 0.97; }
+
+		void init(size_t capacity) { allocate(capacity); }
+		void destroy() {
+			delete[] raw;
+			delete[] stash;
+			forget();
+		}
+		void forget() {
+			raw = nullptr;
+			buckets = nullptr;
+			num_buckets = 0;
+			stash = nullptr;
+			stash_size = stash_capacity = 0;
+			residents = 0;
+		}
+		size_t capacity() const { return num_buckets * WAYS; }
+
+		/**
+		 * the stash counts as one more bucket, after the others.
+		 */
+		size_t bucket_count() const { return num_buckets + 1; }
+		size_t bucket_of(size_t hash_code) const { return first_bucket(hash_code); }
+		Node *bucket_first(size_t b) const {
+			if (b == num_buckets) return stash_size ? stash[0] : nullptr;
+			for (size_t i = 0; i < WAYS; i++)
+				if (buckets[b].node[i] != nullptr) return buckets[b].node[i];
+			return nullptr;
+		}
+		Node *bucket_next(const Node *node, size_t b) const {
+			if (b == num_buckets) {
+				for (size_t i = 0; i + 1 < stash_size; i++)
+					if (stash[i] == node) return stash[i + 1];
+				return nullptr;
+			}
+			size_t i = 0;
+			while (buckets[b].node[i] != node) i++;
+			for (i++; i < WAYS; i++)
+				if (buckets[b].node[i] != nullptr) return buckets[b].node[i];
+			return nullptr;
+		}
+
+		Node *find(const Key &key, size_t hash_code, const Equal &key_equal, size_t &probe) const {
+			unsigned int frag = (unsigned int)hash_code;
+			probe = 0;
+			const probe_kernels &simd = *kernels;
+			if (simd.level == simd_scalar) {
+				for (int round = 0; round < 2; round++) {
+					const bucket &b = buckets[round == 0 ? first_bucket(hash_code) : second_bucket(hash_code)];
+					for (size_t i = 0; i < WAYS; i++) {
+						if (b.frag[i] != frag || b.node[i] == nullptr) continue;
+						if (b.node[i]->hash_code == hash_code && key_equal(b.node[i]->data.first, key)) return b.node[i];
+					}
+				}
+			} else {
+				const bucket &b1 = buckets[first_bucket(hash_code)], &b2 = buckets[second_bucket(hash_code)];
+				for (unsigned int match = simd.bucket_match(b1.frag, b2.frag, frag); match != 0; match &= match - 1) {
+					unsigned int i = __builtin_ctz(match);
+					Node *node = (i < WAYS ? b1 : b2).node[i % WAYS];
+					if (node != nullptr && node->hash_code == hash_code && key_equal(node->data.first, key)) return node;
+				}
+			}
+			for (size_t i = 0; i < stash_size; i++, probe++)
+				if (stash[i]->hash_code == hash_code && key_equal(stash[i]->data.first, key)) return stash[i];
+			return nullptr;
+		}
+
+		void insert(Node *node) {
+			place(node);
+			residents++;
+		}
+
+		void erase(Node *node) {
+			residents--;
+			size_t candidates[2] = {first_bucket(node->hash_code), second_bucket(node->hash_code)};
+			for (size_t c = 0; c < 2; c++) {
+				bucket &b = buckets[candidates[c]];
+				for (size_t i = 0; i < WAYS; i++) {
+					if (b.node[i] == node) {
+						b.node[i] = nullptr;
+						return;
+					}
+				}
+			}
+			for (size_t i = 0; i < stash_size; i++) {
+				if (stash[i] == node) {
+					stash[i] = stash[--stash_size];
+					return;
+				}
+			}
+		}
+
+		void clear() {
+			for (size_t b = 0; b < num_buckets; b++)
+				for (size_t i = 0; i < WAYS; i++) buckets[b].node[i] = nullptr;
+			stash_size = 0;
+			residents = 0;
+		}
+
+		template<class Link>
+		void rebuild(Link *first, Link *last, size_t capacity) {
+			if (capacity != this->capacity()) allocate(capacity);
+			else clear();
+			for (Link *p = first; p != last; p = p->order_next) {
+				place(static_cast<Node*>(p));
+				residents++;
+			}
+		}
+
+		void copy_shape(const table &) {}
+		/**
+		 * the stash is long and reseeding was not possible: double.
+		 */
+		void long_probe(Node *) {
+			if (stash_size < stash_limit || capacity() >= residents * MAX_SPREAD) return;
+			grow();
+			stash_limit = stash_size * 2 > PROBE_LIMIT ? stash_size * 2 : PROBE_LIMIT;
+		}
+	};
+};
+
+
+    /**
+     * hopscotch_storage: open addressing where every node sits within
+     * NEIGHBORHOOD slots of its home slot, and each home slot keeps a
+     * bitmap of which of those slots hold its nodes. a find only visits
+     * the slots named in one bitmap, usually within a line or two of
+     * home. inserts probe for a free slot and hop it back towards home
+     * by moving nodes within their own neighborhoods. a node that cannot
+     * be brought close enough goes to a stash scanned by every find; as
+     * for cuckoo_storage, pair it with seeded_hash for untrusted keys.
+     */
+struct hopscotch_storage {
+	template<class Node>
+	struct hook {};
+
+	template<class Key, class Node, class Equal>
+	class table {
+	public:
+		static const size_t PROBE_LIMIT = 8;
+
+	private:
+		static const size_t NEIGHBORHOOD = 32;
+		/**
+		 * how far an insert looks for a free slot before giving up.
+		 */
+		static const size_t FREE_RANGE = 512;
+		// long_probe grows the table to at most this many slots per node
+		static const size_t MAX_SPREAD = 8;
+
+		/**
+		 * hop[h] has bit d set when slots[h + d] holds a node whose home is
+		 * h; frag[i] holds the low 32 bits of slots[i]'s hash code. a free
+		 * slot is nullptr in slots.
+		 */
+		Node **slots;
+		unsigned int *hop;
+		unsigned int *frag;
+		size_t slot_capacity;
+		unsigned int shift;
+		Node **stash;
+		size_t stash_size;
+		size_t stash_capacity;
+		size_t residents;
+		/**
+		 * the stash size at which long_probe grows the table, raised after
+		 * a growth the same way as cuckoo_storage's.
+		 */
+		size_t stash_limit;
+
+		size_t home(size_t hash_code) const {
+			return (size_t)(((unsigned long long)hash_code * 0x9e3779b97f4a7c15ULL) >> shift);
+		}
+
+		void stash_push(Node *node) {
+			if (stash_size == stash_capacity) {
+				size_t capacity = stash_capacity ? stash_capacity * 2 : 4;
+				Node **grown = new Node*[capacity];
+				for (size_t i = 0; i < stash_size; i++) grown[i] = stash[i];
+				delete[] stash;
+				stash = grown;
+				stash_capacity = capacity;
+			}
+			stash[stash_size++] = node;
+		}
+
+		/**
+		 * move some node from the NEIGHBORHOOD - 1 slots before the free
+		 *   slot free into it, as long as that keeps it in its own
+		 *   neighborhood. return the slot it left, or free if none could.
+		 */
+		size_t hop_back(size_t free) {
+			size_t mask = slot_capacity - 1;
+			for (size_t back = NEIGHBORHOOD - 1; back > 0; back--) {
+				size_t h = (free - back) & mask;
+				unsigned int bits = hop[h];
+				for (size_t d = 0; d < back; d++) {
+					if (!(bits & (1u << d))) continue;
+					size_t from = (h + d) & mask;
+					slots[free] = slots[from];
+					frag[free] = frag[from];
+					slots[from] = nullptr;
+					hop[h] = (bits & ~(1u << d)) | (1u << back);
+					return from;
+				}
+			}
+			return free;
+		}
+
+		void place(Node *node) {
+			size_t mask = slot_capacity - 1, h = home(node->hash_code), free = h, dist = 0;
+			size_t range = FREE_RANGE < slot_capacity ? FREE_RANGE : slot_capacity;
+			while (dist < range && slots[free] != nullptr) {
+				free = (free + 1) & mask;
+				dist++;
+			}
+			if (dist == range) {
+				stash_push(node);
+				return;
+			}
+			while (dist >= NEIGHBORHOOD) {
+				size_t from = hop_back(free);
+				if (from == free) {
+					stash_push(node);
+					return;
+				}
+				free = from;
+				dist = (free - h) & mask;
+			}
+			slots[free] = node;
+			frag[free] = (unsigned int)node->hash_code;
+			hop[h] |= 1u << dist;
+		}
+
+		void allocate(size_t capacity) {
+			Node **new_slots = new Node*[capacity];
+			unsigned int *new_hop = nullptr, *new_frag;
+			try {
+				new_hop = new unsigned int[capacity];
+				new_frag = new unsigned int[capacity];
+			} catch (...) {
+				delete[] new_slots;
+				delete[] new_hop;
+				throw;
+			}
+			delete[] slots;
+			delete[] hop;
+			delete[] frag;
+			slots = new_slots;
+			hop = new_hop;
+			frag = new_frag;
+			slot_capacity = capacity;
+			shift = 64;
+			for (size_t c = capacity; c > 1; c >>= 1) shift--;
+			clear();
+		}
+
+		/**
+		 * place every node again in a table of twice the capacity, the
+		 *   gathering array serving as the stash as in cuckoo_storage.
+		 */
+		void grow() {
+			size_t count = 0;
+			Node **all = new Node*[slot_capacity + stash_size];
+			for (size_t i = 0; i < slot_capacity; i++)
+				if (slots[i] != nullptr) all[count++] = slots[i];
+			for (size_t i = 0; i < stash_size; i++) all[count++] = stash[i];
+			try {
+				allocate(slot_capacity * 2);
+			} catch (...) {
+				delete[] all;
+				throw;
+			}
+			residents = count;
+			delete[] stash;
+			stash = all;
+			stash_capacity = count;
+			for (size_t i = 0; i < count; i++) place(all[i]);
+			try {
+				size_t capacity = stash_size > 4 ? stash_size : 4;
+				Node **kept = new Node*[capacity];
+				for (size_t i = 0; i < stash_size; i++) kept[i] = stash[i];
+				delete[] stash;
+				stash = kept;
+				stash_capacity = capacity;
+			} catch (...) {
+			}
+		}
+
+	public:
+		table() : slots(nullptr), hop(nullptr), frag(nullptr), slot_capacity(0), shift(64), stash(nullptr), stash_size(0), stash_capacity(0),
+			residents(0), stash_limit(PROBE_LIMIT) {}
+
+		static double default_load_factor() { return 0.9; }
+		static double max_load_factor_limit() { return 0.95; }
+
+		void init(size_t capacity) { allocate(capacity); }
+		void destroy() {
+			delete[] slots;
+			delete[] hop;
+			delete[] frag;
+			delete[] stash;
+			forget();
+		}
+		void forget() {
+			slots = nullptr;
+			hop = nullptr;
+			frag = nullptr;
+			slot_capacity = 0;
+			stash = nullptr;
+			stash_size = stash_capacity = 0;
+			residents = 0;
+		}
+		size_t capacity() const { return slot_capacity; }
+
+		/**
+		 * the stash counts as one more bucket, after the slots.
+		 */
+		size_t bucket_count() const { return slot_capacity + 1; }
+		size_t bucket_of(size_t hash_code) const { return home(hash_code); }
+		Node *bucket_first(size_t b) const {
+			if (b == slot_capacity) return stash_size ? stash[0] : nullptr;
+			return slots[b];
+		}
+		Node *bucket_next(const Node *node, size_t b) const {
+			if (b == slot_capacity)
+				for (size_t i = 0; i + 1 < stash_size; i++)
+					if (stash[i] == node) return stash[i + 1];
+			return nullptr;
+		}
+
+		Node *find(const Key &key, size_t hash_code, const Equal &key_equal, size_t &probe) const {
+			size_t mask = slot_capacity - 1, h = home(hash_code);
+			unsigned int bits = hop[h], f = (unsigned int)hash_code;
+			probe = 0;
+			while (bits != 0) {
+				size_t i = (h + __builtin_ctz(bits)) & mask;
+				bits &= bits - 1;
+				if (frag[i] == f && slots[i]->hash_code == hash_code && key_equal(slots[i]->data.first, key)) return slots[i];
+			}
+			for (size_t i = 0; i < stash_size; i++, probe++)
+				if (stash[i]->hash_code == hash_code && key_equal(stash[i]->data.first, key)) return stash[i];
+			return nullptr;
+		}
+
+		void insert(Node *node) {
+			place(node);
+			residents++;
+		}
+
+		void erase(Node *node) {
+			residents--;
+			size_t mask = slot_capacity - 1, h = home(node->hash_code);
+			for (unsigned int bits = hop[h]; bits != 0; bits &= bits - 1) {
+				size_t d = __builtin_ctz(bits), i = (h + d) & mask;
+				if (slots[i] == node) {
+					slots[i] = nullptr;
+					hop[h] &= ~(1u << d);
+					return;
+				}
+			}
+			for (size_t i = 0; i < stash_size; i++) {
+				if (stash[i] == node) {
+					stash[i] = stash[--stash_size];
+					return;
+				}
+			}
+		}
+
+		void clear() {
+			for (size_t i = 0; i < slot_capacity; i++) {
+				slots[i] = nullptr;
+				hop[i] = 0;
+			}
+			stash_size = 0;
+			residents = 0;
+		}
+
+		template<class Link>
+		void rebuild(Link *first, Link *last, size_t capacity) {
+			if (capacity != slot_capacity) allocate(capacity);
+			else clear();
+			for (Link *p = first; p != last; p = p->order_next) {
+				place(static_cast<Node*>(p));
+				residents++;
+			}
+		}
+
+		void copy_shape(const table &) {}
+		/**
+		 * the stash is long and reseeding was not possible: double.
+		 */
+		void long_probe(Node *) {
+			if (stash_size < stash_limit || slot_capacity >= residents * MAX_SPREAD) return;
+			grow();
+			stash_limit = stash_size * 2 > PROBE_LIMIT ? stash_size * 2 : PROBE_LIMIT;
+		}
+	};
+};
+
+
+    /**
+     * soa_storage: Robin Hood probing like robin_hood_storage, with the
+     * table split into parallel arrays by slot: probe metadata, a copy of
+     * each key, and the node pointers. keys that are trivially copyable
+     * and at most INLINE_KEY_SIZE bytes are copied into the key array, so
+     * a probe compares keys without touching any node and only a hit
+     * reads its node; values and order links stay out of the probe path
+     * however large they are. other keys are compared through the node,
+     * as in robin_hood_storage. the same caveat about keys colliding on
+     * their whole hash code applies.
+     */
+struct soa_storage {
+	template<class Node>
+	struct hook {};
+
+	static const size_t INLINE_KEY_SIZE = 16;
+
+	template<class Key, class Node, class Equal>
+	class table {
+	public:
+		static const size_t PROBE_LIMIT = 64;
+
+	private:
+		typedef std::integral_constant<bool,
+			std::is_trivially_copyable<Key>::value && sizeof(Key) <= INLINE_KEY_SIZE> inline_keys;
+		// raw room for one inline key; a struct so that slots can be copied whole
+		struct key_cell {
+			alignas(Key) unsigned char bytes[sizeof(Key)];
+		};
+
+		/**
+		 * slot i is described by meta[i] (dist is 0 when empty, else 1 +
+		 * how far it sits from home; frag is the low bits of its hash
+		 * code), keys[i] (inline keys only, else nullptr) and nodes[i].
+		 */
+		struct slot_meta {
+			unsigned int dist;
+			unsigned int frag;
+		};
+		slot_meta *meta;
+		key_cell *keys;
+		Node **nodes;
+		size_t slot_capacity;
+		unsigned int shift;
+
+		size_t home(size_t hash_code) const {
+			return (size_t)(((unsigned long long)hash_code * 0x9e3779b97f4a7c15ULL) >> shift);
+		}
+
+		bool same_key(size_t i, const Key &key, const Equal &key_equal, std::true_type) const {
+			return key_equal(*reinterpret_cast<const Key*>(&keys[i]), key);
+		}
+		bool same_key(size_t i, const Key &key, const Equal &key_equal, std::false_type) const {
+			return key_equal(nodes[i]->data.first, key);
+		}
+
+		void set_key(key_cell &cell, const Node *node, std::true_type) { new (&cell) Key(node->data.first); }
+		void set_key(key_cell &, const Node *, std::false_type) {}
+
+		void place(Node *node) {
+			size_t mask = slot_capacity - 1, i = home(node->hash_code);
+			slot_meta m = {1, (unsigned int)node->hash_code};
+			key_cell k;
+			set_key(k, node, inline_keys());
+			while (true) {
+				if (meta[i].dist == 0) {
+					meta[i] = m;
+					if (keys) keys[i] = k;
+					nodes[i] = node;
+					return;
+				}
+				if (meta[i].dist < m.dist) {
+					slot_meta tm = meta[i];
+					meta[i] = m;
+					m = tm;
+					if (keys) {
+						key_cell tk = keys[i];
+						keys[i] = k;
+						k = tk;
+					}
+					Node *t = nodes[i];
+					nodes[i] = node;
+					node = t;
+				}
+				i = (i + 1) & mask;
+				m.dist++;
+			}
+		}
+
+		void allocate(size_t capacity) {
+			slot_meta *new_meta = new slot_meta[capacity];
+			key_cell *new_keys = nullptr;
+			Node **new_nodes;
+			try {
+				if (inline_keys::value) new_keys = new key_cell[capacity];
+				new_nodes = new Node*[capacity];
+			} catch (...) {
+				delete[] new_meta;
+				delete[] new_keys;
+				throw;
+			}
+			delete[] meta;
+			delete[] keys;
+			delete[] nodes;
+			meta = new_meta;
+			keys = new_keys;
+			nodes = new_nodes;
+			slot_capacity = capacity;
+			shift = 64;
+			for (size_t c = capacity; c > 1; c >>= 1) shift--;
+			clear();
+		}
+
+	public:
+		table() : meta(nullptr), keys(nullptr), nodes(nullptr), slot_capacity(0), shift(64) {}
+
+		static double default_load_factor() { return 0.9; }
+		static double max_load_factor_limit() { return 0.99; }
+
+		void init(size_t capacity) { allocate(capacity); }
+		void destroy() {
+			delete[] meta;
+			delete[] keys;
+			delete[] nodes;
+			forget();
+		}
+		void forget() {
+			meta = nullptr;
+			keys = nullptr;
+			nodes = nullptr;
+			slot_capacity = 0;
+		}
+		size_t capacity() const { return slot_capacity; }
+
+		size_t bucket_count() const { return slot_capacity; }
+		size_t bucket_of(size_t hash_code) const { return home(hash_code); }
+		Node *bucket_first(size_t b) const { return meta[b].dist ? nodes[b] : nullptr; }
+		Node *bucket_next(const Node *, size_t) const { return nullptr; }
+
+		Node *find(const Key &key, size_t hash_code, const Equal &key_equal, size_t &probe) const {
+			size_t mask = slot_capacity - 1, i = home(hash_code);
+			unsigned int d = 1, frag = (unsigned int)hash_code;
+			for (;; i = (i + 1) & mask, d++) {
+				if (meta[i].dist < d) break;
+				if (meta[i].frag != frag || !same_key(i, key, key_equal, inline_keys())) continue;
+				probe = d - 1;
+				return nodes[i];
+			}
+			probe = d - 1;
+			return nullptr;
+		}
+
+		void insert(Node *node) { place(node); }
+
+		void erase(Node *node) {
+			size_t mask = slot_capacity - 1, i = home(node->hash_code);
+			while (meta[i].dist == 0 || nodes[i] != node) i = (i + 1) & mask;
+			size_t j = (i + 1) & mask;
+			while (meta[j].dist > 1) {
+				meta[i] = meta[j];
+				meta[i].dist--;
+				if (keys) keys[i] = keys[j];
+				nodes[i] = nodes[j];
+				i = j;
+				j = (j + 1) & mask;
+			}
+			meta[i].dist = 0;
+		}
+
+		void clear() {
+			for (size_t i = 0; i < slot_capacity; i++) meta[i].dist = 0;
+		}
+
+		template<class Link>
+		void rebuild(Link *first, Link *last, size_t capacity) {
+			if (capacity != slot_capacity) allocate(capacity);
+			else clear();
+			for (Link *p = first; p != last; p = p->order_next) place(static_cast<Node*>(p));
+		}
+
+		void copy_shape(const table &) {}
+		void long_probe(Node *) {}
+	};
+};
+
+}
+
+#endif
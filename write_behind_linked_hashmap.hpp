@@ -0,0 +1,337 @@
+/**
+ * implement a linked_hashmap taking writes through a queue
+ */
+#ifndef SJTU_WRITE_BEHIND_LINKEDHASHMAP_HPP
+#define SJTU_WRITE_BEHIND_LINKEDHASHMAP_HPP
+
+// only for std::equal_to<T> and std::hash<T>
+#include <functional>
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "linked_hashmap.hpp"
+#include "exceptions.hpp"
+
+namespace sjtu {
+    /**
+     * write_behind_linked_hashmap is for threads that only write: an
+     * async_insert() or async_erase() puts the change into a bounded
+     * lock-free queue and returns, and one applier thread, owned by the
+     * map, takes changes off the queue a batch at a time and applies
+     * them. Producers never wait for each other or for the map, only for
+     * room in the queue when the applier falls behind.
+     *
+     * Within a batch, changes to keys already in the map are applied
+     * grouped by the bucket their key goes to, so that the applier works
+     * through the table in order rather than at random. Keys the map does
+     * not hold are inserted after that, in the order they were queued.
+     * The map ends up as if every change had been applied one at a time:
+     * the changes to each key apply in queue order, and new keys join
+     * the insertion order in queue order.
+     *
+     * flush() waits until every change queued before it is applied.
+     * read() shows the map as the applier left it after some batch.
+     */
+template<
+	class Key,
+	class T,
+	class Hash = std::hash<Key>,
+	class Equal = std::equal_to<Key>,
+	class Storage = chained_storage
+> class write_behind_linked_hashmap {
+public:
+	typedef linked_hashmap<Key, T, Hash, Equal, Storage> map_type;
+	typedef typename map_type::value_type value_type;
+
+private:
+	static const size_t LINE = 64;
+	// empty polls before the applier starts sleeping between them
+	static const int IDLE_SPINS = 64;
+
+	enum change_kind { ASSIGN, ERASE, NOTHING };
+
+	/**
+	 * a queue cell. seq tells whose turn it is (see enqueue and
+	 *   take_batch): pos when free for the producer of position pos,
+	 *   pos + 1 once that producer filled it.
+	 */
+	struct cell {
+		unsigned long long seq;
+		change_kind kind;
+		alignas(Key) unsigned char key[sizeof(Key)];
+		alignas(T) unsigned char value[sizeof(T)];
+		Key & key_ref() { return *reinterpret_cast<Key *>(key); }
+		T & value_ref() { return *reinterpret_cast<T *>(value); }
+	};
+
+	cell *cells;
+	size_t mask;
+	size_t batch_limit;
+	char pad[LINE];
+	// next position a producer claims; shared by producers
+	unsigned long long enqueue_pos;
+	char pad_enqueue[LINE];
+	// changes applied so far; written by the applier after each batch
+	unsigned long long applied;
+	int stopping;
+	char pad_applied[LINE];
+	// the applier's alone
+	unsigned long long dequeue_pos;
+	size_t batches;
+	std::vector<std::pair<size_t, size_t> > order;
+	std::vector<char> deferred;
+	Equal key_equal;
+	std::exception_ptr error;
+	std::mutex map_lock;
+	map_type map;
+	std::thread applier;
+
+	/**
+	 * claim the next cell, waiting while the queue is full, and fill it
+	 *   with key and, unless null, value moved from.
+	 */
+	template<class K>
+	void enqueue(change_kind kind, K &&key, T *value) {
+		unsigned long long pos = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+		cell *c;
+		for (;;) {
+			c = cells + (pos & mask);
+			unsigned long long seq = __atomic_load_n(&c->seq, __ATOMIC_ACQUIRE);
+			long long diff = (long long)(seq - pos);
+			if (diff == 0) {
+				if (__atomic_compare_exchange_n(&enqueue_pos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+			} else {
+				// full: the applier has yet to free this cell
+				if (diff < 0) std::this_thread::yield();
+				pos = __atomic_load_n(&enqueue_pos, __ATOMIC_RELAXED);
+			}
+		}
+		c->kind = kind;
+		try {
+			new (c->key) Key(std::forward<K>(key));
+			try {
+				if (value) new (c->value) T(std::move(*value));
+			} catch (...) {
+				c->key_ref().~Key();
+				throw;
+			}
+		} catch (...) {
+			// the cell is ours and the applier waits for it: hand it over empty
+			c->kind = NOTHING;
+			__atomic_store_n(&c->seq, pos + 1, __ATOMIC_RELEASE);
+			throw;
+		}
+		__atomic_store_n(&c->seq, pos + 1, __ATOMIC_RELEASE);
+	}
+
+	/**
+	 * the cells filled from dequeue_pos on, up to batch_limit of them.
+	 */
+	size_t take_batch() {
+		size_t n = 0;
+		while (n < batch_limit) {
+			cell &c = cells[(dequeue_pos + n) & mask];
+			if (__atomic_load_n(&c.seq, __ATOMIC_ACQUIRE) != dequeue_pos + n + 1) break;
+			n++;
+		}
+		return n;
+	}
+
+	void apply(cell &c) {
+		if (c.kind == ASSIGN) {
+			pair<typename map_type::iterator, bool> result = map.try_emplace(std::move(c.key_ref()), std::move(c.value_ref()));
+			if (!result.second) result.first->second = std::move(c.value_ref());
+		} else if (c.kind == ERASE) {
+			map.erase(c.key_ref());
+		}
+	}
+
+	void release(cell &c, unsigned long long pos) {
+		if (c.kind != NOTHING) {
+			c.key_ref().~Key();
+			if (c.kind == ASSIGN) c.value_ref().~T();
+		}
+		__atomic_store_n(&c.seq, pos + mask + 1, __ATOMIC_RELEASE);
+	}
+
+	void note_error() {
+		if (!error) error = std::current_exception();
+	}
+
+	/**
+	 * apply n cells from dequeue_pos on, in two passes.
+	 * the first goes over the cells in bucket order, a stable sort
+	 *   keeping each key's changes in queue order. it updates and erases
+	 *   keys the map holds, and defers a change to a key it does not
+	 *   hold, and every later change to that key, to the second pass.
+	 *   the first pass inserts nothing, so the buckets do not move under
+	 *   it.
+	 * the second applies the deferred cells in queue order, so new keys
+	 *   are inserted in the order they were queued.
+	 */
+	void apply_batch(size_t n) {
+		std::lock_guard<std::mutex> guard(map_lock);
+		order.clear();
+		deferred.assign(n, 0);
+		for (size_t i = 0; i < n; i++) {
+			cell &c = cells[(dequeue_pos + i) & mask];
+			if (c.kind == NOTHING) continue;
+			try {
+				order.push_back(std::make_pair(map.bucket(c.key_ref()), i));
+			} catch (...) {
+				note_error();
+			}
+		}
+		std::stable_sort(order.begin(), order.end(),
+			[](const std::pair<size_t, size_t> &a, const std::pair<size_t, size_t> &b) { return a.first < b.first; });
+		size_t run = 0;
+		for (size_t k = 0; k < order.size(); k++) {
+			// a key's cells all sit in the run of its bucket
+			if (order[k].first != order[run].first) run = k;
+			size_t i = order[k].second;
+			cell &c = cells[(dequeue_pos + i) & mask];
+			try {
+				bool defer = false;
+				for (size_t j = run; j < k && !defer; j++)
+					defer = deferred[order[j].second] && key_equal(cells[(dequeue_pos + order[j].second) & mask].key_ref(), c.key_ref());
+				if (!defer) {
+					typename map_type::iterator it = map.find(c.key_ref());
+					if (it == map.end()) defer = c.kind == ASSIGN;
+					else if (c.kind == ASSIGN) it->second = std::move(c.value_ref());
+					else map.erase(it);
+				}
+				deferred[i] = defer;
+			} catch (...) {
+				note_error();
+			}
+		}
+		for (size_t i = 0; i < n; i++) {
+			if (!deferred[i]) continue;
+			try {
+				apply(cells[(dequeue_pos + i) & mask]);
+			} catch (...) {
+				note_error();
+			}
+		}
+		for (size_t i = 0; i < n; i++) release(cells[(dequeue_pos + i) & mask], dequeue_pos + i);
+		dequeue_pos += n;
+		batches++;
+	}
+
+	void run() {
+		int idle = 0;
+		for (;;) {
+			size_t n = take_batch();
+			if (n > 0) {
+				apply_batch(n);
+				__atomic_store_n(&applied, dequeue_pos, __ATOMIC_RELEASE);
+				idle = 0;
+				continue;
+			}
+			if (__atomic_load_n(&stopping, __ATOMIC_ACQUIRE) && dequeue_pos == __atomic_load_n(&enqueue_pos, __ATOMIC_ACQUIRE)) return;
+			if (++idle < IDLE_SPINS) std::this_thread::yield();
+			else std::this_thread::sleep_for(std::chrono::microseconds(50));
+		}
+	}
+
+public:
+	/**
+	 * a queue of queue_capacity changes (rounded up to a power of 2),
+	 *   applied up to batch_size at a time.
+	 */
+	explicit write_behind_linked_hashmap(size_t queue_capacity = 4096, size_t batch_size = 256)
+		: cells(nullptr), mask(0), batch_limit(batch_size), enqueue_pos(0), applied(0), stopping(0), dequeue_pos(0), batches(0) {
+		if (queue_capacity == 0 || batch_size == 0) throw runtime_error();
+		size_t capacity = 1;
+		while (capacity < queue_capacity) capacity <<= 1;
+		mask = capacity - 1;
+		if (batch_limit > capacity) batch_limit = capacity;
+		cells = new cell[capacity];
+		for (size_t i = 0; i < capacity; i++) cells[i].seq = i;
+		try {
+			order.reserve(batch_limit);
+			deferred.reserve(batch_limit);
+			applier = std::thread([this]() { run(); });
+		} catch (...) {
+			delete[] cells;
+			throw;
+		}
+	}
+	write_behind_linked_hashmap(const write_behind_linked_hashmap &) = delete;
+	write_behind_linked_hashmap & operator=(const write_behind_linked_hashmap &) = delete;
+	/**
+	 * apply what is queued, then stop the applier. nobody may be
+	 *   queueing changes any more.
+	 */
+	~write_behind_linked_hashmap() {
+		__atomic_store_n(&stopping, 1, __ATOMIC_RELEASE);
+		applier.join();
+		delete[] cells;
+	}
+
+	/**
+	 * queue an insertion of key, or a new value for it if present.
+	 *   waits while the queue is full.
+	 */
+	void async_insert(const Key &key, const T &value) {
+		T copy(value);
+		enqueue(ASSIGN, key, &copy);
+	}
+	void async_insert(Key &&key, T &&value) {
+		enqueue(ASSIGN, std::move(key), &value);
+	}
+	/**
+	 * queue an erase of key.
+	 */
+	void async_erase(const Key &key) {
+		enqueue(ERASE, key, nullptr);
+	}
+
+	/**
+	 * wait until every change queued before this call is applied. if
+	 *   applying some change threw since the last flush(), throw that.
+	 */
+	void flush() {
+		unsigned long long target = __atomic_load_n(&enqueue_pos, __ATOMIC_ACQUIRE);
+		while (__atomic_load_n(&applied, __ATOMIC_ACQUIRE) < target) std::this_thread::yield();
+		std::exception_ptr thrown;
+		{
+			std::lock_guard<std::mutex> guard(map_lock);
+			std::swap(thrown, error);
+		}
+		if (thrown) std::rethrow_exception(thrown);
+	}
+
+	/**
+	 * return f(map) with the applier held off; f must not keep
+	 *   references or iterators into the map past its return.
+	 */
+	template<class F>
+	auto read(F f) -> decltype(f(std::declval<const map_type &>())) {
+		std::lock_guard<std::mutex> guard(map_lock);
+		return f(static_cast<const map_type &>(map));
+	}
+	size_t size() {
+		return read([](const map_type &m) { return m.size(); });
+	}
+
+	/**
+	 * changes applied, and the batches they came in; any thread may ask
+	 *   for the first, the second is read under the map's lock.
+	 */
+	unsigned long long applied_count() const { return __atomic_load_n(&applied, __ATOMIC_ACQUIRE); }
+	size_t batch_count() {
+		return read([this](const map_type &) { return batches; });
+	}
+	size_t queue_capacity() const { return mask + 1; }
+};
+
+}
+
+#endif